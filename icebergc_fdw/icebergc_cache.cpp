@@ -0,0 +1,510 @@
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/status.h>
+#include <arrow/util/future.h>
+#include <arrow/util/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "icebergc_cache.h"
+
+char *icebergc_cache_dir = NULL;
+int icebergc_cache_size = 1024;
+
+/* Remote files are cached in aligned blocks of this size. */
+static const int64_t kBlockSize = 1024 * 1024;
+
+/* An eviction pass trims the cache to this fraction of its cap. */
+static const double kEvictTarget = 0.9;
+
+/* Temporary files older than this are leftovers of a crashed backend. */
+static const time_t kStaleTempSeconds = 600;
+
+/* Marks the end of a block file; see BlockCache::Store. */
+static const uint32_t kBlockMagic = 0x49434231; // "ICB1"
+
+/*
+ * Lives in the mmapped "stats" file of the cache directory, so all backends
+ * share it. A new, zero-filled file is a valid initial state.
+ */
+struct SharedStats {
+    std::atomic<int64_t> hits;
+    std::atomic<int64_t> misses;
+    std::atomic<int64_t> evictions;
+    std::atomic<int64_t> bytes;
+};
+static_assert(std::atomic<int64_t>::is_always_lock_free,
+              "cache counters must be usable across processes");
+
+static uint64_t fnv1a(const std::string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* A cached block, mapped read-only; unmapped with the last reference. */
+class MappedBlock : public arrow::Buffer {
+public:
+    MappedBlock(void *map, size_t map_size, int64_t length)
+        : arrow::Buffer(static_cast<const uint8_t *>(map), length), map_(map),
+          map_size_(map_size) {}
+    ~MappedBlock() override { munmap(map_, map_size_); }
+
+private:
+    void *map_;
+    size_t map_size_;
+};
+
+/*
+ * One cache directory. Each block is a file written under a temporary name
+ * and renamed into place, and files are only ever unlinked, never rewritten,
+ * so a mapping stays valid even if another backend evicts the block. Recency
+ * for LRU eviction is the file's mtime, bumped on every hit. Safe to use from
+ * Arrow's I/O threads.
+ */
+class BlockCache {
+public:
+    BlockCache(std::string dir, int64_t capacity);
+    ~BlockCache() { munmap(stats_, sizeof(SharedStats)); }
+    BlockCache(const BlockCache &) = delete;
+    BlockCache &operator=(const BlockCache &) = delete;
+
+    const std::string &dir() const { return dir_; }
+    void set_capacity(int64_t capacity) { capacity_ = capacity; }
+
+    std::shared_ptr<arrow::Buffer> Lookup(const std::string &key, uint64_t hash,
+                                          int64_t block, int64_t length);
+    void Store(const std::string &key, uint64_t hash, int64_t block,
+               const uint8_t *data, int64_t length);
+    void GetStats(IcebergcCacheStats *stats) const;
+
+private:
+    std::string BlockPath(uint64_t hash, int64_t block) const;
+    void Evict();
+
+    std::string dir_;
+    std::atomic<int64_t> capacity_;
+    SharedStats *stats_ = NULL;
+    std::atomic<uint64_t> temp_seq_{0};
+};
+
+BlockCache::BlockCache(std::string dir, int64_t capacity)
+    : dir_(std::move(dir)), capacity_(capacity) {
+    if (mkdir(dir_.c_str(), 0700) != 0 && errno != EEXIST)
+        throw std::runtime_error("could not create cache directory \"" + dir_ +
+                                 "\": " + strerror(errno));
+    std::string path = dir_ + "/stats";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("could not open \"" + path +
+                                 "\": " + strerror(errno));
+    struct stat st;
+    void *map = MAP_FAILED;
+    bool fresh = false;
+    if (fstat(fd, &st) == 0) {
+        fresh = st.st_size == 0;
+        if (st.st_size >= (off_t)sizeof(SharedStats) ||
+            ftruncate(fd, sizeof(SharedStats)) == 0)
+            map = mmap(NULL, sizeof(SharedStats), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+    }
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("could not map \"" + path +
+                                 "\": " + strerror(err));
+    stats_ = static_cast<SharedStats *>(map);
+    /* Blocks may predate the counters; measure them. */
+    if (fresh)
+        Evict();
+}
+
+std::string BlockCache::BlockPath(uint64_t hash, int64_t block) const {
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx.%lld.blk", (unsigned long long)hash,
+             (long long)block);
+    return dir_ + name;
+}
+
+/*
+ * Returns the cached block, or NULL if it is absent or belongs to another key
+ * with the same hash.
+ */
+std::shared_ptr<arrow::Buffer> BlockCache::Lookup(const std::string &key,
+                                                  uint64_t hash, int64_t block,
+                                                  int64_t length) {
+    std::string path = BlockPath(hash, block);
+    size_t file_size = length + key.size() + 2 * sizeof(uint32_t);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size == file_size) {
+            map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+            futimens(fd, NULL);
+        }
+        close(fd);
+        if (map != MAP_FAILED) {
+            const uint8_t *trailer = static_cast<const uint8_t *>(map) + length;
+            uint32_t key_len, magic;
+            memcpy(&key_len, trailer + key.size(), sizeof(key_len));
+            memcpy(&magic, trailer + key.size() + sizeof(key_len), sizeof(magic));
+            if (magic == kBlockMagic && key_len == key.size() &&
+                memcmp(trailer, key.data(), key.size()) == 0) {
+                stats_->hits++;
+                return std::make_shared<MappedBlock>(map, file_size, length);
+            }
+            munmap(map, file_size);
+        }
+    }
+    stats_->misses++;
+    return NULL;
+}
+
+/*
+ * Adds a block. The file holds the data followed by the key, its length and
+ * kBlockMagic, which Lookup checks. Failures only cost a later miss.
+ */
+void BlockCache::Store(const std::string &key, uint64_t hash, int64_t block,
+                       const uint8_t *data, int64_t length) {
+    std::string path = BlockPath(hash, block);
+    std::string temp = path + ".tmp." + std::to_string(getpid()) + "." +
+                       std::to_string(temp_seq_++);
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    uint32_t key_len = key.size();
+    bool ok = write_all(fd, data, length) &&
+              write_all(fd, key.data(), key.size()) &&
+              write_all(fd, &key_len, sizeof(key_len)) &&
+              write_all(fd, &kBlockMagic, sizeof(kBlockMagic));
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return;
+    }
+    int64_t bytes = stats_->bytes += length + key.size() + 2 * sizeof(uint32_t);
+    if (bytes > capacity_)
+        Evict();
+}
+
+/*
+ * Unlinks the least recently used blocks until the cache is under
+ * kEvictTarget of its cap, and resets the shared size to what is on disk. One
+ * backend at a time evicts; the others carry on.
+ */
+void BlockCache::Evict() {
+    std::string lock_path = dir_ + "/lock";
+    int lock = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock < 0)
+        return;
+    if (flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        close(lock);
+        return;
+    }
+
+    struct Entry {
+        struct timespec mtime;
+        int64_t size;
+        std::string path;
+    };
+    std::vector<Entry> entries;
+    int64_t total = 0;
+    time_t now = time(NULL);
+    if (DIR *d = opendir(dir_.c_str())) {
+        while (struct dirent *de = readdir(d)) {
+            std::string name = de->d_name;
+            bool temp = name.find(".tmp.") != std::string::npos;
+            if (!temp && (name.size() < 4 ||
+                          name.compare(name.size() - 4, 4, ".blk") != 0))
+                continue;
+            std::string path = dir_ + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+            if (temp) {
+                if (now - st.st_mtime > kStaleTempSeconds)
+                    unlink(path.c_str());
+                continue;
+            }
+            entries.push_back({st.st_mtim, (int64_t)st.st_size, std::move(path)});
+            total += st.st_size;
+        }
+        closedir(d);
+    }
+
+    int64_t target = (int64_t)(capacity_ * kEvictTarget);
+    if (total > target) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry &a, const Entry &b) {
+                      if (a.mtime.tv_sec != b.mtime.tv_sec)
+                          return a.mtime.tv_sec < b.mtime.tv_sec;
+                      return a.mtime.tv_nsec < b.mtime.tv_nsec;
+                  });
+        for (const Entry &e : entries) {
+            if (total <= target)
+                break;
+            if (unlink(e.path.c_str()) == 0) {
+                total -= e.size;
+                stats_->evictions++;
+            }
+        }
+    }
+    stats_->bytes = total;
+
+    flock(lock, LOCK_UN);
+    close(lock);
+}
+
+void BlockCache::GetStats(IcebergcCacheStats *stats) const {
+    stats->hits = stats_->hits;
+    stats->misses = stats_->misses;
+    stats->evictions = stats_->evictions;
+    stats->bytes = stats_->bytes;
+}
+
+/*
+ * Reads of one remote file, split into blocks. Blocks found in the cache are
+ * mapped; each run of missing blocks is one read from the source, whose result
+ * is stored block by block on an I/O thread.
+ */
+class CachedFile : public arrow::io::RandomAccessFile {
+public:
+    CachedFile(std::shared_ptr<BlockCache> cache,
+               std::shared_ptr<arrow::io::RandomAccessFile> source,
+               std::string key, int64_t size)
+        : cache_(std::move(cache)), source_(std::move(source)),
+          key_(std::move(key)), hash_(fnv1a(key_)), size_(size) {}
+
+    using arrow::io::RandomAccessFile::ReadAsync;
+    using arrow::io::RandomAccessFile::ReadAt;
+
+    arrow::Status Close() override {
+        closed_ = true;
+        return source_->Close();
+    }
+    bool closed() const override { return closed_; }
+
+    arrow::Result<int64_t> GetSize() override { return size_; }
+    arrow::Result<int64_t> Tell() const override { return pos_; }
+    arrow::Status Seek(int64_t position) override {
+        if (position < 0)
+            return arrow::Status::Invalid("negative seek position");
+        pos_ = position;
+        return arrow::Status::OK();
+    }
+
+    arrow::Result<int64_t> Read(int64_t nbytes, void *out) override {
+        ARROW_ASSIGN_OR_RAISE(int64_t n, ReadAt(pos_, nbytes, out));
+        pos_ += n;
+        return n;
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override {
+        ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(pos_, nbytes));
+        pos_ += buf->size();
+        return buf;
+    }
+
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  bool allow_short_read, void *out) override {
+        ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(position, nbytes, allow_short_read));
+        memcpy(out, buf->data(), buf->size());
+        return buf->size();
+    }
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  void *out) override {
+        return ReadAt(position, nbytes, true, out);
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>>
+    ReadAt(int64_t position, int64_t nbytes, bool allow_short_read) override {
+        return ReadAsync(io_context(), position, nbytes, allow_short_read).result();
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position,
+                                                         int64_t nbytes) override {
+        return ReadAt(position, nbytes, true);
+    }
+
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &ctx, int64_t position, int64_t nbytes,
+              bool allow_short_read) override;
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &ctx, int64_t position,
+              int64_t nbytes) override {
+        return ReadAsync(ctx, position, nbytes, true);
+    }
+
+private:
+    typedef arrow::Future<std::shared_ptr<arrow::Buffer>> BufferFuture;
+    typedef std::vector<std::shared_ptr<arrow::Buffer>> BlockList;
+
+    int64_t BlockLength(int64_t block) const {
+        return std::min(kBlockSize, size_ - block * kBlockSize);
+    }
+
+    std::shared_ptr<BlockCache> cache_;
+    std::shared_ptr<arrow::io::RandomAccessFile> source_;
+    std::string key_;
+    uint64_t hash_;
+    int64_t size_;
+    int64_t pos_ = 0;
+    bool closed_ = false;
+};
+
+/* Copies bytes [offset, offset + n) of the concatenated blocks. */
+static arrow::Result<std::shared_ptr<arrow::Buffer>>
+assemble(const std::vector<std::shared_ptr<arrow::Buffer>> &blocks,
+         int64_t offset, int64_t n) {
+    if (blocks.size() == 1)
+        return arrow::SliceBuffer(blocks[0], offset, n);
+    ARROW_ASSIGN_OR_RAISE(std::unique_ptr<arrow::Buffer> out,
+                          arrow::AllocateBuffer(n));
+    uint8_t *dst = out->mutable_data();
+    for (const auto &block : blocks) {
+        if (offset >= block->size()) {
+            offset -= block->size();
+            continue;
+        }
+        int64_t len = std::min(block->size() - offset, n);
+        memcpy(dst, block->data() + offset, len);
+        dst += len;
+        n -= len;
+        offset = 0;
+        if (n == 0)
+            break;
+    }
+    return std::shared_ptr<arrow::Buffer>(std::move(out));
+}
+
+arrow::Future<std::shared_ptr<arrow::Buffer>>
+CachedFile::ReadAsync(const arrow::io::IOContext &ctx, int64_t position,
+                      int64_t nbytes, bool allow_short_read) {
+    if (closed_)
+        return BufferFuture::MakeFinished(
+            arrow::Status::Invalid("cached file is closed"));
+    if (position < 0 || nbytes < 0)
+        return BufferFuture::MakeFinished(
+            arrow::Status::Invalid("invalid read range"));
+    int64_t n = std::min(nbytes, std::max<int64_t>(size_ - position, 0));
+    if (n < nbytes && !allow_short_read)
+        return BufferFuture::MakeFinished(
+            arrow::Status::IOError("read past the end of the file"));
+    if (n == 0)
+        return BufferFuture::MakeFinished(std::make_shared<arrow::Buffer>(
+            static_cast<const uint8_t *>(NULL), 0));
+
+    int64_t first = position / kBlockSize;
+    int64_t last = (position + n - 1) / kBlockSize;
+    int64_t offset = position - first * kBlockSize;
+    auto blocks = std::make_shared<BlockList>(last - first + 1);
+    for (int64_t b = first; b <= last; ++b)
+        (*blocks)[b - first] = cache_->Lookup(key_, hash_, b, BlockLength(b));
+
+    /* Runs of missing blocks, as [start, end) block numbers. */
+    std::vector<std::pair<int64_t, int64_t>> runs;
+    std::vector<BufferFuture> fetches;
+    for (int64_t b = first; b <= last; ++b) {
+        if ((*blocks)[b - first])
+            continue;
+        int64_t end = b + 1;
+        while (end <= last && !(*blocks)[end - first])
+            ++end;
+        int64_t start_byte = b * kBlockSize;
+        int64_t len = std::min(end * kBlockSize, size_) - start_byte;
+        runs.emplace_back(b, end);
+        fetches.push_back(source_->ReadAsync(ctx, start_byte, len, false));
+        b = end;
+    }
+    if (runs.empty())
+        return BufferFuture::MakeFinished(assemble(*blocks, offset, n));
+
+    auto cache = cache_;
+    std::string key = key_;
+    uint64_t hash = hash_;
+    return ctx.executor()
+        ->Transfer(arrow::All(std::move(fetches)))
+        .Then([=](const std::vector<arrow::Result<std::shared_ptr<arrow::Buffer>>>
+                      &results) -> arrow::Result<std::shared_ptr<arrow::Buffer>> {
+            for (size_t i = 0; i < runs.size(); ++i) {
+                ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Buffer> data,
+                                      results[i]);
+                int64_t base = runs[i].first * kBlockSize;
+                for (int64_t b = runs[i].first; b < runs[i].second; ++b) {
+                    int64_t off = b * kBlockSize - base;
+                    int64_t len = std::min(kBlockSize, data->size() - off);
+                    cache->Store(key, hash, b, data->data() + off, len);
+                    (*blocks)[b - first] = arrow::SliceBuffer(data, off, len);
+                }
+            }
+            return assemble(*blocks, offset, n);
+        });
+}
+
+/* The cache for the configured directory; only the backend thread calls this. */
+static std::shared_ptr<BlockCache> current_cache() {
+    static std::shared_ptr<BlockCache> cache;
+    if (!icebergc_cache_dir || icebergc_cache_dir[0] == '\0')
+        return NULL;
+    int64_t capacity = (int64_t)icebergc_cache_size * 1024 * 1024;
+    if (!cache || cache->dir() != icebergc_cache_dir)
+        cache = std::make_shared<BlockCache>(icebergc_cache_dir, capacity);
+    cache->set_capacity(capacity);
+    return cache;
+}
+
+std::shared_ptr<arrow::io::RandomAccessFile>
+cache_wrap_file(std::shared_ptr<arrow::io::RandomAccessFile> source,
+                const std::string &path, const std::string &version) {
+    std::shared_ptr<BlockCache> cache = current_cache();
+    if (!cache || version.empty())
+        return source;
+    arrow::Result<int64_t> size = source->GetSize();
+    if (!size.ok())
+        throw std::runtime_error(path + ": " + size.status().ToString());
+    return std::make_shared<CachedFile>(std::move(cache), std::move(source),
+                                        path + '\0' + version, *size);
+}
+
+extern "C" bool icebergc_cache_get_stats(IcebergcCacheStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    try {
+        std::shared_ptr<BlockCache> cache = current_cache();
+        if (!cache)
+            return false;
+        cache->GetStats(stats);
+        return true;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
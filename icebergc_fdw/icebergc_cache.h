@@ -0,0 +1,49 @@
+#ifndef ICEBERGC_CACHE_H
+#define ICEBERGC_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* GUCs, registered in _PG_init. An empty directory disables the cache. */
+extern char *icebergc_cache_dir;  /* icebergc_fdw.cache_dir */
+extern int icebergc_cache_size;   /* icebergc_fdw.cache_size, in MB */
+
+/* Counters shared by every backend using the same cache directory. */
+typedef struct IcebergcCacheStats {
+    int64_t hits;      /* blocks served from the cache */
+    int64_t misses;    /* blocks read from S3 or HDFS */
+    int64_t evictions; /* blocks removed to stay under the size cap */
+    int64_t bytes;     /* approximate size of the cached blocks */
+} IcebergcCacheStats;
+
+/*
+ * Reads the counters of the configured cache directory. Returns false, with
+ * *stats zeroed, if the cache is disabled or unusable. Never throws.
+ */
+bool icebergc_cache_get_stats(IcebergcCacheStats *stats);
+
+#ifdef __cplusplus
+}
+
+#include <memory>
+#include <string>
+
+#include <arrow/io/interfaces.h>
+
+/*
+ * Serves reads of a remote file through the local block cache. Blocks are
+ * keyed by path, version (ETag or modification time) and offset, so a new
+ * version of the file never sees stale data. Returns source itself if the
+ * cache is disabled or version is empty. Throws std::runtime_error if the
+ * cache directory cannot be set up.
+ */
+std::shared_ptr<arrow::io::RandomAccessFile>
+cache_wrap_file(std::shared_ptr<arrow::io::RandomAccessFile> source,
+                const std::string &path, const std::string &version);
+#endif
+
+#endif // ICEBERGC_CACHE_H
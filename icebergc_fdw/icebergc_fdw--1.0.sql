@@ -11,3 +11,38 @@ LANGUAGE C STRICT;
 CREATE FOREIGN DATA WRAPPER icebergc_fdw
   HANDLER icebergc_fdw_handler
   VALIDATOR icebergc_fdw_validator;
+
+CREATE FUNCTION icebergc_fdw_cache_stats(
+  OUT hits bigint,
+  OUT misses bigint,
+  OUT evictions bigint,
+  OUT cached_bytes bigint,
+  OUT capacity_bytes bigint)
+RETURNS record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION icebergc_fdw_hms_invalidate(
+  db text DEFAULT NULL,
+  table_name text DEFAULT NULL)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+CREATE FUNCTION icebergc_fdw_stats(
+  OUT name text,
+  OUT le float8,
+  OUT value bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE VIEW icebergc_fdw_stats AS
+  SELECT * FROM icebergc_fdw_stats();
+
+CREATE FUNCTION icebergc_fdw_stats_reset()
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION icebergc_fdw_stats_reset() FROM PUBLIC;
@@ -1,39 +1,110 @@
+#include "postgres.h"
+
+#include <float.h>
+#include <math.h>
+
 #include "access/htup_details.h"
+#include "access/parallel.h"
+#include "access/reloptions.h"
+#include "access/stratnum.h"
+#include "access/sysattr.h"
+#include "access/table.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_foreign_server.h"
+#include "catalog/pg_foreign_table.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "commands/explain.h"
+#include "commands/vacuum.h"
 #include "executor/executor.h"
 #include "fmgr.h"
 #include "foreign/fdwapi.h"
 #include "foreign/foreign.h"
+#include "funcapi.h"
+#include "icebergc_cache.h"
 #include "icebergc_hms.h"
+#include "icebergc_stats.h"
+#include "lib/binaryheap.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/primnodes.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/planmain.h"
+#include "optimizer/restrictinfo.h"
 #include "parquet_utils.h"
-#include "postgres.h"
+#include "parser/parsetree.h"
+#include "port/atomics.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datum.h"
 #include "utils/errcodes.h"
+#include "utils/fmgroids.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/sampling.h"
+#include "utils/sortsupport.h"
+#include "utils/syscache.h"
+#include "utils/tuplesort.h"
+#include "utils/tuplestore.h"
 
 PG_MODULE_MAGIC;
 
 PG_FUNCTION_INFO_V1(icebergc_fdw_handler);
 PG_FUNCTION_INFO_V1(icebergc_fdw_validator);
+PG_FUNCTION_INFO_V1(icebergc_fdw_cache_stats);
+PG_FUNCTION_INFO_V1(icebergc_fdw_hms_invalidate);
+PG_FUNCTION_INFO_V1(icebergc_fdw_stats);
+PG_FUNCTION_INFO_V1(icebergc_fdw_stats_reset);
+
+void _PG_init(void);
+
+static double icebergc_remote_page_cost = 4.0;
+static double icebergc_remote_file_cost = 100.0;
+static int icebergc_analyze_read_size = 64; /* MB */
 
 static void icebergcGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel,
                                       Oid foreigntableid);
 static void icebergcGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel,
                                     Oid foreigntableid);
+static void icebergcGetForeignUpperPaths(PlannerInfo *root,
+                                         UpperRelationKind stage,
+                                         RelOptInfo *input_rel,
+                                         RelOptInfo *output_rel, void *extra);
 static ForeignScan *
 icebergcGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
                        Oid foreigntableid, ForeignPath *best_path, List *tlist,
                        List *scan_clauses, Plan *outer_plan);
 static void icebergcBeginForeignScan(ForeignScanState *node, int eflags);
 static TupleTableSlot *icebergcIterateForeignScan(ForeignScanState *node);
+static void icebergcReScanForeignScan(ForeignScanState *node);
+static void release_scan(void *arg);
 static void icebergcEndForeignScan(ForeignScanState *node);
+static void icebergcExplainForeignScan(ForeignScanState *node,
+                                       ExplainState *es);
+static bool icebergcIsForeignScanParallelSafe(PlannerInfo *root,
+                                              RelOptInfo *rel,
+                                              RangeTblEntry *rte);
+static Size icebergcEstimateDSMForeignScan(ForeignScanState *node,
+                                           ParallelContext *pcxt);
+static void icebergcInitializeDSMForeignScan(ForeignScanState *node,
+                                             ParallelContext *pcxt,
+                                             void *coordinate);
+static void icebergcReInitializeDSMForeignScan(ForeignScanState *node,
+                                               ParallelContext *pcxt,
+                                               void *coordinate);
+static void icebergcInitializeWorkerForeignScan(ForeignScanState *node,
+                                                shm_toc *toc,
+                                                void *coordinate);
+static bool icebergcAnalyzeForeignTable(Relation relation,
+                                        AcquireSampleRowsFunc *func,
+                                        BlockNumber *totalpages);
 static void validate_schema(Relation rel);
 
 typedef struct IcebergcFdwOptions {
@@ -43,6 +114,15 @@ typedef struct IcebergcFdwOptions {
   char *catalog_uri;
   char *warehouse;
   char *s3_endpoint;
+  char *metadata_location; /* Iceberg metadata.json of the table */
+  char *table_name;        /* or [namespace.]name under warehouse */
+  int64 snapshot_id;       /* 0 = current snapshot */
+  int s3_max_connections;          /* 0 = let aws-c-s3 decide */
+  int s3_part_size;                /* bytes; 0 = default */
+  double s3_throughput_target_gbps; /* 0 = default */
+  int hms_connect_timeout;         /* ms; 0 = Thrift default */
+  int hms_timeout;                 /* ms; 0 = none */
+  bool hms_framed;                 /* framed rather than buffered transport */
 } IcebergcFdwOptions;
 
 typedef enum { ICEBERG_FILTER_OP, ICEBERG_FILTER_BETWEEN } IcebergFilterKind;
@@ -52,7 +132,11 @@ typedef struct IcebergFilter {
   char *column;
   char *op; /* used when kind == ICEBERG_FILTER_OP */
   char *val1;
-  char *val2; /* used for BETWEEN */
+  char *val2;         /* used for BETWEEN */
+  AttrNumber attnum;  /* column as an attribute number */
+  Oid valtype;        /* type of value1 and value2 */
+  Datum value1;       /* binary forms of val1 and val2 */
+  Datum value2;
 } IcebergFilter;
 
 typedef struct IcebergScanState {
@@ -60,16 +144,191 @@ typedef struct IcebergScanState {
   List *filters;            /* list of IcebergFilter* */
   List *columns;            /* list of column names */
   ParquetReader *reader;    /* current parquet reader */
-  AttInMetadata *attinmeta; /* attribute input metadata */
-  char **values;            /* row buffer */
+  ParquetFileQueue *queue;  /* serial scans: opens the files in order */
+  IcebergcS3Options s3;
+  ParquetScanSpec spec;     /* how each data file is read */
+  IcebergScanFiles files;   /* data files to scan, in order */
+  bool iceberg;             /* files listed from a snapshot's manifests */
+  int next_file;            /* index into files.paths */
+  ParquetReaderStats stats; /* totals of the readers already closed */
+  MemoryContextCallback *cleanup; /* releases them if the query fails */
+  struct IcebergParallelScan *pscan; /* shared state of a parallel scan */
+  int file;                 /* parallel scans: files index of the reader */
+  struct IcebergTopN *top_n; /* ORDER BY ... LIMIT scans */
+  struct IcebergAggScan *agg; /* aggregate scans */
 } IcebergScanState;
 
+/*
+ * Shared by the processes of a parallel scan. Row groups are the units of
+ * work: a process claims a file nobody has opened yet, publishes its row
+ * group count and claims its row groups one at a time, so that others can
+ * join in. Once every file is claimed, processes help with the row groups
+ * left in files opened by others, and the tail of the scan is spread one row
+ * group at a time rather than one file at a time.
+ */
+typedef struct IcebergParallelFile {
+  pg_atomic_uint32 row_groups;     /* 0 until the file is opened */
+  pg_atomic_uint32 next_row_group; /* next row group to hand out */
+  Size path;                       /* offset of the path in the scan state */
+} IcebergParallelFile;
+
+typedef struct IcebergParallelScan {
+  pg_atomic_uint32 next_file; /* next file nobody has opened */
+  int nfiles;
+  IcebergParallelFile files[FLEXIBLE_ARRAY_MEMBER];
+} IcebergParallelScan;
+
+/*
+ * ORDER BY ... LIMIT scans sort the rows themselves and return only the
+ * first `limit`. The leading sort keys of the best rows so far are kept in a
+ * heap, worst on top; once it holds `limit` of them, its top is the bound
+ * the reader skips row groups with.
+ */
+typedef struct IcebergTopN {
+  int nkeys;
+  AttrNumber *attnums;
+  Oid *sortops;
+  Oid *collations;
+  bool *nulls_first;
+  int limit;
+  SortSupportData first;  /* compares leading keys */
+  bool first_byval;
+  int16 first_len;
+  binaryheap *best;       /* non-NULL leading keys, worst on top */
+  Tuplesortstate *sort;   /* NULL until the rows are collected */
+  TupleTableSlot *sorted; /* rows come out of the sort here */
+  MemoryContext cxt;      /* the scan's */
+  MemoryContext row_cxt;  /* reset after each row given to the sort */
+} IcebergTopN;
+
+/*
+ * Aggregate scans compute count(*), and count and min/max of attributes, for
+ * the rows passing the pushed quals in one pass that returns a single row.
+ * min/max stand for any aggregate with a sort operator: its result is the
+ * first value in that operator's order. Row groups whose statistics answer
+ * every aggregate are not decoded; see parquet_reader_summarize.
+ */
+typedef struct IcebergAggregate {
+  AttrNumber attnum;    /* 0 for count(*) */
+  bool count;           /* count(*) or count(attnum) */
+  SortSupportData ssup; /* the others: orders values, result first */
+  bool byval;
+  int16 len;
+  int64 n;              /* counts */
+  bool isnull;          /* the others: their value so far */
+  Datum value;
+} IcebergAggregate;
+
+typedef struct IcebergAggScan {
+  int naggs;
+  IcebergAggregate *aggs;
+  int *attnums;         /* for parquet_reader_summarize */
+  bool *bounds;
+  Datum *values;        /* a row of the table */
+  bool *nulls;
+  bool done;            /* the result row has been returned */
+  MemoryContext cxt;    /* the scan's */
+  MemoryContext row_cxt; /* reset after each row */
+} IcebergAggScan;
+
+/* Largest LIMIT a top-N scan takes: its heap of leading keys is one palloc. */
+#define TOP_N_MAX_ROWS ((double)(MaxAllocSize / sizeof(Datum) / 2))
+
+/* Indexes of the items stored in ForeignScan.fdw_private. */
+enum IcebergFdwScanPrivateIndex {
+  IcebergFdwScanPrivateColumns, /* String list of columns the scan reads */
+  IcebergFdwScanPrivateFilters, /* quals the reader evaluates for the executor */
+  IcebergFdwScanPrivateLimit,   /* Integer: rows a LIMIT takes, 0 if none */
+  IcebergFdwScanPrivateSortKeys, /* top-N scans: see top_n_sort_keys */
+  IcebergFdwScanPrivateAggregates, /* aggregate scans: see aggregate_items */
+};
+
 static List *extract_filters(Relation rel, List *quals);
-static List *extract_projection(Relation rel, List *tlist);
+static bool is_exact_clause(Relation rel, Expr *clause);
+static Node *strip_relabel(Node *node);
+static IcebergFilter *make_op_filter(Relation rel, OpExpr *op);
+static bool make_parquet_filter(IcebergFilter *f, TupleDesc desc,
+                                ParquetFilter *pf);
+static void free_filter(IcebergFilter *f);
+static List *extract_projection(Relation rel, Bitmapset *attrs_used);
+static bool *columns_used(TupleDesc desc, List *columns);
 static char *datum_to_cstring(Datum d, Oid typeoid);
 static bool list_member_str(List *list, const char *str);
 
+static bool icebergc_string_option(const char *name);
+static bool icebergc_s3_tuning_option(DefElem *def, IcebergcFdwOptions *opts);
+static bool icebergc_hms_option(DefElem *def, IcebergcFdwOptions *opts);
+static int64 icebergc_snapshot_id(DefElem *def);
 static IcebergcFdwOptions *icebergcGetOptions(Oid foreigntableid, Oid serverid);
+static void icebergc_s3_options(const IcebergcFdwOptions *opts,
+                                IcebergcS3Options *s3);
+static bool icebergc_table_ref(const IcebergcFdwOptions *opts,
+                               const IcebergcS3Options *s3,
+                               IcebergTableRef *ref);
+static bool icebergc_uses_hms(const IcebergcFdwOptions *opts);
+
+void _PG_init(void) {
+  DefineCustomStringVariable(
+      "icebergc_fdw.cache_dir",
+      "Directory of the local block cache for S3 and HDFS files.",
+      "Shared by all backends. Empty disables the cache.", &icebergc_cache_dir,
+      "", PGC_SIGHUP, 0, NULL, NULL, NULL);
+  DefineCustomIntVariable("icebergc_fdw.cache_size",
+                          "Size cap of the local block cache.", NULL,
+                          &icebergc_cache_size, 1024, 1, INT_MAX, PGC_SIGHUP,
+                          GUC_UNIT_MB, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.metadata_cache_size",
+      "Memory for parsed Parquet footers kept by each backend.",
+      "Zero disables the footer cache.", &icebergc_metadata_cache_size,
+      16 * 1024, 0, INT_MAX, PGC_USERSET, GUC_UNIT_KB, NULL, NULL, NULL);
+  DefineCustomRealVariable(
+      "icebergc_fdw.remote_page_cost",
+      "Planner's estimate of the cost of reading 8kB of an S3 or HDFS file.",
+      "Local files are charged seq_page_cost.", &icebergc_remote_page_cost,
+      4.0, 0, DBL_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+  DefineCustomRealVariable(
+      "icebergc_fdw.remote_file_cost",
+      "Planner's estimate of the cost of opening an S3 or HDFS file.",
+      "Covers the requests made before the first column chunk arrives.",
+      &icebergc_remote_file_cost, 100.0, 0, DBL_MAX, PGC_USERSET, 0, NULL,
+      NULL, NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.analyze_read_size",
+      "Column data ANALYZE reads from a table to sample its rows.", NULL,
+      &icebergc_analyze_read_size, 64, 1, INT_MAX, PGC_USERSET, GUC_UNIT_MB,
+      NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.prefetch_row_groups",
+      "Row groups a scan decodes ahead on a background thread.",
+      "Zero decodes them on the backend as they are reached.",
+      &icebergc_prefetch_row_groups, 1, 0, 64, PGC_USERSET, 0, NULL, NULL,
+      NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.scan_memory_limit",
+      "Decoded data a scan may hold at once.",
+      "Past half of it row groups are no longer decoded ahead; past it the "
+      "scan fails. Zero disables the limit.",
+      &icebergc_scan_memory_limit, 1024 * 1024, 0, INT_MAX, PGC_USERSET,
+      GUC_UNIT_KB, NULL, NULL, NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.files_in_flight",
+      "S3 files a scan keeps requested, counting the one it is reading.",
+      "Files known to be under 1MB are read whole by that request.",
+      &icebergc_files_in_flight, 8, 1, 1024, PGC_USERSET, 0, NULL, NULL,
+      NULL);
+  DefineCustomIntVariable(
+      "icebergc_fdw.hms_cache_ttl",
+      "How long Hive Metastore table lookups are reused.",
+      "Zero disables the cache.", &icebergc_hms_cache_ttl, 60, 0, INT_MAX,
+      PGC_USERSET, GUC_UNIT_S, NULL, NULL, NULL);
+#if PG_VERSION_NUM >= 150000
+  MarkGUCPrefixReserved("icebergc_fdw");
+#else
+  EmitWarningsOnPlaceholders("icebergc_fdw");
+#endif
+  icebergc_stats_init();
+}
 
 Datum icebergc_fdw_handler(PG_FUNCTION_ARGS) {
   FdwRoutine *routine = makeNode(FdwRoutine);
@@ -80,46 +339,258 @@ Datum icebergc_fdw_handler(PG_FUNCTION_ARGS) {
   routine->GetForeignRelSize = icebergcGetForeignRelSize;
   routine->GetForeignPaths = icebergcGetForeignPaths;
   routine->GetForeignPlan = icebergcGetForeignPlan;
+  routine->GetForeignUpperPaths = icebergcGetForeignUpperPaths;
   routine->BeginForeignScan = icebergcBeginForeignScan;
   routine->IterateForeignScan = icebergcIterateForeignScan;
+  routine->ReScanForeignScan = icebergcReScanForeignScan;
   routine->EndForeignScan = icebergcEndForeignScan;
+  routine->ExplainForeignScan = icebergcExplainForeignScan;
+  routine->IsForeignScanParallelSafe = icebergcIsForeignScanParallelSafe;
+  routine->EstimateDSMForeignScan = icebergcEstimateDSMForeignScan;
+  routine->InitializeDSMForeignScan = icebergcInitializeDSMForeignScan;
+  routine->ReInitializeDSMForeignScan = icebergcReInitializeDSMForeignScan;
+  routine->InitializeWorkerForeignScan = icebergcInitializeWorkerForeignScan;
+  routine->AnalyzeForeignTable = icebergcAnalyzeForeignTable;
 
   PG_RETURN_POINTER(routine);
 }
 
+/*
+ * Options are accepted on the server and on the table; a table option
+ * overrides the server's. Whether the table is located (catalog_uri,
+ * metadata_location or table_name) is checked when it is used, since the
+ * options may come from either place.
+ */
 Datum icebergc_fdw_validator(PG_FUNCTION_ARGS) {
   List *options_list = untransformRelOptions(PG_GETARG_DATUM(0));
-  Oid relid = PG_GETARG_OID(1);
+  Oid catalog = PG_GETARG_OID(1);
+  IcebergcFdwOptions scratch = {0};
   ListCell *lc;
-  bool catalog_uri_found = false;
 
   foreach (lc, options_list) {
     DefElem *def = (DefElem *)lfirst(lc);
 
-    if (strcmp(def->defname, "aws_access_key_id") == 0 ||
-        strcmp(def->defname, "aws_secret_access_key") == 0 ||
-        strcmp(def->defname, "region") == 0 ||
-        strcmp(def->defname, "catalog_uri") == 0 ||
-        strcmp(def->defname, "warehouse") == 0 ||
-        strcmp(def->defname, "s3_endpoint") == 0) {
-      if (strcmp(def->defname, "catalog_uri") == 0)
-        catalog_uri_found = true;
-    } else {
+    if (catalog != ForeignServerRelationId &&
+        catalog != ForeignTableRelationId)
+      ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
+                      errmsg("invalid option \"%s\"", def->defname),
+                      errhint("icebergc_fdw options are set on the server "
+                              "or the foreign table.")));
+
+    if (strcmp(def->defname, "snapshot_id") == 0)
+      (void)icebergc_snapshot_id(def);
+    else if (!icebergc_string_option(def->defname) &&
+             !icebergc_s3_tuning_option(def, &scratch) &&
+             !icebergc_hms_option(def, &scratch))
       ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
                       errmsg("invalid option \"%s\"", def->defname)));
-    }
   }
 
-  if (!catalog_uri_found)
-    ereport(ERROR, (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-                    errmsg("\"catalog_uri\" option is required")));
+  PG_RETURN_VOID();
+}
+
+static bool icebergc_string_option(const char *name) {
+  return strcmp(name, "aws_access_key_id") == 0 ||
+         strcmp(name, "aws_secret_access_key") == 0 ||
+         strcmp(name, "region") == 0 || strcmp(name, "catalog_uri") == 0 ||
+         strcmp(name, "warehouse") == 0 || strcmp(name, "s3_endpoint") == 0 ||
+         strcmp(name, "metadata_location") == 0 ||
+         strcmp(name, "table_name") == 0;
+}
+
+static int64 icebergc_snapshot_id(DefElem *def) {
+  char *value = defGetString(def);
+  char *end;
+  long long id;
+
+  errno = 0;
+  id = strtoll(value, &end, 10);
+  if (errno != 0 || end == value || *end != '\0' || id <= 0)
+    ereport(ERROR,
+            (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+             errmsg("\"%s\" must be a positive integer", def->defname)));
+  return (int64)id;
+}
+
+/*
+ * Parses the S3 client tuning options into opts. Returns false if def is not
+ * one of them; raises an error for a bad value.
+ */
+static bool icebergc_s3_tuning_option(DefElem *def, IcebergcFdwOptions *opts) {
+  char *value;
+  const char *hintmsg = NULL;
+
+  if (strcmp(def->defname, "s3_max_connections") == 0) {
+    value = defGetString(def);
+    if (!parse_int(value, &opts->s3_max_connections, 0, &hintmsg) ||
+        opts->s3_max_connections <= 0)
+      ereport(ERROR,
+              (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+               errmsg("\"%s\" must be a positive integer", def->defname),
+               hintmsg ? errhint("%s", _(hintmsg)) : 0));
+  } else if (strcmp(def->defname, "s3_part_size") == 0) {
+    value = defGetString(def);
+    if (!parse_int(value, &opts->s3_part_size, GUC_UNIT_BYTE, &hintmsg) ||
+        opts->s3_part_size <= 0)
+      ereport(ERROR,
+              (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+               errmsg("\"%s\" must be a positive size", def->defname),
+               hintmsg ? errhint("%s", _(hintmsg)) : 0));
+  } else if (strcmp(def->defname, "s3_throughput_target_gbps") == 0) {
+    value = defGetString(def);
+    if (!parse_real(value, &opts->s3_throughput_target_gbps, 0, &hintmsg) ||
+        opts->s3_throughput_target_gbps <= 0)
+      ereport(ERROR,
+              (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+               errmsg("\"%s\" must be a positive number", def->defname),
+               hintmsg ? errhint("%s", _(hintmsg)) : 0));
+  } else
+    return false;
+  return true;
+}
+
+/*
+ * Parses the Hive Metastore connection options into opts. Returns false if
+ * def is not one of them; raises an error for a bad value.
+ */
+static bool icebergc_hms_option(DefElem *def, IcebergcFdwOptions *opts) {
+  char *value;
+  const char *hintmsg = NULL;
+  int *timeout;
+
+  if (strcmp(def->defname, "hms_connect_timeout") == 0)
+    timeout = &opts->hms_connect_timeout;
+  else if (strcmp(def->defname, "hms_timeout") == 0)
+    timeout = &opts->hms_timeout;
+  else if (strcmp(def->defname, "hms_transport") == 0) {
+    value = defGetString(def);
+    if (strcmp(value, "framed") == 0)
+      opts->hms_framed = true;
+    else if (strcmp(value, "buffered") == 0)
+      opts->hms_framed = false;
+    else
+      ereport(ERROR,
+              (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+               errmsg("\"%s\" must be \"buffered\" or \"framed\"",
+                      def->defname)));
+    return true;
+  } else
+    return false;
+
+  value = defGetString(def);
+  if (!parse_int(value, timeout, GUC_UNIT_MS, &hintmsg) || *timeout <= 0)
+    ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+                    errmsg("\"%s\" must be a positive duration", def->defname),
+                    hintmsg ? errhint("%s", _(hintmsg)) : 0));
+  return true;
+}
+
+/*
+ * Counters of the block cache, shared by all backends using the same
+ * directory. All zero while the cache is disabled.
+ */
+Datum icebergc_fdw_cache_stats(PG_FUNCTION_ARGS) {
+  TupleDesc tupdesc;
+  IcebergcCacheStats stats;
+  Datum values[5];
+  bool nulls[5] = {0};
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+
+  icebergc_cache_get_stats(&stats);
+  values[0] = Int64GetDatum(stats.hits);
+  values[1] = Int64GetDatum(stats.misses);
+  values[2] = Int64GetDatum(stats.evictions);
+  values[3] = Int64GetDatum(stats.bytes);
+  values[4] = Int64GetDatum(icebergc_cache_dir && icebergc_cache_dir[0]
+                                ? (int64)icebergc_cache_size * 1024 * 1024
+                                : 0);
+
+  PG_RETURN_DATUM(
+      HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Forgets this backend's cached Hive Metastore lookups: all of them, those of
+ * one database, of one table, or of tables of that name in any database.
+ */
+Datum icebergc_fdw_hms_invalidate(PG_FUNCTION_ARGS) {
+  char *db = PG_ARGISNULL(0) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(0));
+  char *table = PG_ARGISNULL(1) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+  hms_invalidate(db, table);
+  PG_RETURN_VOID();
+}
+
+static void stats_row(Tuplestorestate *store, TupleDesc tupdesc,
+                      const char *name, double le, int64 value) {
+  Datum values[3];
+  bool nulls[3] = {0};
+
+  values[0] = CStringGetTextDatum(name);
+  if (isnan(le))
+    nulls[1] = true;
+  else
+    values[1] = Float8GetDatum(le);
+  values[2] = Int64GetDatum(value);
+  tuplestore_putvalues(store, tupdesc, values, nulls);
+}
+
+/*
+ * The counters of all backends since the server started or they were reset,
+ * one per row, then the local block cache's. Latencies come as cumulative
+ * histograms: a row per bucket, with its upper bound in le.
+ */
+Datum icebergc_fdw_stats(PG_FUNCTION_ARGS) {
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  TupleDesc tupdesc;
+  IcebergcStatsSnapshot snapshot;
+  IcebergcCacheStats cache;
 
-  if (OidIsValid(relid)) {
-    Relation rel = relation_open(relid, AccessShareLock);
-    validate_schema(rel);
-    relation_close(rel, AccessShareLock);
+  if (!icebergc_stats_read(&snapshot))
+    ereport(ERROR,
+            (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+             errmsg("icebergc_fdw must be loaded via shared_preload_libraries")));
+  if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+      !(rsinfo->allowedModes & SFRM_Materialize))
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("set-valued function called in context that "
+                           "cannot accept a set")));
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+
+  MemoryContext oldcxt =
+      MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  Tuplestorestate *store = tuplestore_begin_heap(true, false, work_mem);
+  tupdesc = CreateTupleDescCopy(tupdesc);
+  MemoryContextSwitchTo(oldcxt);
+
+  for (int i = 0; i < ICEBERGC_NUM_STATS; i++)
+    stats_row(store, tupdesc, icebergc_stat_names[i], NAN,
+              snapshot.counters[i]);
+  icebergc_cache_get_stats(&cache);
+  stats_row(store, tupdesc, "cache_hits", NAN, cache.hits);
+  stats_row(store, tupdesc, "cache_misses", NAN, cache.misses);
+  stats_row(store, tupdesc, "cache_evictions", NAN, cache.evictions);
+  for (int i = 0; i < ICEBERGC_NUM_LATENCIES; i++) {
+    int64 count = 0;
+    for (int b = 0; b < ICEBERGC_LATENCY_BUCKETS; b++) {
+      count += snapshot.latencies[i][b];
+      stats_row(store, tupdesc, icebergc_latency_names[i],
+                icebergc_latency_bound(b), count);
+    }
   }
 
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = store;
+  rsinfo->setDesc = tupdesc;
+  return (Datum)0;
+}
+
+/* Zeroes the counters of icebergc_fdw_stats(), but not the cache's. */
+Datum icebergc_fdw_stats_reset(PG_FUNCTION_ARGS) {
+  icebergc_stats_reset();
   PG_RETURN_VOID();
 }
 
@@ -132,7 +603,191 @@ static void icebergcGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel,
     ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), errmsg("baserel is NULL")));
   if (root == NULL)
     ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), errmsg("root is NULL")));
-  baserel->rows = 1;
+
+  /* The footers or manifests read here are cached for the scan. */
+  IcebergcFdwOptions *opts =
+      icebergcGetOptions(foreigntableid, baserel->serverid);
+  IcebergcS3Options s3;
+  IcebergTableRef table;
+  ParquetScanEstimate *est = palloc0(sizeof(ParquetScanEstimate));
+  bool known;
+  ListCell *lc;
+
+  /* Columns the scan reads: the target list plus every qual. */
+  Bitmapset *attrs_used = NULL;
+  pull_varattnos((Node *)baserel->reltarget->exprs, baserel->relid,
+                 &attrs_used);
+  foreach (lc, baserel->baserestrictinfo)
+    pull_varattnos((Node *)lfirst_node(RestrictInfo, lc)->clause,
+                   baserel->relid, &attrs_used);
+
+  Relation rel = table_open(foreigntableid, NoLock);
+  TupleDesc desc = RelationGetDescr(rel);
+
+  /*
+   * Comparisons with a reader form are estimated from the files' column
+   * statistics, the other quals by clauselist_selectivity.
+   */
+  ParquetFilter *filters = palloc0(
+      sizeof(ParquetFilter) * (list_length(baserel->baserestrictinfo) + 1));
+  List *filter_quals = NIL;
+  List *other_quals = NIL;
+  int nfilters = 0;
+  foreach (lc, baserel->baserestrictinfo) {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+    IcebergFilter *f = NULL;
+
+    if (IsA(rinfo->clause, OpExpr))
+      f = make_op_filter(rel, (OpExpr *)rinfo->clause);
+    if (f && make_parquet_filter(f, desc, &filters[nfilters])) {
+      nfilters++;
+      filter_quals = lappend(filter_quals, rinfo);
+    } else
+      other_quals = lappend(other_quals, rinfo);
+    if (f)
+      free_filter(f);
+  }
+
+  List *columns = NIL;
+  foreach (lc, extract_projection(rel, attrs_used))
+    columns = lappend(columns, strVal(lfirst(lc)));
+
+  ParquetScanSpec spec = {0};
+  bool *estimated = palloc0(sizeof(bool) * (nfilters + 1));
+  icebergc_s3_options(opts, &s3);
+  spec.tupdesc = desc;
+  spec.attrs_used = columns_used(desc, columns);
+  spec.filters = filters;
+  spec.nfilters = nfilters;
+  spec.s3 = &s3;
+  if (icebergc_table_ref(opts, &s3, &table)) {
+    iceberg_estimate_scan(&table, &spec, est, estimated);
+    known = true;
+  } else
+    known = parquet_estimate_scan(opts->catalog_uri, &spec, est, estimated);
+  table_close(rel, NoLock);
+
+  /*
+   * Once ANALYZE has sampled the filtered columns, their histograms and MCVs
+   * estimate every qual better than min/max can.
+   */
+  bool analyzed = nfilters > 0;
+  for (int i = 0; i < nfilters && analyzed; i++)
+    analyzed = SearchSysCacheExists3(
+        STATRELATTINH, ObjectIdGetDatum(foreigntableid),
+        Int16GetDatum(filters[i].attnum + 1), BoolGetDatum(false));
+
+  if (known && analyzed) {
+    baserel->tuples = est->tuples;
+    baserel->rows = clamp_row_est(
+        est->tuples * clauselist_selectivity(root, baserel->baserestrictinfo,
+                                             0, JOIN_INNER, NULL));
+  } else if (known) {
+    for (int i = 0; i < nfilters; i++)
+      if (!estimated[i])
+        other_quals = lappend(other_quals, list_nth(filter_quals, i));
+    baserel->tuples = est->tuples;
+    baserel->rows = clamp_row_est(
+        est->rows *
+        clauselist_selectivity(root, other_quals, 0, JOIN_INNER, NULL));
+  } else
+    baserel->rows = 1;
+  baserel->fdw_private = est;
+}
+
+/*
+ * The share of a partial path's rows each process handles, as the core
+ * planner reckons it: the leader contributes less the more workers there
+ * are to feed.
+ */
+static double parallel_divisor(int workers) {
+  double divisor = workers;
+  if (parallel_leader_participation) {
+    double leader = 1.0 - 0.3 * workers;
+    if (leader > 0)
+      divisor += leader;
+  }
+  return divisor;
+}
+
+/*
+ * The rows a LIMIT takes from this scan, if the query reads this table alone
+ * and the reader evaluates all its quals, so that each row the scan returns
+ * counts towards the LIMIT; 0 otherwise. FETCH FIRST ... WITH TIES may take
+ * more rows than that, so it is never pushed down.
+ */
+static double scan_limit(PlannerInfo *root, RelOptInfo *baserel,
+                         Relation rel) {
+  ListCell *lc;
+
+  if (root->limit_tuples <= 0 || root->limit_tuples > INT_MAX ||
+      root->parse->limitOption == LIMIT_OPTION_WITH_TIES ||
+      baserel->reloptkind != RELOPT_BASEREL ||
+      bms_membership(root->all_baserels) != BMS_SINGLETON)
+    return 0;
+  foreach (lc, baserel->baserestrictinfo)
+    if (!is_exact_clause(rel, lfirst_node(RestrictInfo, lc)->clause))
+      return 0;
+  return root->limit_tuples;
+}
+
+/*
+ * For a query ordered by attributes of the table, with the leading one of a
+ * type whose row group statistics order as Postgres does: the sort keys of
+ * a top-N scan (see IcebergTopN) as lists of attribute numbers, ordering
+ * operators, collations and NULLS FIRST flags. NIL otherwise.
+ */
+static List *top_n_sort_keys(PlannerInfo *root, RelOptInfo *baserel) {
+  List *attnums = NIL;
+  List *sortops = NIL;
+  List *collations = NIL;
+  List *nulls_first = NIL;
+  ListCell *lc;
+
+  foreach (lc, root->query_pathkeys) {
+    PathKey *pk = (PathKey *)lfirst(lc);
+    EquivalenceClass *ec = pk->pk_eclass;
+    EquivalenceMember *member = NULL;
+    Var *var = NULL;
+    ListCell *lc2;
+
+    if (ec->ec_has_volatile)
+      return NIL;
+    foreach (lc2, ec->ec_members) {
+      EquivalenceMember *em = (EquivalenceMember *)lfirst(lc2);
+      Node *expr = strip_relabel((Node *)em->em_expr);
+
+      if (bms_equal(em->em_relids, baserel->relids) && IsA(expr, Var) &&
+          ((Var *)expr)->varno == baserel->relid &&
+          ((Var *)expr)->varattno > 0) {
+        member = em;
+        var = (Var *)expr;
+        break;
+      }
+    }
+    if (!var)
+      return NIL;
+
+#if PG_VERSION_NUM >= 180000
+    bool desc = pk->pk_cmptype == COMPARE_GT;
+#else
+    bool desc = pk->pk_strategy == BTGreaterStrategyNumber;
+#endif
+    Oid sortop = get_opfamily_member(
+        pk->pk_opfamily, member->em_datatype, member->em_datatype,
+        desc ? BTGreaterStrategyNumber : BTLessStrategyNumber);
+    if (!OidIsValid(sortop))
+      return NIL;
+    if (attnums == NIL && !parquet_orderable(var->vartype, desc))
+      return NIL;
+    attnums = lappend_int(attnums, var->varattno);
+    sortops = lappend_oid(sortops, sortop);
+    collations = lappend_oid(collations, ec->ec_collation);
+    nulls_first = lappend_int(nulls_first, pk->pk_nulls_first);
+  }
+  if (attnums == NIL)
+    return NIL;
+  return list_make4(attnums, sortops, collations, nulls_first);
 }
 
 static void icebergcGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel,
@@ -144,18 +799,264 @@ static void icebergcGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel,
     ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), errmsg("baserel is NULL")));
   if (root == NULL)
     ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), errmsg("root is NULL")));
-  Cost startup_cost = 0;
-  Cost total_cost = baserel->rows;
+  ParquetScanEstimate *est = (ParquetScanEstimate *)baserel->fdw_private;
+
+  /*
+   * The first row waits for a file to be opened, and every other file opened
+   * costs the same. Column chunks are charged per page read and rows like
+   * heap tuples, plus their quals. Remote files are charged
+   * remote_file_cost and remote_page_cost instead of seq_page_cost.
+   */
+  double pages = ceil(est->bytes / BLCKSZ);
+  Cost file_cost = est->remote ? icebergc_remote_file_cost : seq_page_cost;
+  Cost page_cost = est->remote ? icebergc_remote_page_cost : seq_page_cost;
+  Cost startup_cost = baserel->baserestrictcost.startup;
+  Cost io_cost = page_cost * pages;
+  Cost cpu_cost = (cpu_tuple_cost + baserel->baserestrictcost.per_tuple) *
+                  est->scanned;
+  if (est->files > 0) {
+    startup_cost += file_cost;
+    io_cost += file_cost * (est->files - 1);
+  }
+
+  Relation rel = table_open(foreigntableid, NoLock);
+  double limit = scan_limit(root, baserel, rel);
+  table_close(rel, NoLock);
+  List *sort_keys = limit > 0 ? top_n_sort_keys(root, baserel) : NIL;
 
+  /*
+   * Paths carry the LIMIT and sort keys for fdw_private. An unordered LIMIT
+   * tells the reader not to fetch far beyond it.
+   */
   add_path(baserel, (Path *)create_foreignscan_path(
                         root, baserel, NULL, baserel->rows, startup_cost,
-                        total_cost, NIL, NULL, NIL));
+                        startup_cost + io_cost + cpu_cost, NIL, NULL, NULL,
+#if PG_VERSION_NUM >= 170000
+                        NIL,
+#endif
+                        list_make2(makeInteger(root->query_pathkeys == NIL
+                                                   ? (int)limit
+                                                   : 0),
+                                   NIL)));
+
+  /*
+   * ORDER BY ... LIMIT: the scan sorts the rows itself, reading row groups
+   * best first and stopping once the rest cannot make the cut. If the table
+   * is clustered on the leading key, as tables loaded in time order are,
+   * that is the LIMIT's share of the rows plus a row group. Nothing comes
+   * out before all of it is read and sorted.
+   */
+  if (sort_keys != NIL && est->scanned > 0 && limit <= TOP_N_MAX_ROWS) {
+    double fraction =
+        Min(1.0, limit / baserel->rows + 1.0 / Max(est->row_groups, 1.0));
+    Cost total = startup_cost + fraction * (io_cost + cpu_cost) +
+                 2.0 * cpu_operator_cost * fraction * est->scanned *
+                     log2(2.0 * limit);
+    add_path(baserel,
+             (Path *)create_foreignscan_path(
+                 root, baserel, NULL, Min(baserel->rows, limit), total, total,
+                 root->query_pathkeys, NULL, NULL,
+#if PG_VERSION_NUM >= 170000
+                 NIL,
+#endif
+                 list_make2(makeInteger((int)limit), sort_keys)));
+  }
+
+  /*
+   * A parallel scan hands out row groups to the processes. Like a parallel
+   * seq scan, each pays its share of the CPU; reading remote files is bound
+   * by latency rather than bandwidth, so their I/O is shared out too.
+   */
+  if (baserel->consider_parallel && est->scanned > 0) {
+    int workers = compute_parallel_worker(baserel, pages, -1,
+                                          max_parallel_workers_per_gather);
+    if (workers > 0) {
+      double divisor = parallel_divisor(workers);
+      if (est->remote)
+        io_cost /= divisor;
+      ForeignPath *path = create_foreignscan_path(
+          root, baserel, NULL, clamp_row_est(baserel->rows / divisor),
+          startup_cost, startup_cost + io_cost + cpu_cost / divisor, NIL,
+          NULL, NULL,
+#if PG_VERSION_NUM >= 170000
+          NIL,
+#endif
+          list_make2(makeInteger(0), NIL));
+      path->path.parallel_aware = true;
+      path->path.parallel_workers = workers;
+      add_partial_path(baserel, (Path *)path);
+    }
+  }
+}
+
+/*
+ * The aggregates an aggregate scan computes (see IcebergAggregate) as lists
+ * of attribute numbers (0 for count(*)), sort operators (InvalidOid for
+ * counts) and input collations. NIL if any is of another kind, or takes
+ * anything but one attribute of the table as it is.
+ */
+static List *aggregate_items(List *aggrefs, Index relid) {
+  List *attnums = NIL;
+  List *sortops = NIL;
+  List *collations = NIL;
+  ListCell *lc;
+
+  foreach (lc, aggrefs) {
+    Aggref *agg = lfirst_node(Aggref, lc);
+    Oid sortop = InvalidOid;
+
+    if (agg->agglevelsup != 0 || agg->aggkind != AGGKIND_NORMAL ||
+        agg->aggsplit != AGGSPLIT_SIMPLE || agg->aggdistinct ||
+        agg->aggorder || agg->aggfilter)
+      return NIL;
+    if (agg->aggfnoid == F_COUNT_) {
+      attnums = lappend_int(attnums, 0);
+      sortops = lappend_oid(sortops, InvalidOid);
+      collations = lappend_oid(collations, InvalidOid);
+      continue;
+    }
+    if (list_length(agg->args) != 1)
+      return NIL;
+    Node *arg = strip_relabel((Node *)linitial_node(TargetEntry, agg->args)->expr);
+    if (!IsA(arg, Var) || ((Var *)arg)->varno != relid ||
+        ((Var *)arg)->varattno <= 0)
+      return NIL;
+    if (agg->aggfnoid != F_COUNT_ANY) {
+      HeapTuple tuple =
+          SearchSysCache1(AGGFNOID, ObjectIdGetDatum(agg->aggfnoid));
+      if (!HeapTupleIsValid(tuple))
+        return NIL;
+      sortop = ((Form_pg_aggregate)GETSTRUCT(tuple))->aggsortop;
+      ReleaseSysCache(tuple);
+      if (!OidIsValid(sortop))
+        return NIL;
+    }
+    attnums = lappend_int(attnums, ((Var *)arg)->varattno);
+    sortops = lappend_oid(sortops, sortop);
+    collations = lappend_oid(collations, agg->inputcollid);
+  }
+  return list_make3(attnums, sortops, collations);
+}
+
+/*
+ * Aggregates without GROUP BY over this table alone, with every qual
+ * evaluated by the reader, are computed by the scan: see IcebergAggScan.
+ * Counts, and min/max of types whose statistics are exact, then cost only
+ * the footers when there are no quals; otherwise the scan is charged as a
+ * full one, which still saves the Agg node.
+ */
+static void icebergcGetForeignUpperPaths(PlannerInfo *root,
+                                         UpperRelationKind stage,
+                                         RelOptInfo *input_rel,
+                                         RelOptInfo *output_rel, void *extra) {
+  Query *parse = root->parse;
+  ListCell *lc;
+
+  if (stage != UPPERREL_GROUP_AGG || output_rel->fdw_private ||
+      input_rel->reloptkind != RELOPT_BASEREL ||
+      bms_membership(root->all_baserels) != BMS_SINGLETON ||
+      parse->groupClause || parse->groupingSets || parse->havingQual)
+    return;
+
+  RangeTblEntry *rte = planner_rt_fetch(input_rel->relid, root);
+  if (rte->inh)
+    return;
+  Oid relid = rte->relid;
+  Relation rel = table_open(relid, NoLock);
+  bool exact = true;
+  foreach (lc, input_rel->baserestrictinfo)
+    exact = exact &&
+            is_exact_clause(rel, lfirst_node(RestrictInfo, lc)->clause);
+  table_close(rel, NoLock);
+  if (!exact)
+    return;
+
+  /* The target may compute on the aggregates, but needs nothing else. */
+  PathTarget *target = root->upper_targets[UPPERREL_GROUP_AGG];
+  List *aggrefs = NIL;
+  foreach (lc, target->exprs) {
+    ListCell *lc2;
+    foreach (lc2, pull_var_clause((Node *)lfirst(lc),
+                                  PVC_INCLUDE_AGGREGATES |
+                                      PVC_RECURSE_PLACEHOLDERS)) {
+      if (!IsA(lfirst(lc2), Aggref))
+        return;
+      aggrefs = list_append_unique(aggrefs, lfirst(lc2));
+    }
+  }
+  List *items = aggrefs ? aggregate_items(aggrefs, input_rel->relid) : NIL;
+  if (items == NIL)
+    return;
+
+  ParquetScanEstimate *est = (ParquetScanEstimate *)input_rel->fdw_private;
+  bool footers_only = input_rel->baserestrictinfo == NIL;
+  ListCell *attnum, *sortop;
+  forboth (attnum, linitial(items), sortop, lsecond(items)) {
+    if (OidIsValid(lfirst_oid(sortop)))
+      footers_only =
+          footers_only &&
+          parquet_exact_bounds(
+              get_atttype(relid, (AttrNumber)lfirst_int(attnum)));
+  }
+  Cost file_cost = est->remote ? icebergc_remote_file_cost : seq_page_cost;
+  Cost total;
+  if (footers_only)
+    total = file_cost * Max(est->files, 1) +
+            cpu_operator_cost * est->row_groups * list_length(aggrefs);
+  else
+    total = input_rel->cheapest_total_path->total_cost +
+            cpu_operator_cost * input_rel->rows * list_length(aggrefs);
+
+  output_rel->fdw_private = input_rel;
+  add_path(output_rel,
+           (Path *)create_foreign_upper_path(root, output_rel, target, 1,
+                                             total, total, NIL, NULL,
+#if PG_VERSION_NUM >= 170000
+                                             NIL,
+#endif
+                                             aggrefs));
+}
+
+/*
+ * The plan of an aggregate scan. It has no relation of its own: its input
+ * relation is kept in the upper relation, and it returns the aggregates
+ * as fdw_scan_tlist lists them.
+ */
+static ForeignScan *aggregate_plan(PlannerInfo *root, RelOptInfo *upperrel,
+                                   ForeignPath *best_path, List *tlist,
+                                   Plan *outer_plan) {
+  RelOptInfo *input = (RelOptInfo *)upperrel->fdw_private;
+  List *aggrefs = best_path->fdw_private;
+  List *pushed = extract_actual_clauses(input->baserestrictinfo, false);
+  List *scan_tlist = NIL;
+  ListCell *lc;
+
+  Bitmapset *attrs_used = NULL;
+  pull_varattnos((Node *)aggrefs, input->relid, &attrs_used);
+  pull_varattnos((Node *)pushed, input->relid, &attrs_used);
+  Relation rel =
+      table_open(planner_rt_fetch(input->relid, root)->relid, NoLock);
+  List *columns = extract_projection(rel, attrs_used);
+  table_close(rel, NoLock);
+
+  foreach (lc, aggrefs)
+    scan_tlist = lappend(scan_tlist,
+                         makeTargetEntry((Expr *)lfirst(lc),
+                                         list_length(scan_tlist) + 1, NULL,
+                                         false));
+  List *fdw_private =
+      list_make5(columns, pushed, makeInteger(0), NIL,
+                 aggregate_items(aggrefs, input->relid));
+  return make_foreignscan(tlist, NIL, 0, NIL, fdw_private, scan_tlist, NIL,
+                          outer_plan);
 }
 
 static ForeignScan *
 icebergcGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
                        Oid foreigntableid, ForeignPath *best_path, List *tlist,
                        List *scan_clauses, Plan *outer_plan) {
+  if (baserel && IS_UPPER_REL(baserel) && best_path)
+    return aggregate_plan(root, baserel, best_path, tlist, outer_plan);
   if (!OidIsValid(foreigntableid))
     ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_FOREIGN_TABLE),
                     errmsg("invalid foreign table OID")));
@@ -165,7 +1066,36 @@ icebergcGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
     ereport(ERROR,
             (errcode(ERRCODE_FDW_ERROR), errmsg("planner info is NULL")));
   scan_clauses = extract_actual_clauses(scan_clauses, false);
-  return make_foreignscan(tlist, scan_clauses, baserel->relid, NIL, NIL, tlist,
+
+  /* Columns the scan has to produce: the target list plus the local quals. */
+  Bitmapset *attrs_used = NULL;
+  pull_varattnos((Node *)baserel->reltarget->exprs, baserel->relid,
+                 &attrs_used);
+  pull_varattnos((Node *)scan_clauses, baserel->relid, &attrs_used);
+
+  Relation rel = table_open(foreigntableid, NoLock);
+  List *columns = extract_projection(rel, attrs_used);
+
+  /*
+   * Comparisons the reader evaluates exactly go to the scan through
+   * fdw_private instead of being rechecked by the executor.
+   */
+  List *pushed = NIL;
+  List *local = NIL;
+  ListCell *lc;
+  foreach (lc, scan_clauses) {
+    Expr *clause = (Expr *)lfirst(lc);
+    if (is_exact_clause(rel, clause))
+      pushed = lappend(pushed, clause);
+    else
+      local = lappend(local, clause);
+  }
+  table_close(rel, NoLock);
+
+  List *fdw_private =
+      list_concat(list_make2(columns, pushed), best_path->fdw_private);
+  fdw_private = lappend(fdw_private, NIL);
+  return make_foreignscan(tlist, local, baserel->relid, NIL, fdw_private, NIL,
                           NIL, outer_plan);
 }
 
@@ -176,9 +1106,48 @@ static char *datum_to_cstring(Datum d, Oid typeoid) {
   return OidOutputFunctionCall(typoutput, d);
 }
 
+static Node *strip_relabel(Node *node) {
+  while (node && IsA(node, RelabelType))
+    node = (Node *)((RelabelType *)node)->arg;
+  return node;
+}
+
+/*
+ * The comparison `opno` makes as an operator name, if it is a member of the
+ * default btree family of `type`; NULL otherwise.
+ */
+static const char *btree_op_name(Oid opno, Oid type) {
+  Oid opclass = GetDefaultOpClass(type, BTREE_AM_OID);
+  if (!OidIsValid(opclass))
+    return NULL;
+  Oid opfamily = get_opclass_family(opclass);
+
+  switch (get_op_opfamily_strategy(opno, opfamily)) {
+  case BTLessStrategyNumber:
+    return "<";
+  case BTLessEqualStrategyNumber:
+    return "<=";
+  case BTEqualStrategyNumber:
+    return "=";
+  case BTGreaterEqualStrategyNumber:
+    return ">=";
+  case BTGreaterStrategyNumber:
+    return ">";
+  }
+  /* <> is not in the family, but its negator is = */
+  Oid negator = get_negator(opno);
+  if (OidIsValid(negator) &&
+      get_op_opfamily_strategy(negator, opfamily) == BTEqualStrategyNumber)
+    return "<>";
+  return NULL;
+}
+
 static IcebergFilter *make_op_filter(Relation rel, OpExpr *op) {
-  Node *larg = linitial(op->args);
-  Node *rarg = lsecond(op->args);
+  if (list_length(op->args) != 2)
+    return NULL;
+  Node *larg = strip_relabel(linitial(op->args));
+  Node *rarg = strip_relabel(lsecond(op->args));
+  Oid opno = op->opno;
   Var *var = NULL;
   Const *cst = NULL;
 
@@ -188,15 +1157,28 @@ static IcebergFilter *make_op_filter(Relation rel, OpExpr *op) {
   } else if (IsA(rarg, Var) && IsA(larg, Const)) {
     var = (Var *)rarg;
     cst = (Const *)larg;
+    opno = get_commutator(opno); /* write it as "var op const" */
   }
-  if (!var || !cst)
+  if (!var || !cst || !OidIsValid(opno))
+    return NULL;
+  if (var->varattno <= 0 || cst->constisnull)
+    return NULL;
+  /* Byte-wise comparisons can't stand in for nondeterministic collations. */
+  if (OidIsValid(op->inputcollid) &&
+      !get_collation_isdeterministic(op->inputcollid))
+    return NULL;
+  const char *opname = btree_op_name(opno, var->vartype);
+  if (!opname)
     return NULL;
 
   IcebergFilter *f = palloc0(sizeof(IcebergFilter));
   f->kind = ICEBERG_FILTER_OP;
   f->column = pstrdup(get_attname(RelationGetRelid(rel), var->varattno, false));
-  f->op = pstrdup(get_opname(op->opno));
+  f->op = pstrdup(opname);
   f->val1 = datum_to_cstring(cst->constvalue, cst->consttype);
+  f->attnum = var->varattno;
+  f->valtype = cst->consttype;
+  f->value1 = cst->constvalue;
   return f;
 }
 
@@ -208,7 +1190,7 @@ static bool is_between_clause(Relation rel, Expr *e1, Expr *e2,
   IcebergFilter *f2 = make_op_filter(rel, (OpExpr *)e2);
   if (!f1 || !f2)
     return false;
-  if (strcmp(f1->column, f2->column) != 0)
+  if (f1->attnum != f2->attnum || f1->valtype != f2->valtype)
     return false;
   if (!((strcmp(f1->op, ">=") == 0 && strcmp(f2->op, "<=") == 0) ||
         (strcmp(f1->op, "<=") == 0 && strcmp(f2->op, ">=") == 0)))
@@ -216,13 +1198,19 @@ static bool is_between_clause(Relation rel, Expr *e1, Expr *e2,
   IcebergFilter *f = palloc0(sizeof(IcebergFilter));
   f->kind = ICEBERG_FILTER_BETWEEN;
   f->column = f1->column;
+  f->attnum = f1->attnum;
+  f->valtype = f1->valtype;
   if (strcmp(f1->op, ">=") == 0) {
     f->val1 = f1->val1;
     f->val2 = f2->val1;
+    f->value1 = f1->value1;
+    f->value2 = f2->value1;
     pfree(f2->column);
   } else {
     f->val1 = f2->val1;
     f->val2 = f1->val1;
+    f->value1 = f2->value1;
+    f->value2 = f1->value1;
     pfree(f1->column);
   }
   pfree(f1->op);
@@ -240,7 +1228,10 @@ static void append_filter(Relation rel, Expr *expr, List **out) {
       *out = lappend(*out, f);
   } else if (IsA(expr, BoolExpr)) {
     BoolExpr *b = (BoolExpr *)expr;
-    if (b->boolop == AND && list_length(b->args) == 2) {
+    /* Only conjunctions narrow the scan; OR/NOT arms say nothing alone. */
+    if (b->boolop != AND_EXPR)
+      return;
+    if (list_length(b->args) == 2) {
       IcebergFilter *bf;
       if (is_between_clause(rel, linitial(b->args), lsecond(b->args), &bf)) {
         *out = lappend(*out, bf);
@@ -261,6 +1252,153 @@ static List *extract_filters(Relation rel, List *quals) {
   return result;
 }
 
+static bool filter_op_from_name(const char *name, ParquetFilterOp *op) {
+  if (strcmp(name, "=") == 0)
+    *op = PARQUET_FILTER_EQ;
+  else if (strcmp(name, "<>") == 0)
+    *op = PARQUET_FILTER_NE;
+  else if (strcmp(name, "<") == 0)
+    *op = PARQUET_FILTER_LT;
+  else if (strcmp(name, "<=") == 0)
+    *op = PARQUET_FILTER_LE;
+  else if (strcmp(name, ">") == 0)
+    *op = PARQUET_FILTER_GT;
+  else if (strcmp(name, ">=") == 0)
+    *op = PARQUET_FILTER_GE;
+  else
+    return false;
+  return true;
+}
+
+/*
+ * Converts a filter constant to the column's type when that can be done
+ * without changing the comparison's result; false if it can't.
+ */
+static bool coerce_filter_value(Datum value, Oid valtype, Oid atttype,
+                                Datum *out) {
+  int64 v;
+
+  switch (atttype) {
+  case INT2OID:
+  case INT4OID:
+  case INT8OID:
+    if (valtype == INT2OID)
+      v = DatumGetInt16(value);
+    else if (valtype == INT4OID)
+      v = DatumGetInt32(value);
+    else if (valtype == INT8OID)
+      v = DatumGetInt64(value);
+    else
+      return false;
+    if (atttype == INT2OID) {
+      if (v < PG_INT16_MIN || v > PG_INT16_MAX)
+        return false;
+      *out = Int16GetDatum((int16)v);
+    } else if (atttype == INT4OID) {
+      if (v < PG_INT32_MIN || v > PG_INT32_MAX)
+        return false;
+      *out = Int32GetDatum((int32)v);
+    } else
+      *out = Int64GetDatum(v);
+    return true;
+  case TEXTOID:
+  case VARCHAROID:
+    if (valtype != TEXTOID && valtype != VARCHAROID)
+      return false;
+    *out = PointerGetDatum(PG_DETOAST_DATUM_PACKED(value));
+    return true;
+  case TIMESTAMPOID:
+    if (valtype == DATEOID) {
+      int overflow;
+      Timestamp ts = date2timestamp_opt_overflow(DatumGetDateADT(value),
+                                                 &overflow);
+      if (overflow)
+        return false;
+      *out = TimestampGetDatum(ts);
+      return true;
+    }
+    if (valtype != atttype)
+      return false;
+    *out = value;
+    return true;
+  case BOOLOID:
+  case FLOAT4OID:
+  case FLOAT8OID:
+  case TIMESTAMPTZOID:
+  case DATEOID:
+    if (valtype != atttype)
+      return false;
+    *out = value;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Fills in the reader's form of `f`; false if it has none. */
+static bool make_parquet_filter(IcebergFilter *f, TupleDesc desc,
+                                ParquetFilter *pf) {
+  Oid atttype = TupleDescAttr(desc, f->attnum - 1)->atttypid;
+
+  if (f->kind == ICEBERG_FILTER_BETWEEN)
+    pf->op = PARQUET_FILTER_BETWEEN;
+  else if (!filter_op_from_name(f->op, &pf->op))
+    return false;
+  if (!coerce_filter_value(f->value1, f->valtype, atttype, &pf->value1))
+    return false;
+  if (f->kind == ICEBERG_FILTER_BETWEEN &&
+      !coerce_filter_value(f->value2, f->valtype, atttype, &pf->value2))
+    return false;
+  pf->attnum = f->attnum - 1;
+  return true;
+}
+
+/* The IcebergFilters the reader can prune row groups and filter rows with. */
+static ParquetFilter *make_parquet_filters(List *filters, TupleDesc desc,
+                                           int *nfilters) {
+  ParquetFilter *out = palloc0(sizeof(ParquetFilter) * list_length(filters));
+  ListCell *lc;
+  int n = 0;
+
+  foreach (lc, filters) {
+    if (make_parquet_filter((IcebergFilter *)lfirst(lc), desc, &out[n]))
+      n++;
+  }
+  *nfilters = n;
+  return out;
+}
+
+/*
+ * Whether the reader drops every row for which `clause` is not true, so the
+ * executor need not check it again.
+ */
+static bool is_exact_clause(Relation rel, Expr *clause) {
+  if (!IsA(clause, OpExpr))
+    return false;
+  IcebergFilter *f = make_op_filter(rel, (OpExpr *)clause);
+  if (!f)
+    return false;
+
+  TupleDesc desc = RelationGetDescr(rel);
+  ParquetFilter pf;
+  bool exact = make_parquet_filter(f, desc, &pf) &&
+               parquet_filter_exact(TupleDescAttr(desc, pf.attnum)->atttypid,
+                                    pf.op);
+  free_filter(f);
+  return exact;
+}
+
+static void free_filter(IcebergFilter *f) {
+  pfree(f->column);
+  if (f->op)
+    pfree(f->op);
+  if (f->val1)
+    pfree(f->val1);
+  if (f->val2)
+    pfree(f->val2);
+  pfree(f);
+}
+
 static bool list_member_str(List *list, const char *str) {
   ListCell *lc;
   foreach (lc, list)
@@ -269,23 +1407,32 @@ static bool list_member_str(List *list, const char *str) {
   return false;
 }
 
-static List *extract_projection(Relation rel, List *tlist) {
+static List *extract_projection(Relation rel, Bitmapset *attrs_used) {
+  TupleDesc desc = RelationGetDescr(rel);
+  bool whole_row = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber,
+                                 attrs_used);
   List *cols = NIL;
-  ListCell *lc;
-  foreach (lc, tlist) {
-    TargetEntry *tle = (TargetEntry *)lfirst(lc);
-    if (tle->resjunk)
+
+  for (int i = 0; i < desc->natts; i++) {
+    Form_pg_attribute attr = TupleDescAttr(desc, i);
+    if (attr->attisdropped)
       continue;
-    if (IsA(tle->expr, Var)) {
-      Var *var = (Var *)tle->expr;
-      char *name = get_attname(RelationGetRelid(rel), var->varattno, false);
-      if (!list_member_str(cols, name))
-        cols = lappend(cols, pstrdup(name));
-    }
+    if (whole_row ||
+        bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber,
+                      attrs_used))
+      cols = lappend(cols, makeString(pstrdup(NameStr(attr->attname))));
   }
   return cols;
 }
 
+/* Per attribute of desc, whether it is among the named columns. */
+static bool *columns_used(TupleDesc desc, List *columns) {
+  bool *used = (bool *)palloc0(desc->natts * sizeof(bool));
+  for (int i = 0; i < desc->natts; i++)
+    used[i] = list_member_str(columns, NameStr(TupleDescAttr(desc, i)->attname));
+  return used;
+}
+
 static void validate_schema(Relation rel) {
   if (rel == NULL)
     ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_FOREIGN_TABLE),
@@ -318,8 +1465,100 @@ static void validate_schema(Relation rel) {
   }
 }
 
+static int top_n_compare(Datum a, Datum b, void *arg) {
+  return ApplySortComparator(a, false, b, false, (SortSupport)arg);
+}
+
+/* Sets up a top-N scan; sort_keys is as top_n_sort_keys returns it. */
+static void init_top_n(IcebergScanState *state, List *sort_keys, int limit,
+                       TupleDesc tupdesc) {
+  IcebergTopN *top_n = palloc0(sizeof(IcebergTopN));
+  List *attnums = linitial(sort_keys);
+  List *sortops = lsecond(sort_keys);
+  List *collations = lthird(sort_keys);
+  List *nulls_first = lfourth(sort_keys);
+
+  top_n->nkeys = list_length(attnums);
+  top_n->attnums = palloc(sizeof(AttrNumber) * top_n->nkeys);
+  top_n->sortops = palloc(sizeof(Oid) * top_n->nkeys);
+  top_n->collations = palloc(sizeof(Oid) * top_n->nkeys);
+  top_n->nulls_first = palloc(sizeof(bool) * top_n->nkeys);
+  for (int i = 0; i < top_n->nkeys; i++) {
+    top_n->attnums[i] = (AttrNumber)list_nth_int(attnums, i);
+    top_n->sortops[i] = list_nth_oid(sortops, i);
+    top_n->collations[i] = list_nth_oid(collations, i);
+    top_n->nulls_first[i] = (bool)list_nth_int(nulls_first, i);
+  }
+  top_n->limit = limit;
+
+  top_n->cxt = CurrentMemoryContext;
+  top_n->first.ssup_cxt = CurrentMemoryContext;
+  top_n->first.ssup_collation = top_n->collations[0];
+  top_n->first.ssup_nulls_first = top_n->nulls_first[0];
+  PrepareSortSupportFromOrderingOp(top_n->sortops[0], &top_n->first);
+  get_typlenbyval(TupleDescAttr(tupdesc, top_n->attnums[0] - 1)->atttypid,
+                  &top_n->first_len, &top_n->first_byval);
+  top_n->best = binaryheap_allocate(top_n->limit, top_n_compare, &top_n->first);
+  top_n->sorted = MakeSingleTupleTableSlot(tupdesc, &TTSOpsMinimalTuple);
+  top_n->row_cxt = AllocSetContextCreate(
+      CurrentMemoryContext, "icebergc_fdw top-N row", ALLOCSET_DEFAULT_SIZES);
+
+  state->top_n = top_n;
+  state->spec.ordered = true;
+  state->spec.order_attnum = top_n->attnums[0] - 1;
+  state->spec.order_desc = top_n->first.ssup_reverse;
+  state->spec.order_nulls_first = top_n->nulls_first[0];
+}
+
+/* Sets up an aggregate scan; items is as aggregate_items returns it. */
+static void init_aggregates(IcebergScanState *state, List *items,
+                            TupleDesc tupdesc) {
+  IcebergAggScan *agg = palloc0(sizeof(IcebergAggScan));
+  List *attnums = linitial(items);
+  List *sortops = lsecond(items);
+  List *collations = lthird(items);
+
+  agg->naggs = list_length(attnums);
+  agg->aggs = palloc0(sizeof(IcebergAggregate) * agg->naggs);
+  agg->attnums = palloc(sizeof(int) * agg->naggs);
+  agg->bounds = palloc(sizeof(bool) * agg->naggs);
+  for (int i = 0; i < agg->naggs; i++) {
+    IcebergAggregate *a = &agg->aggs[i];
+    Oid sortop = list_nth_oid(sortops, i);
+
+    a->attnum = (AttrNumber)list_nth_int(attnums, i);
+    a->count = !OidIsValid(sortop);
+    a->isnull = true;
+    if (!a->count) {
+      a->ssup.ssup_cxt = CurrentMemoryContext;
+      a->ssup.ssup_collation = list_nth_oid(collations, i);
+      PrepareSortSupportFromOrderingOp(sortop, &a->ssup);
+      get_typlenbyval(TupleDescAttr(tupdesc, a->attnum - 1)->atttypid,
+                      &a->len, &a->byval);
+    }
+    agg->attnums[i] = a->attnum - 1;
+    agg->bounds[i] = !a->count;
+  }
+  agg->values = palloc(sizeof(Datum) * tupdesc->natts);
+  agg->nulls = palloc(sizeof(bool) * tupdesc->natts);
+  agg->cxt = CurrentMemoryContext;
+  agg->row_cxt = AllocSetContextCreate(
+      CurrentMemoryContext, "icebergc_fdw aggregate row", ALLOCSET_DEFAULT_SIZES);
+  state->agg = agg;
+}
+
 static void icebergcBeginForeignScan(ForeignScanState *node, int eflags) {
+  ForeignScan *fsplan = (ForeignScan *)node->ss.ps.plan;
   Relation rel = node->ss.ss_currentRelation;
+  /* Aggregate scans read the only relation of the query. */
+  if (!rel && fsplan->scan.scanrelid == 0)
+    rel = ExecGetRangeTableRelation(node->ss.ps.state,
+#if PG_VERSION_NUM >= 160000
+                                    bms_next_member(fsplan->fs_base_relids, -1)
+#else
+                                    bms_next_member(fsplan->fs_relids, -1)
+#endif
+    );
   if (!rel)
     ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_FOREIGN_TABLE),
                     errmsg("relation is NULL")));
@@ -334,25 +1573,66 @@ static void icebergcBeginForeignScan(ForeignScanState *node, int eflags) {
   if (!state->opts)
     ereport(ERROR,
             (errcode(ERRCODE_FDW_ERROR), errmsg("could not get options")));
-  if (!state->opts->catalog_uri)
-    ereport(ERROR, (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-                    errmsg("\"catalog_uri\" option is required")));
 
-  ForeignScan *fsplan = (ForeignScan *)node->ss.ps.plan;
-  state->filters = extract_filters(rel, fsplan->scan.plan.qual);
-  state->columns = extract_projection(rel, fsplan->fs_targetlist);
+  List *pushed =
+      (List *)list_nth(fsplan->fdw_private, IcebergFdwScanPrivateFilters);
+  state->filters = extract_filters(
+      rel, list_concat(list_copy(pushed), fsplan->scan.plan.qual));
+  ListCell *lc;
+  foreach (lc, (List *)list_nth(fsplan->fdw_private,
+                                IcebergFdwScanPrivateColumns))
+    state->columns = lappend(state->columns, pstrdup(strVal(lfirst(lc))));
 
   TupleDesc tupdesc = RelationGetDescr(rel);
-  state->attinmeta = TupleDescGetAttInMetadata(tupdesc);
-  state->values = (char **)palloc0(tupdesc->natts * sizeof(char *));
-  if (state->opts && state->opts->catalog_uri)
-    state->reader = parquet_reader_open(state->opts->catalog_uri);
-  if (!state->reader)
-    ereport(ERROR, (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
-                    errmsg("could not open parquet file")));
+  icebergc_s3_options(state->opts, &state->s3);
+  state->spec.tupdesc = tupdesc;
+  state->spec.attrs_used = columns_used(tupdesc, state->columns);
+  state->spec.filters =
+      make_parquet_filters(state->filters, tupdesc, &state->spec.nfilters);
+  state->spec.s3 = &state->s3;
+  /* Buffers freed by one row group are kept for the next, up to work_mem. */
+  state->spec.pool = parquet_pool_create((int64)work_mem * 1024);
+  int limit = intVal(list_nth(fsplan->fdw_private, IcebergFdwScanPrivateLimit));
+  List *sort_keys = list_nth(fsplan->fdw_private, IcebergFdwScanPrivateSortKeys);
+  List *aggregates =
+      list_nth(fsplan->fdw_private, IcebergFdwScanPrivateAggregates);
+  if (sort_keys != NIL)
+    init_top_n(state, sort_keys, limit, tupdesc);
+  else
+    state->spec.limit = limit;
+  if (aggregates != NIL)
+    init_aggregates(state, aggregates, tupdesc);
+
+  /*
+   * An Iceberg table is read as the list of data files its snapshot's
+   * metadata leaves after pruning; a plain catalog_uri is a single file.
+   * Files are opened one at a time as the scan reaches them. EXPLAIN lists
+   * them too, from the metadata planning has cached.
+   */
+  IcebergTableRef iceberg;
+  bool executed = !(eflags & EXEC_FLAG_EXPLAIN_ONLY);
+  if (fsplan->scan.plan.parallel_aware && IsParallelWorker()) {
+    /* the leader's files come with the shared state */
+  } else if (icebergc_table_ref(state->opts, &state->s3, &iceberg)) {
+    iceberg_plan_files(&iceberg, &state->spec, &state->files);
+    state->iceberg = true;
+    if (executed)
+      icebergc_stats_add(ICEBERGC_STAT_FILES_PRUNED, state->files.files_pruned);
+    elog(DEBUG1,
+         "manifests: " INT64_FORMAT " of " INT64_FORMAT
+         " pruned, data files: %d to scan, " INT64_FORMAT " pruned",
+         state->files.manifests_pruned, state->files.manifests,
+         state->files.nfiles, state->files.files_pruned);
+  } else {
+    state->files.nfiles = 1;
+    state->files.paths = palloc(sizeof(char *));
+    state->files.paths[0] = state->opts->catalog_uri;
+  }
+  /* A parallel scan counts once, its workers' reads with it. */
+  if (executed && !IsParallelWorker())
+    icebergc_stats_add(ICEBERGC_STAT_SCANS, 1);
 
   if (state->filters) {
-    ListCell *lc;
     foreach (lc, state->filters) {
       IcebergFilter *f = (IcebergFilter *)lfirst(lc);
       if (f->kind == ICEBERG_FILTER_BETWEEN)
@@ -363,83 +1643,922 @@ static void icebergcBeginForeignScan(ForeignScanState *node, int eflags) {
     }
   }
   if (state->columns) {
-    ListCell *lc;
     foreach (lc, state->columns)
       elog(DEBUG1, "project column: %s", (char *)lfirst(lc));
   }
 
+  /*
+   * A reader may have a thread decoding ahead and holds memory palloc does
+   * not know about; if the query fails, close it with the executor's memory.
+   */
+  state->cleanup = palloc0(sizeof(MemoryContextCallback));
+  state->cleanup->func = release_scan;
+  state->cleanup->arg = state;
+  MemoryContextRegisterResetCallback(CurrentMemoryContext, state->cleanup);
+
   node->fdw_state = (void *)state;
 }
 
+static void release_scan(void *arg) {
+  IcebergScanState *state = (IcebergScanState *)arg;
+
+  if (state && state->reader) {
+    parquet_reader_close(state->reader);
+    state->reader = NULL;
+  }
+  if (state && state->queue) {
+    parquet_queue_close(state->queue);
+    state->queue = NULL;
+  }
+  if (state && state->spec.pool) {
+    parquet_pool_close(state->spec.pool);
+    state->spec.pool = NULL;
+  }
+}
+
+static void aggregate_value(IcebergAggregate *a, Datum value,
+                            MemoryContext cxt);
+
+/*
+ * Aggregate scans: adds what the reader's summarized row groups hold to the
+ * aggregates.
+ */
+static void add_summary(IcebergAggScan *agg, ParquetReader *reader) {
+  ParquetColumnSummary *columns =
+      palloc(sizeof(ParquetColumnSummary) * agg->naggs);
+  int64 rows;
+
+  parquet_reader_get_summary(reader, &rows, columns);
+  for (int i = 0; i < agg->naggs; i++) {
+    IcebergAggregate *a = &agg->aggs[i];
+    if (a->count) {
+      a->n += columns[i].nonnull;
+    } else if (columns[i].has_bounds) {
+      aggregate_value(a, columns[i].min, agg->cxt);
+      aggregate_value(a, columns[i].max, agg->cxt);
+    }
+  }
+  pfree(columns);
+}
+
+static void add_reader_stats(ParquetReaderStats *total,
+                             const ParquetReaderStats *stats) {
+  total->row_groups += stats->row_groups;
+  total->row_groups_pruned += stats->row_groups_pruned;
+  total->row_groups_pruned_pages += stats->row_groups_pruned_pages;
+  total->row_groups_pruned_bloom += stats->row_groups_pruned_bloom;
+  total->row_groups_summarized += stats->row_groups_summarized;
+  total->rows_filtered += stats->rows_filtered;
+  total->bytes_read += stats->bytes_read;
+  total->bytes_remote += stats->bytes_remote;
+  total->open_time += stats->open_time;
+  total->fetch_time += stats->fetch_time;
+  total->decode_time += stats->decode_time;
+  total->filter_time += stats->filter_time;
+  total->convert_time += stats->convert_time;
+}
+
+/* Adds a closed reader's counters to those of all backends. */
+static void count_reader(const char *path, const ParquetReaderStats *stats) {
+  IcebergcStat scheme = ICEBERGC_STAT_LOCAL_BYTES;
+
+  if (strncmp(path, "s3://", 5) == 0 || strncmp(path, "s3a://", 6) == 0 ||
+      strncmp(path, "s3n://", 6) == 0)
+    scheme = ICEBERGC_STAT_S3_BYTES;
+  else if (strncmp(path, "hdfs://", 7) == 0)
+    scheme = ICEBERGC_STAT_HDFS_BYTES;
+  icebergc_stats_add(ICEBERGC_STAT_FILES_OPENED, 1);
+  icebergc_stats_add(ICEBERGC_STAT_ROW_GROUPS, stats->row_groups);
+  icebergc_stats_add(ICEBERGC_STAT_ROW_GROUPS_PRUNED, stats->row_groups_pruned);
+  icebergc_stats_add(ICEBERGC_STAT_ROW_GROUPS_SUMMARIZED,
+                     stats->row_groups_summarized);
+  icebergc_stats_add(ICEBERGC_STAT_ROWS_FILTERED, stats->rows_filtered);
+  icebergc_stats_add(scheme, stats->bytes_read);
+  icebergc_stats_add(ICEBERGC_STAT_REMOTE_BYTES, stats->bytes_remote);
+  icebergc_stats_observe(ICEBERGC_LATENCY_FILE_OPEN, stats->open_time);
+}
+
+/*
+ * Adds the current reader's counters to the scan's and to the shared ones,
+ * and closes it.
+ */
+static void close_reader(IcebergScanState *state) {
+  ParquetReaderStats stats;
+
+  if (state->agg)
+    add_summary(state->agg, state->reader);
+  parquet_reader_get_stats(state->reader, &stats);
+  add_reader_stats(&state->stats, &stats);
+  count_reader(state->files.paths[state->file], &stats);
+  parquet_reader_close(state->reader);
+  state->reader = NULL;
+}
+
+static void open_reader(IcebergScanState *state, int file) {
+  const char *path = state->files.paths[file];
+  state->reader = parquet_reader_open(path, &state->spec);
+  if (!state->reader)
+    ereport(ERROR, (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
+                    errmsg("could not open parquet file \"%s\"", path)));
+  state->file = file;
+}
+
+/*
+ * Parallel scans: points the reader at the next row group this process
+ * claims, opening another file if need be. Returns false once every row
+ * group has been handed out.
+ */
+static bool claim_row_group(IcebergScanState *state) {
+  IcebergParallelScan *pscan = state->pscan;
+
+  for (;;) {
+    if (state->reader) {
+      IcebergParallelFile *file = &pscan->files[state->file];
+      uint32 rg = pg_atomic_fetch_add_u32(&file->next_row_group, 1);
+      if (rg < pg_atomic_read_u32(&file->row_groups)) {
+        int n = (int)rg;
+        parquet_reader_select_row_groups(state->reader, &n, 1);
+        return true;
+      }
+      close_reader(state);
+    }
+
+    CHECK_FOR_INTERRUPTS();
+    if (pg_atomic_read_u32(&pscan->next_file) < (uint32)pscan->nfiles) {
+      uint32 f = pg_atomic_fetch_add_u32(&pscan->next_file, 1);
+      if (f < (uint32)pscan->nfiles) {
+        ParquetReaderStats stats;
+
+        open_reader(state, (int)f);
+        parquet_reader_get_stats(state->reader, &stats);
+        pg_atomic_write_u32(&pscan->files[f].row_groups,
+                            (uint32)stats.row_groups);
+        continue;
+      }
+    }
+
+    /* Every file is open somewhere; help with the one most left to read. */
+    int best = -1;
+    uint32 most = 0;
+    for (int i = 0; i < pscan->nfiles; i++) {
+      IcebergParallelFile *file = &pscan->files[i];
+      uint32 total = pg_atomic_read_u32(&file->row_groups);
+      uint32 next = pg_atomic_read_u32(&file->next_row_group);
+      if (next < total && total - next > most) {
+        best = i;
+        most = total - next;
+      }
+    }
+    if (best < 0)
+      return false;
+    open_reader(state, best);
+  }
+}
+
+static bool top_n_full(IcebergTopN *top_n) {
+  return top_n->best->bh_size >= top_n->limit;
+}
+
+/*
+ * Fills in values and nulls with the next row of the scan. Returns false at
+ * the end.
+ */
+static bool next_row(IcebergScanState *state, Datum *values, bool *nulls) {
+  for (;;) {
+    if (state->reader && parquet_reader_next(state->reader, values, nulls))
+      return true;
+    if (state->pscan) {
+      if (!claim_row_group(state))
+        return false;
+      continue;
+    }
+    if (state->reader)
+      close_reader(state);
+    if (state->next_file >= state->files.nfiles)
+      return false;
+    if (!state->queue)
+      state->queue = parquet_queue_open(state->files.paths, state->files.sizes,
+                                        state->files.rows, state->files.nfiles,
+                                        &state->spec);
+    state->reader = parquet_queue_next(state->queue);
+    if (!state->reader)
+      ereport(ERROR, (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
+                      errmsg("could not open parquet file \"%s\"",
+                             state->files.paths[state->next_file])));
+    state->file = state->next_file++;
+    if (state->agg)
+      parquet_reader_summarize(state->reader, state->agg->attnums,
+                               state->agg->bounds, state->agg->naggs,
+                               &state->spec);
+    if (state->top_n && top_n_full(state->top_n))
+      parquet_reader_set_bound(state->reader,
+                               binaryheap_first(state->top_n->best));
+  }
+}
+
+/*
+ * Adds a row's leading sort key to the best ones. Returns true if the worst
+ * of those changed while the heap is full, i.e. the bound got tighter.
+ */
+static bool top_n_add(IcebergTopN *top_n, Datum key) {
+  binaryheap *best = top_n->best;
+  MemoryContext oldcxt;
+
+  if (!top_n_full(top_n)) {
+    oldcxt = MemoryContextSwitchTo(top_n->cxt);
+    binaryheap_add(best, datumCopy(key, top_n->first_byval, top_n->first_len));
+    MemoryContextSwitchTo(oldcxt);
+    return top_n_full(top_n);
+  }
+
+  Datum worst = binaryheap_first(best);
+  if (ApplySortComparator(key, false, worst, false, &top_n->first) >= 0)
+    return false;
+  oldcxt = MemoryContextSwitchTo(top_n->cxt);
+  binaryheap_replace_first(
+      best, datumCopy(key, top_n->first_byval, top_n->first_len));
+  MemoryContextSwitchTo(oldcxt);
+  if (!top_n->first_byval)
+    pfree(DatumGetPointer(worst));
+  return true;
+}
+
+/*
+ * Top-N scans: feeds every row the reader does not skip to a bounded sort,
+ * passing the bound to the reader each time it gets tighter.
+ */
+static void collect_top_n(IcebergScanState *state, TupleTableSlot *slot) {
+  IcebergTopN *top_n = state->top_n;
+  int first = top_n->attnums[0] - 1;
+
+  MemoryContext oldcxt = MemoryContextSwitchTo(top_n->cxt);
+  top_n->sort = tuplesort_begin_heap(
+      slot->tts_tupleDescriptor, top_n->nkeys, top_n->attnums, top_n->sortops,
+      top_n->collations, top_n->nulls_first, work_mem, NULL,
+#if PG_VERSION_NUM >= 150000
+      TUPLESORT_NONE
+#else
+      false
+#endif
+  );
+  tuplesort_set_bound(top_n->sort, top_n->limit);
+
+  MemoryContextSwitchTo(top_n->row_cxt);
+  while (next_row(state, slot->tts_values, slot->tts_isnull)) {
+    CHECK_FOR_INTERRUPTS();
+    ExecStoreVirtualTuple(slot);
+    tuplesort_puttupleslot(top_n->sort, slot);
+    if (!slot->tts_isnull[first] &&
+        top_n_add(top_n, slot->tts_values[first]))
+      parquet_reader_set_bound(state->reader, binaryheap_first(top_n->best));
+    ExecClearTuple(slot);
+    MemoryContextReset(top_n->row_cxt);
+  }
+  MemoryContextSwitchTo(oldcxt);
+  tuplesort_performsort(top_n->sort);
+}
+
+/*
+ * Makes value the aggregate's if it comes before its current one in the
+ * aggregate's order.
+ */
+static void aggregate_value(IcebergAggregate *a, Datum value,
+                            MemoryContext cxt) {
+  if (!a->isnull &&
+      ApplySortComparator(value, false, a->value, false, &a->ssup) >= 0)
+    return;
+  MemoryContext oldcxt = MemoryContextSwitchTo(cxt);
+  Datum copy = datumCopy(value, a->byval, a->len);
+  MemoryContextSwitchTo(oldcxt);
+  if (!a->isnull && !a->byval)
+    pfree(DatumGetPointer(a->value));
+  a->value = copy;
+  a->isnull = false;
+}
+
+/*
+ * Aggregate scans: computes the aggregates over every row passing the
+ * quals. Row groups the readers summarize are added when they close.
+ */
+static void compute_aggregates(IcebergScanState *state) {
+  IcebergAggScan *agg = state->agg;
+
+  /*
+   * Without quals, count(*) is the sum of the record counts the Iceberg
+   * metadata gives for the data files.
+   */
+  bool from_manifests = state->spec.nfilters == 0 && state->files.rows;
+  for (int i = 0; i < agg->naggs; i++)
+    from_manifests = from_manifests && agg->aggs[i].attnum == 0;
+  for (int i = 0; from_manifests && i < state->files.nfiles; i++)
+    from_manifests = state->files.rows[i] >= 0;
+  if (from_manifests) {
+    int64 rows = 0;
+    for (int i = state->next_file; i < state->files.nfiles; i++)
+      rows += state->files.rows[i];
+    for (int i = 0; i < agg->naggs; i++)
+      agg->aggs[i].n += rows;
+    state->next_file = state->files.nfiles;
+    return;
+  }
+
+  MemoryContext oldcxt = MemoryContextSwitchTo(agg->row_cxt);
+  while (next_row(state, agg->values, agg->nulls)) {
+    CHECK_FOR_INTERRUPTS();
+    for (int i = 0; i < agg->naggs; i++) {
+      IcebergAggregate *a = &agg->aggs[i];
+      int attnum = agg->attnums[i];
+      if (attnum >= 0 && agg->nulls[attnum])
+        continue;
+      if (a->count)
+        a->n++;
+      else
+        aggregate_value(a, agg->values[attnum], agg->cxt);
+    }
+    MemoryContextReset(agg->row_cxt);
+  }
+  MemoryContextSwitchTo(oldcxt);
+  if (state->reader)
+    close_reader(state);
+}
+
+/* Drops what an aggregate scan computed, for a rescan or the end. */
+static void reset_aggregates(IcebergAggScan *agg) {
+  for (int i = 0; i < agg->naggs; i++) {
+    IcebergAggregate *a = &agg->aggs[i];
+    if (!a->isnull && !a->byval)
+      pfree(DatumGetPointer(a->value));
+    a->isnull = true;
+    a->n = 0;
+  }
+  agg->done = false;
+}
+
+/* Drops the rows collected by a top-N scan, for a rescan or the end. */
+static void reset_top_n(IcebergTopN *top_n) {
+  if (top_n->sort) {
+    tuplesort_end(top_n->sort);
+    top_n->sort = NULL;
+  }
+  if (!top_n->first_byval)
+    for (int i = 0; i < top_n->best->bh_size; i++)
+      pfree(DatumGetPointer(top_n->best->bh_nodes[i]));
+  binaryheap_reset(top_n->best);
+}
+
 static TupleTableSlot *icebergcIterateForeignScan(ForeignScanState *node) {
   IcebergScanState *state = (IcebergScanState *)node->fdw_state;
-  if (state == NULL || state->reader == NULL)
+  if (state == NULL)
     ereport(ERROR,
             (errcode(ERRCODE_FDW_ERROR), errmsg("scan state not initialized")));
   TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-  int natts = slot->tts_tupleDescriptor->natts;
 
   ExecClearTuple(slot);
+  /* Instrumentation is set up only after BeginForeignScan returns. */
+  state->spec.instrument =
+      node->ss.ps.instrument && node->ss.ps.instrument->need_timer;
 
-  if (!parquet_reader_next(state->reader, state->values, natts))
+  if (state->top_n) {
+    IcebergTopN *top_n = state->top_n;
+    if (!top_n->sort)
+      collect_top_n(state, slot);
+    if (tuplesort_gettupleslot(top_n->sort, true, false, top_n->sorted, NULL))
+      ExecCopySlot(slot, top_n->sorted);
     return slot;
+  }
 
-  Datum *values = slot->tts_values;
-  bool *nulls = slot->tts_isnull;
-
-  for (int i = 0; i < natts; i++) {
-    if (state->values[i] == NULL) {
-      nulls[i] = true;
-    } else {
-      values[i] = InputFunctionCall(
-          &(state->attinmeta->attinfuncs[i]), state->values[i],
-          state->attinmeta->attioparams[i], state->attinmeta->atttypmods[i]);
-      nulls[i] = false;
-      pfree(state->values[i]);
-      state->values[i] = NULL;
+  if (state->agg) {
+    IcebergAggScan *agg = state->agg;
+    if (agg->done)
+      return slot;
+    compute_aggregates(state);
+    for (int i = 0; i < agg->naggs; i++) {
+      IcebergAggregate *a = &agg->aggs[i];
+      slot->tts_values[i] = a->count ? Int64GetDatum(a->n) : a->value;
+      slot->tts_isnull[i] = a->count ? false : a->isnull;
     }
+    agg->done = true;
+    return ExecStoreVirtualTuple(slot);
   }
 
-  ExecStoreVirtualTuple(slot);
+  if (next_row(state, slot->tts_values, slot->tts_isnull))
+    ExecStoreVirtualTuple(slot);
   return slot;
 }
 
+static void icebergcReScanForeignScan(ForeignScanState *node) {
+  IcebergScanState *state = (IcebergScanState *)node->fdw_state;
+
+  /* A parallel scan's shared state is reset by ReInitializeDSMForeignScan. */
+  if (state->reader)
+    close_reader(state);
+  if (state->queue) {
+    parquet_queue_close(state->queue);
+    state->queue = NULL;
+  }
+  state->next_file = 0;
+  if (state->top_n)
+    reset_top_n(state->top_n);
+  if (state->agg)
+    reset_aggregates(state->agg);
+}
+
 static void icebergcEndForeignScan(ForeignScanState *node) {
   IcebergScanState *state = (IcebergScanState *)node->fdw_state;
   if (state == NULL)
     ereport(ERROR,
             (errcode(ERRCODE_FDW_ERROR), errmsg("foreign scan state is NULL")));
   if (state->reader)
-    parquet_reader_close(state->reader);
-  if (state->values) {
-    TupleDesc desc = RelationGetDescr(node->ss.ss_currentRelation);
-    for (int i = 0; i < desc->natts; i++)
-      if (state->values[i])
-        pfree(state->values[i]);
-    pfree(state->values);
+    close_reader(state);
+  if (state->queue)
+    parquet_queue_close(state->queue);
+  if (state->top_n) {
+    reset_top_n(state->top_n);
+    ExecDropSingleTupleTableSlot(state->top_n->sorted);
+    MemoryContextDelete(state->top_n->row_cxt);
   }
-  ListCell *lc;
-  foreach (lc, state->filters) {
-    IcebergFilter *f = (IcebergFilter *)lfirst(lc);
-    pfree(f->column);
-    if (f->op)
-      pfree(f->op);
-    if (f->val1)
-      pfree(f->val1);
-    if (f->val2)
-      pfree(f->val2);
-    pfree(f);
+  if (state->agg) {
+    reset_aggregates(state->agg);
+    MemoryContextDelete(state->agg->row_cxt);
+  }
+  if (state->next_file > 0 || state->pscan)
+    elog(DEBUG1,
+         "row groups: " INT64_FORMAT " of " INT64_FORMAT
+         " pruned, " INT64_FORMAT " summarized, rows: " INT64_FORMAT
+         " filtered",
+         state->stats.row_groups_pruned, state->stats.row_groups,
+         state->stats.row_groups_summarized, state->stats.rows_filtered);
+  if (state->spec.pool) {
+    elog(DEBUG1, "decoded data: peak " INT64_FORMAT " kB",
+         parquet_pool_peak(state->spec.pool) / 1024);
+    parquet_pool_close(state->spec.pool);
   }
+  if (state->spec.attrs_used)
+    pfree((void *)state->spec.attrs_used);
+  if (state->spec.filters)
+    pfree((void *)state->spec.filters);
+  ListCell *lc;
+  foreach (lc, state->filters)
+    free_filter((IcebergFilter *)lfirst(lc));
   list_free(state->filters);
   foreach (lc, state->columns)
     pfree(lfirst(lc));
   list_free(state->columns);
   if (state->opts)
     pfree(state->opts);
+  state->cleanup->arg = NULL;
   pfree(state);
   node->fdw_state = NULL;
 }
 
+/*
+ * Counters that belong together: one "label: name=value ..." line in text
+ * format, a property each otherwise. Units show in text only if text_unit.
+ */
+typedef struct ExplainCounter {
+  const char *name;
+  const char *property;
+  double value;
+} ExplainCounter;
+
+static void explain_counters(const char *label, const ExplainCounter *counters,
+                             int n, const char *unit, bool text_unit,
+                             int ndigits, ExplainState *es) {
+  if (es->format != EXPLAIN_FORMAT_TEXT) {
+    for (int i = 0; i < n; i++)
+      ExplainPropertyFloat(counters[i].property, unit, counters[i].value,
+                           ndigits, es);
+    return;
+  }
+  appendStringInfoSpaces(es->str, es->indent * 2);
+  appendStringInfo(es->str, "%s:", label);
+  for (int i = 0; i < n; i++) {
+    if (counters[i].name)
+      appendStringInfo(es->str, " %s=", counters[i].name);
+    else
+      appendStringInfoChar(es->str, ' ');
+    appendStringInfo(es->str, "%.*f%s", ndigits, counters[i].value,
+                     text_unit ? unit : "");
+  }
+  appendStringInfoChar(es->str, '\n');
+}
+
+/*
+ * EXPLAIN shows what the reader is given: the filters it evaluates or prunes
+ * with, the columns it decodes and, for Iceberg tables, the data files left
+ * after pruning. EXPLAIN ANALYZE adds what the scan read and, with TIMING,
+ * where the reader's time went; parallel scans show the leader's part.
+ */
+static void icebergcExplainForeignScan(ForeignScanState *node,
+                                       ExplainState *es) {
+  IcebergScanState *state = (IcebergScanState *)node->fdw_state;
+  ListCell *lc;
+
+  if (state == NULL)
+    return;
+  if (state->filters) {
+    List *filters = NIL;
+    foreach (lc, state->filters) {
+      IcebergFilter *f = (IcebergFilter *)lfirst(lc);
+      if (f->kind == ICEBERG_FILTER_BETWEEN)
+        filters = lappend(filters, psprintf("%s BETWEEN %s AND %s", f->column,
+                                            f->val1, f->val2));
+      else
+        filters =
+            lappend(filters, psprintf("%s %s %s", f->column, f->op, f->val1));
+    }
+    ExplainPropertyList("Pushed Filters", filters, es);
+  }
+  if (state->columns)
+    ExplainPropertyList("Columns Read", state->columns, es);
+  if (state->iceberg) {
+    ExplainCounter files[] = {
+        {"planned", "Data Files Planned", state->files.nfiles},
+        {"pruned", "Data Files Pruned", state->files.files_pruned},
+    };
+    ExplainCounter manifests[] = {
+        {"total", "Manifests", state->files.manifests},
+        {"pruned", "Manifests Pruned", state->files.manifests_pruned},
+    };
+    explain_counters("Data Files", files, lengthof(files), NULL, false, 0, es);
+    explain_counters("Manifests", manifests, lengthof(manifests), NULL, false,
+                     0, es);
+  }
+  if (!es->analyze)
+    return;
+
+  /* Totals of the readers closed so far, and of the one still open. */
+  ParquetReaderStats stats = state->stats;
+  if (state->reader) {
+    ParquetReaderStats open;
+    parquet_reader_get_stats(state->reader, &open);
+    add_reader_stats(&stats, &open);
+  }
+  ExplainCounter row_groups[5] = {
+      {"total", "Row Groups", stats.row_groups},
+      {"pruned", "Row Groups Pruned", stats.row_groups_pruned},
+  };
+  int nrow_groups = 2;
+  bool lookup = false;
+  for (int i = 0; i < state->spec.nfilters; i++)
+    lookup = lookup || state->spec.filters[i].op == PARQUET_FILTER_EQ;
+  /* Equality filters also prune with the page index and bloom filters. */
+  if (lookup) {
+    row_groups[nrow_groups++] =
+        (ExplainCounter){"by_pages", "Row Groups Pruned by Page Index",
+                         stats.row_groups_pruned_pages};
+    row_groups[nrow_groups++] =
+        (ExplainCounter){"by_bloom", "Row Groups Pruned by Bloom Filters",
+                         stats.row_groups_pruned_bloom};
+  }
+  if (state->agg)
+    row_groups[nrow_groups++] =
+        (ExplainCounter){"summarized", "Row Groups Summarized",
+                         stats.row_groups_summarized};
+  explain_counters("Row Groups", row_groups, nrow_groups, NULL, false, 0, es);
+  if (state->spec.nfilters > 0)
+    ExplainPropertyInteger("Rows Removed by Reader Filters", NULL,
+                           stats.rows_filtered, es);
+  ExplainCounter data[] = {
+      {"total", "Data Read", stats.bytes_read / 1024.0},
+      {"remote", "Data Fetched Remotely", stats.bytes_remote / 1024.0},
+  };
+  explain_counters("Data Read", data, stats.bytes_remote > 0 ? 2 : 1, "kB",
+                   true, 0, es);
+  if (state->spec.instrument && es->timing) {
+    ExplainCounter times[] = {
+        {"fetch", "Reader Fetch Time", stats.fetch_time},
+        {"decode", "Reader Decode Time", stats.decode_time},
+        {"filter", "Reader Filter Time", stats.filter_time},
+        {"convert", "Reader Convert Time", stats.convert_time},
+    };
+    explain_counters("Reader Time", times, lengthof(times), "ms", false, 3,
+                     es);
+  }
+  if (state->spec.pool) {
+    ExplainCounter peak[] = {
+        {NULL, "Peak Decoded Memory",
+         parquet_pool_peak(state->spec.pool) / 1024.0},
+    };
+    explain_counters("Peak Decoded Memory", peak, 1, "kB", true, 0, es);
+  }
+}
+
+static bool icebergcIsForeignScanParallelSafe(PlannerInfo *root,
+                                              RelOptInfo *rel,
+                                              RangeTblEntry *rte) {
+  return true;
+}
+
+static Size icebergcEstimateDSMForeignScan(ForeignScanState *node,
+                                           ParallelContext *pcxt) {
+  IcebergScanState *state = (IcebergScanState *)node->fdw_state;
+  Size size = add_size(offsetof(IcebergParallelScan, files),
+                       mul_size(state->files.nfiles,
+                                sizeof(IcebergParallelFile)));
+  for (int i = 0; i < state->files.nfiles; i++)
+    size = add_size(size, strlen(state->files.paths[i]) + 1);
+  return size;
+}
+
+/* The leader copies out the files it planned for the workers to share. */
+static void icebergcInitializeDSMForeignScan(ForeignScanState *node,
+                                             ParallelContext *pcxt,
+                                             void *coordinate) {
+  IcebergScanState *state = (IcebergScanState *)node->fdw_state;
+  IcebergParallelScan *pscan = (IcebergParallelScan *)coordinate;
+  Size offset = offsetof(IcebergParallelScan, files) +
+                state->files.nfiles * sizeof(IcebergParallelFile);
+
+  pg_atomic_init_u32(&pscan->next_file, 0);
+  pscan->nfiles = state->files.nfiles;
+  for (int i = 0; i < pscan->nfiles; i++) {
+    IcebergParallelFile *file = &pscan->files[i];
+    Size len = strlen(state->files.paths[i]) + 1;
+
+    pg_atomic_init_u32(&file->row_groups, 0);
+    pg_atomic_init_u32(&file->next_row_group, 0);
+    file->path = offset;
+    memcpy((char *)pscan + offset, state->files.paths[i], len);
+    offset += len;
+  }
+  state->pscan = pscan;
+}
+
+static void icebergcReInitializeDSMForeignScan(ForeignScanState *node,
+                                               ParallelContext *pcxt,
+                                               void *coordinate) {
+  IcebergParallelScan *pscan = (IcebergParallelScan *)coordinate;
+
+  pg_atomic_write_u32(&pscan->next_file, 0);
+  for (int i = 0; i < pscan->nfiles; i++) {
+    pg_atomic_write_u32(&pscan->files[i].row_groups, 0);
+    pg_atomic_write_u32(&pscan->files[i].next_row_group, 0);
+  }
+}
+
+static void icebergcInitializeWorkerForeignScan(ForeignScanState *node,
+                                                shm_toc *toc,
+                                                void *coordinate) {
+  IcebergScanState *state = (IcebergScanState *)node->fdw_state;
+  IcebergParallelScan *pscan = (IcebergParallelScan *)coordinate;
+
+  state->files.nfiles = pscan->nfiles;
+  state->files.paths = palloc(sizeof(char *) * Max(pscan->nfiles, 1));
+  for (int i = 0; i < pscan->nfiles; i++)
+    state->files.paths[i] = (char *)pscan + pscan->files[i].path;
+  state->pscan = pscan;
+}
+
+/*
+ * ANALYZE reads a random selection of row groups, no more than
+ * icebergc_fdw.analyze_read_size of column chunks, and samples rows from
+ * them. Files are visited in a random order weighted by their row counts and
+ * each visit takes one row group, itself weighted by rows, so the sample is
+ * spread over as many files as the budget allows.
+ */
+typedef struct SampleFile {
+  const char *path;
+  double rows;        /* from the table metadata, or the footer */
+  double key;         /* visiting order */
+  int nrow_groups;    /* -1 until the footer has been read */
+  int64 *rg_rows;
+  int64 *rg_bytes;
+  bool *rg_taken;
+  int *picked;        /* row groups to read */
+  int npicked;
+} SampleFile;
+
+static int sample_file_cmp(const void *a, const void *b) {
+  double ka = ((const SampleFile *)a)->key;
+  double kb = ((const SampleFile *)b)->key;
+  return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+static int int_cmp(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* Reads the row counts and sizes of a file's row groups. */
+static void sample_file_footer(SampleFile *file, const ParquetScanSpec *spec) {
+  ParquetReader *reader = parquet_reader_open(file->path, spec);
+  ParquetReaderStats stats;
+
+  if (!reader)
+    ereport(ERROR, (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
+                    errmsg("could not open parquet file \"%s\"", file->path)));
+  parquet_reader_get_stats(reader, &stats);
+  file->nrow_groups = (int)stats.row_groups;
+  file->rg_rows = palloc(sizeof(int64) * (file->nrow_groups + 1));
+  file->rg_bytes = palloc(sizeof(int64) * (file->nrow_groups + 1));
+  file->rg_taken = palloc0(sizeof(bool) * (file->nrow_groups + 1));
+  file->picked = palloc(sizeof(int) * (file->nrow_groups + 1));
+  file->rows = 0;
+  for (int i = 0; i < file->nrow_groups; i++) {
+    parquet_reader_row_group(reader, i, &file->rg_rows[i], &file->rg_bytes[i]);
+    file->rows += file->rg_rows[i];
+  }
+  parquet_reader_close(reader);
+}
+
+/* Takes one row group not taken yet, weighted by rows; -1 if none is left. */
+static int sample_row_group(SampleFile *file, ReservoirState rstate) {
+  double left = 0;
+  int last = -1;
+
+  for (int i = 0; i < file->nrow_groups; i++)
+    if (!file->rg_taken[i] && file->rg_rows[i] > 0) {
+      left += file->rg_rows[i];
+      last = i;
+    }
+  if (last < 0)
+    return -1;
+
+  double r = sampler_random_fract(&rstate->randstate) * left;
+  for (int i = 0; i < last; i++) {
+    if (file->rg_taken[i] || file->rg_rows[i] <= 0)
+      continue;
+    r -= file->rg_rows[i];
+    if (r < 0) {
+      last = i;
+      break;
+    }
+  }
+  file->rg_taken[last] = true;
+  file->picked[file->npicked++] = last;
+  return last;
+}
+
+static int icebergcAcquireSampleRows(Relation relation, int elevel,
+                                     HeapTuple *rows, int targrows,
+                                     double *totalrows, double *totaldeadrows) {
+  ForeignTable *table = GetForeignTable(RelationGetRelid(relation));
+  IcebergcFdwOptions *opts =
+      icebergcGetOptions(RelationGetRelid(relation), table->serverid);
+  TupleDesc desc = RelationGetDescr(relation);
+  IcebergcS3Options s3;
+  IcebergTableRef iceberg;
+  IcebergScanFiles files = {0};
+  ParquetScanSpec spec = {0};
+  ReservoirStateData rstate;
+
+  icebergc_s3_options(opts, &s3);
+  spec.tupdesc = desc;
+  spec.s3 = &s3;
+  if (icebergc_table_ref(opts, &s3, &iceberg))
+    iceberg_plan_files(&iceberg, &spec, &files);
+  else {
+    files.nfiles = 1;
+    files.paths = palloc(sizeof(char *));
+    files.paths[0] = opts->catalog_uri;
+  }
+  reservoir_init_selection_state(&rstate, targrows);
+
+  /* Efraimidis-Spirakis keys give a random order weighted by rows. */
+  SampleFile *sample = palloc0(sizeof(SampleFile) * (files.nfiles + 1));
+  int nsample = 0;
+  for (int i = 0; i < files.nfiles; i++) {
+    SampleFile *file = &sample[nsample];
+
+    file->path = files.paths[i];
+    file->nrow_groups = -1;
+    if (files.rows)
+      file->rows = (double)files.rows[i];
+    else
+      sample_file_footer(file, &spec);
+    if (file->rows <= 0)
+      continue;
+    file->key = -log(sampler_random_fract(&rstate.randstate)) / file->rows;
+    nsample++;
+  }
+  qsort(sample, nsample, sizeof(SampleFile), sample_file_cmp);
+
+  double budget = (double)icebergc_analyze_read_size * 1024 * 1024;
+  double bytes = 0;
+  int64 row_groups = 0;
+  bool progress = true;
+  *totalrows = 0;
+  for (int i = 0; i < nsample; i++)
+    *totalrows += sample[i].rows;
+  while (progress && bytes < budget) {
+    progress = false;
+    for (int i = 0; i < nsample && bytes < budget; i++) {
+      SampleFile *file = &sample[i];
+
+      CHECK_FOR_INTERRUPTS();
+      if (file->nrow_groups < 0)
+        sample_file_footer(file, &spec);
+      int rg = sample_row_group(file, &rstate);
+      if (rg < 0)
+        continue;
+      bytes += file->rg_bytes[rg];
+      row_groups++;
+      progress = true;
+    }
+  }
+
+  /* Rows are sampled from the chosen row groups by reservoir sampling. */
+  MemoryContext tupcontext = AllocSetContextCreate(
+      CurrentMemoryContext, "icebergc_fdw sample row", ALLOCSET_DEFAULT_SIZES);
+  Datum *values = palloc(sizeof(Datum) * desc->natts);
+  bool *nulls = palloc(sizeof(bool) * desc->natts);
+  double seen = 0;
+  double rowstoskip = -1;
+  int numrows = 0;
+  int nfiles = 0;
+  for (int i = 0; i < nsample; i++) {
+    SampleFile *file = &sample[i];
+    if (file->npicked == 0)
+      continue;
+    nfiles++;
+
+    ParquetReader *reader = parquet_reader_open(file->path, &spec);
+    if (!reader)
+      ereport(ERROR, (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
+                      errmsg("could not open parquet file \"%s\"", file->path)));
+    qsort(file->picked, file->npicked, sizeof(int), int_cmp);
+    parquet_reader_select_row_groups(reader, file->picked, file->npicked);
+
+    for (;;) {
+#if PG_VERSION_NUM >= 180000
+      vacuum_delay_point(true);
+#else
+      vacuum_delay_point();
+#endif
+      /* Rows the reservoir would pass over are skipped undecoded. */
+      if (numrows >= targrows) {
+        if (rowstoskip < 0)
+          rowstoskip = reservoir_get_next_S(&rstate, seen, targrows);
+        if (rowstoskip > 0) {
+          int64 skipped = parquet_reader_skip(reader, (int64)rowstoskip);
+          seen += skipped;
+          rowstoskip -= skipped;
+          if (rowstoskip > 0)
+            break;
+        }
+      }
+
+      MemoryContextReset(tupcontext);
+      MemoryContext old = MemoryContextSwitchTo(tupcontext);
+      bool found = parquet_reader_next(reader, values, nulls);
+      MemoryContextSwitchTo(old);
+      if (!found)
+        break;
+
+      if (numrows < targrows)
+        rows[numrows++] = heap_form_tuple(desc, values, nulls);
+      else {
+        int k = (int)(targrows * sampler_random_fract(&rstate.randstate));
+        heap_freetuple(rows[k]);
+        rows[k] = heap_form_tuple(desc, values, nulls);
+        rowstoskip = -1;
+      }
+      seen += 1;
+    }
+    parquet_reader_close(reader);
+  }
+  MemoryContextDelete(tupcontext);
+
+  /* The metadata counts every row; the sample may not have seen them all. */
+  if (*totalrows < seen)
+    *totalrows = seen;
+  *totaldeadrows = 0;
+
+  ereport(elevel,
+          (errmsg("\"%s\": read " INT64_FORMAT " row groups from %d of %d "
+                  "files, containing %.0f rows; %d rows in sample, %.0f "
+                  "estimated total rows",
+                  RelationGetRelationName(relation), row_groups, nfiles,
+                  files.nfiles, seen, numrows, *totalrows)));
+  return numrows;
+}
+
+static bool icebergcAnalyzeForeignTable(Relation relation,
+                                        AcquireSampleRowsFunc *func,
+                                        BlockNumber *totalpages) {
+  ForeignTable *table = GetForeignTable(RelationGetRelid(relation));
+  IcebergcFdwOptions *opts =
+      icebergcGetOptions(RelationGetRelid(relation), table->serverid);
+  IcebergcS3Options s3;
+  IcebergTableRef iceberg;
+  ParquetScanSpec spec = {0};
+  ParquetScanEstimate est;
+  bool estimated;
+
+  icebergc_s3_options(opts, &s3);
+  spec.tupdesc = RelationGetDescr(relation);
+  spec.s3 = &s3;
+  if (icebergc_table_ref(opts, &s3, &iceberg))
+    iceberg_estimate_scan(&iceberg, &spec, &est, &estimated);
+  else if (!parquet_estimate_scan(opts->catalog_uri, &spec, &est, &estimated))
+    return false;
+
+  *totalpages = (BlockNumber)Min(Max(ceil(est.bytes / BLCKSZ), 1),
+                                 MaxBlockNumber);
+  *func = icebergcAcquireSampleRows;
+  return true;
+}
+
 static IcebergcFdwOptions *icebergcGetOptions(Oid foreigntableid,
                                               Oid serverid) {
   if (!OidIsValid(foreigntableid))
@@ -456,8 +2575,9 @@ static IcebergcFdwOptions *icebergcGetOptions(Oid foreigntableid,
   ForeignTable *table = GetForeignTable(foreigntableid);
   ForeignServer *server = GetForeignServer(serverid);
 
-  options = list_concat(options, table->options);
+  /* Later entries win, so table options override the server's. */
   options = list_concat(options, server->options);
+  options = list_concat(options, table->options);
 
   foreach (lc, options) {
     DefElem *def = (DefElem *)lfirst(lc);
@@ -474,14 +2594,108 @@ static IcebergcFdwOptions *icebergcGetOptions(Oid foreigntableid,
       opts->warehouse = pstrdup(defGetString(def));
     else if (strcmp(def->defname, "s3_endpoint") == 0)
       opts->s3_endpoint = pstrdup(defGetString(def));
-    else
+    else if (strcmp(def->defname, "metadata_location") == 0)
+      opts->metadata_location = pstrdup(defGetString(def));
+    else if (strcmp(def->defname, "table_name") == 0)
+      opts->table_name = pstrdup(defGetString(def));
+    else if (strcmp(def->defname, "snapshot_id") == 0)
+      opts->snapshot_id = icebergc_snapshot_id(def);
+    else if (!icebergc_s3_tuning_option(def, opts) &&
+             !icebergc_hms_option(def, opts))
       ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
                       errmsg("invalid option \"%s\"", def->defname)));
   }
 
-  if (!opts->catalog_uri)
-    ereport(ERROR, (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-                    errmsg("\"catalog_uri\" option is required")));
+  if (!opts->catalog_uri && !opts->metadata_location && !opts->table_name)
+    ereport(ERROR,
+            (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+             errmsg("\"catalog_uri\", \"metadata_location\" or "
+                    "\"table_name\" option is required")));
+  if (icebergc_uses_hms(opts) && !opts->table_name && !opts->metadata_location)
+    ereport(ERROR,
+            (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+             errmsg("\"table_name\" is required with a Hive Metastore "
+                    "\"catalog_uri\"")));
+  if (opts->table_name && !opts->metadata_location &&
+      !icebergc_uses_hms(opts) && !opts->warehouse)
+    ereport(ERROR,
+            (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+             errmsg("\"table_name\" requires \"warehouse\" or a Hive "
+                    "Metastore \"catalog_uri\"")));
 
   return opts;
 }
+
+static void icebergc_s3_options(const IcebergcFdwOptions *opts,
+                                IcebergcS3Options *s3) {
+  memset(s3, 0, sizeof(*s3));
+  s3->endpoint = opts->s3_endpoint;
+  s3->region = opts->region;
+  s3->access_key_id = opts->aws_access_key_id;
+  s3->secret_access_key = opts->aws_secret_access_key;
+  s3->max_connections = opts->s3_max_connections;
+  s3->part_size = opts->s3_part_size;
+  s3->throughput_target_gbps = opts->s3_throughput_target_gbps;
+}
+
+/* Whether catalog_uri names a Hive Metastore rather than a Parquet file. */
+static bool icebergc_uses_hms(const IcebergcFdwOptions *opts) {
+  return opts->catalog_uri && strncmp(opts->catalog_uri, "thrift://", 9) == 0;
+}
+
+/*
+ * Where the table's Iceberg metadata is, if it is an Iceberg table rather
+ * than a single Parquet file: metadata_location; else the metadata_location
+ * the Hive Metastore records for table_name ([db.]table); else the directory
+ * <warehouse>/<namespace>/.../<table> the Hadoop catalog gives table_name.
+ */
+static bool icebergc_table_ref(const IcebergcFdwOptions *opts,
+                               const IcebergcS3Options *s3,
+                               IcebergTableRef *ref) {
+  memset(ref, 0, sizeof(*ref));
+  ref->snapshot_id = opts->snapshot_id;
+  ref->s3 = s3;
+  if (opts->metadata_location) {
+    ref->metadata_location = opts->metadata_location;
+    return true;
+  }
+  if (!opts->table_name)
+    return false;
+
+  if (icebergc_uses_hms(opts)) {
+    IcebergcHmsOptions hms = {0};
+    IcebergcHmsTable table;
+    char *db = pstrdup(opts->table_name);
+    char *name = strrchr(db, '.');
+
+    if (name)
+      *name++ = '\0';
+    else {
+      name = db;
+      db = "default";
+    }
+    hms.uri = opts->catalog_uri;
+    hms.connect_timeout = opts->hms_connect_timeout;
+    hms.timeout = opts->hms_timeout;
+    hms.framed = opts->hms_framed;
+    hms_get_table(&hms, db, name, &table);
+    if (!table.metadata_location)
+      ereport(ERROR, (errcode(ERRCODE_FDW_TABLE_NOT_FOUND),
+                      errmsg("\"%s\" in the Hive Metastore is not an Iceberg "
+                             "table",
+                             opts->table_name)));
+    ref->metadata_location = table.metadata_location;
+    return true;
+  }
+
+  StringInfoData location;
+  initStringInfo(&location);
+  appendStringInfoString(&location, opts->warehouse);
+  while (location.len > 0 && location.data[location.len - 1] == '/')
+    location.data[--location.len] = '\0';
+  appendStringInfoChar(&location, '/');
+  for (const char *c = opts->table_name; *c; c++)
+    appendStringInfoChar(&location, *c == '.' ? '/' : *c);
+  ref->table_location = location.data;
+  return true;
+}
@@ -1,59 +1,220 @@
-#include "postgres.h"
-
 extern "C" {
+#include "postgres.h"
 #include "utils/palloc.h"
 }
 
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include "hive_metastore_types.h"
 #include "hive_metastore_client.h"
 
+#include "icebergc_hms.h"
+#include "icebergc_stats.h"
+
 using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
 using namespace Apache::Hadoop::Hive;
 
-typedef struct PGColInfo
-{
-    char *name;
-    char *type;
-    bool nullable;
-} PGColInfo;
-
-PGColInfo *
-load_iceberg_table_schema(const char *db_name,
-                          const char *namespace_name,
-                          const char *table_name,
-                          int *out_len)
-{
-    std::shared_ptr<TSocket> socket(new TSocket("localhost", 9083));
-    std::shared_ptr<TTransport> transport(new TBufferedTransport(socket));
-    std::shared_ptr<TProtocol> protocol(new TBinaryProtocol(transport));
-    ThriftHiveMetastoreClient client(protocol);
-
-    transport->open();
-    Table tbl;
-    client.get_table(tbl, db_name, namespace_name, table_name);
-    transport->close();
-
-    size_t cols = tbl.sd.cols.size();
-    PGColInfo *result = (PGColInfo *) palloc0(sizeof(PGColInfo) * cols);
-
-    for (size_t i = 0; i < cols; ++i)
-    {
-        const FieldSchema &f = tbl.sd.cols[i];
-        result[i].name = pstrdup(f.name.c_str());
-        result[i].type = pstrdup(f.type.c_str());
-        if (f.__isset.nullable)
-            result[i].nullable = f.nullable;
+int icebergc_hms_cache_ttl = 60;
+
+/* Idle connections kept per metastore and set of options. */
+static const size_t kMaxIdleConnections = 4;
+
+/* Expired lookups are swept once the cache holds this many. */
+static const size_t kTableCacheSweep = 256;
+
+struct HmsConnection {
+    std::shared_ptr<TTransport> transport;
+    std::unique_ptr<ThriftHiveMetastoreClient> client;
+};
+
+struct CachedTable {
+    std::string db, name;
+    Table table;
+    std::chrono::steady_clock::time_point fetched;
+};
+
+/* Only the backend thread uses these. */
+static std::map<std::string, std::vector<std::unique_ptr<HmsConnection>>>
+    hms_pool;
+static std::map<std::string, CachedTable> hms_tables;
+
+static std::unique_ptr<HmsConnection> hms_connect(const IcebergcHmsOptions &opts) {
+    std::string uris(opts.uri), error = "no metastore URI";
+    size_t start = 0;
+    while (start <= uris.size()) {
+        size_t end = uris.find(',', start);
+        if (end == std::string::npos)
+            end = uris.size();
+        std::string uri = uris.substr(start, end - start);
+        start = end + 1;
+        while (!uri.empty() && uri.front() == ' ')
+            uri.erase(0, 1);
+        if (uri.empty())
+            continue;
+        if (uri.rfind("thrift://", 0) != 0)
+            throw std::runtime_error("metastore URI must start with thrift://: " +
+                                     uri);
+
+        std::string host = uri.substr(9);
+        int port = 9083;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            port = atoi(host.c_str() + colon + 1);
+            host.resize(colon);
+        }
+        while (!host.empty() && host.back() == '/')
+            host.pop_back();
+
+        auto socket = std::make_shared<TSocket>(host, port);
+        if (opts.connect_timeout > 0)
+            socket->setConnTimeout(opts.connect_timeout);
+        if (opts.timeout > 0) {
+            socket->setRecvTimeout(opts.timeout);
+            socket->setSendTimeout(opts.timeout);
+        }
+        std::shared_ptr<TTransport> transport;
+        if (opts.framed)
+            transport = std::make_shared<TFramedTransport>(socket);
         else
-            result[i].nullable = true;
+            transport = std::make_shared<TBufferedTransport>(socket);
+        try {
+            transport->open();
+        } catch (const std::exception &e) {
+            error = uri + ": " + e.what();
+            continue;
+        }
+
+        auto conn = std::make_unique<HmsConnection>();
+        conn->transport = transport;
+        conn->client = std::make_unique<ThriftHiveMetastoreClient>(
+            std::make_shared<TBinaryProtocol>(transport));
+        return conn;
     }
+    throw std::runtime_error("could not connect to the metastore: " + error);
+}
 
-    if (out_len)
-        *out_len = cols;
+/*
+ * Runs fn on a pooled connection, opening one if none is idle. The metastore
+ * may have dropped an idle connection, so a transport error on a pooled one
+ * is retried once on a fresh connection. Connections that saw an error are
+ * not returned to the pool.
+ */
+template <typename Fn>
+static void with_connection(const IcebergcHmsOptions &opts, Fn &&fn) {
+    std::string key = std::string(opts.uri) + '\0' +
+                      std::to_string(opts.connect_timeout) + '\0' +
+                      std::to_string(opts.timeout) + '\0' +
+                      (opts.framed ? "framed" : "buffered");
+    std::vector<std::unique_ptr<HmsConnection>> &idle = hms_pool[key];
 
-    return result;
+    std::unique_ptr<HmsConnection> conn;
+    bool pooled = !idle.empty();
+    if (pooled) {
+        conn = std::move(idle.back());
+        idle.pop_back();
+    } else {
+        conn = hms_connect(opts);
+    }
+    try {
+        fn(*conn->client);
+    } catch (const TTransportException &) {
+        if (!pooled)
+            throw;
+        conn = hms_connect(opts);
+        fn(*conn->client);
+    }
+    if (idle.size() < kMaxIdleConnections)
+        idle.push_back(std::move(conn));
+}
+
+static const Table &get_table(const IcebergcHmsOptions &opts,
+                              const std::string &db, const std::string &name) {
+    auto now = std::chrono::steady_clock::now();
+    auto ttl = std::chrono::seconds(icebergc_hms_cache_ttl);
+    std::string key = std::string(opts.uri) + '\0' + db + '\0' + name;
+
+    auto it = hms_tables.find(key);
+    if (it != hms_tables.end() && now - it->second.fetched < ttl) {
+        icebergc_stats_add(ICEBERGC_STAT_HMS_CACHE_HITS, 1);
+        return it->second.table;
+    }
+
+    Table table;
+    icebergc_stats_add(ICEBERGC_STAT_HMS_CALLS, 1);
+    try {
+        with_connection(opts, [&](ThriftHiveMetastoreClient &client) {
+            client.get_table(table, db, name);
+        });
+    } catch (...) {
+        icebergc_stats_add(ICEBERGC_STAT_HMS_ERRORS, 1);
+        throw;
+    }
+    icebergc_stats_observe(
+        ICEBERGC_LATENCY_HMS_CALL,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - now).count());
+
+    if (hms_tables.size() >= kTableCacheSweep) {
+        for (auto e = hms_tables.begin(); e != hms_tables.end();)
+            e = now - e->second.fetched < ttl ? std::next(e)
+                                              : hms_tables.erase(e);
+    }
+    CachedTable &entry = hms_tables[key];
+    entry.db = db;
+    entry.name = name;
+    entry.table = std::move(table);
+    entry.fetched = now;
+    return entry.table;
+}
+
+extern "C" void hms_get_table(const IcebergcHmsOptions *opts,
+                              const char *db_name, const char *table_name,
+                              IcebergcHmsTable *table) {
+    const Table *tbl = NULL;
+    char *msg = NULL;
+    try {
+        tbl = &get_table(*opts, db_name, table_name);
+    } catch (const std::exception &e) {
+        msg = pstrdup(e.what());
+    }
+    if (!tbl)
+        ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
+                 errmsg("could not get table \"%s.%s\" from the Hive Metastore: %s",
+                        db_name, table_name, msg)));
+
+    /* Nothing below owns C++ resources, so a failing palloc may longjmp. */
+    auto param = tbl->parameters.find("metadata_location");
+    table->metadata_location = param == tbl->parameters.end()
+                                   ? NULL
+                                   : pstrdup(param->second.c_str());
+    table->location = pstrdup(tbl->sd.location.c_str());
+    table->ncols = (int)tbl->sd.cols.size();
+    table->cols = (PGColInfo *)palloc0(sizeof(PGColInfo) * (table->ncols + 1));
+    for (int i = 0; i < table->ncols; ++i) {
+        const FieldSchema &f = tbl->sd.cols[i];
+        table->cols[i].name = pstrdup(f.name.c_str());
+        table->cols[i].type = pstrdup(f.type.c_str());
+        table->cols[i].nullable = f.__isset.nullable ? f.nullable : true;
+    }
+}
+
+extern "C" void hms_invalidate(const char *db_name, const char *table_name) {
+    for (auto e = hms_tables.begin(); e != hms_tables.end();) {
+        bool match = (!db_name || e->second.db == db_name) &&
+                     (!table_name || e->second.name == table_name);
+        e = match ? hms_tables.erase(e) : std::next(e);
+    }
 }
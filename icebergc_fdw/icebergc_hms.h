@@ -1,8 +1,24 @@
 #ifndef ICEBERGC_HMS_H
 #define ICEBERGC_HMS_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "postgres.h"
 
+/*
+ * How to reach a Hive Metastore. uri is thrift://host[:port], or several
+ * comma-separated ones tried in order. Zero timeouts keep Thrift's defaults.
+ */
+typedef struct IcebergcHmsOptions
+{
+    const char *uri;
+    int connect_timeout; /* ms */
+    int timeout;         /* ms, for sending a request and its reply */
+    bool framed;         /* TFramedTransport rather than TBufferedTransport */
+} IcebergcHmsOptions;
+
 typedef struct PGColInfo
 {
     char *name;
@@ -10,9 +26,33 @@ typedef struct PGColInfo
     bool nullable;
 } PGColInfo;
 
-PGColInfo *load_iceberg_table_schema(const char *db_name,
-                                     const char *namespace_name,
-                                     const char *table_name,
-                                     int *out_len);
+typedef struct IcebergcHmsTable
+{
+    char *metadata_location; /* table parameter; NULL if not an Iceberg table */
+    char *location;          /* storage location */
+    PGColInfo *cols;
+    int ncols;
+} IcebergcHmsTable;
+
+/* icebergc_fdw.hms_cache_ttl, in seconds; 0 disables the table cache. */
+extern int icebergc_hms_cache_ttl;
+
+/*
+ * Looks up db_name.table_name. Connections are pooled per backend and
+ * results cached for icebergc_fdw.hms_cache_ttl, so repeated planning does
+ * not pay a Thrift round trip. The result is palloc'd.
+ */
+void hms_get_table(const IcebergcHmsOptions *opts, const char *db_name,
+                   const char *table_name, IcebergcHmsTable *table);
+
+/*
+ * Drops cached lookups of this backend of database db_name and table
+ * table_name; a NULL name matches any. Both NULL drops all of them.
+ */
+void hms_invalidate(const char *db_name, const char *table_name);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* ICEBERGC_HMS_H */
@@ -0,0 +1,1277 @@
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/status.h>
+#include <arrow/util/compression.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+
+#include <strings.h>
+
+#include "icebergc_manifest.h"
+
+/*
+ * JSON, as much of it as table metadata files need. Numbers keep their text
+ * so 64-bit snapshot ids survive exactly.
+ */
+struct Json {
+    enum Kind { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } kind = NUL;
+    bool b = false;
+    std::string str; // a string, or the text of a number
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    /* The member named key, or NULL if absent, null or not an object. */
+    const Json *get(const char *key) const {
+        if (kind != OBJECT)
+            return nullptr;
+        for (const auto &m : members)
+            if (m.first == key)
+                return m.second.kind == NUL ? nullptr : &m.second;
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string &text)
+        : p_(text.data()), end_(text.data() + text.size()) {}
+
+    Json Parse() {
+        Json v = Value(0);
+        Space();
+        if (p_ != end_)
+            Fail("trailing characters");
+        return v;
+    }
+
+private:
+    [[noreturn]] void Fail(const char *what) {
+        throw std::runtime_error(std::string("invalid table metadata: ") + what);
+    }
+
+    void Space() {
+        while (p_ < end_ &&
+               (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+            p_++;
+    }
+
+    bool Literal(const char *s) {
+        size_t n = strlen(s);
+        if ((size_t)(end_ - p_) < n || memcmp(p_, s, n) != 0)
+            return false;
+        p_ += n;
+        return true;
+    }
+
+    bool Peek(char c) {
+        Space();
+        return p_ < end_ && *p_ == c;
+    }
+
+    Json Value(int depth) {
+        if (depth > 64)
+            Fail("nested too deeply");
+        Space();
+        if (p_ == end_)
+            Fail("unexpected end");
+        Json v;
+        if (*p_ == '{') {
+            v.kind = Json::OBJECT;
+            p_++;
+            if (Peek('}')) {
+                p_++;
+                return v;
+            }
+            for (;;) {
+                if (!Peek('"'))
+                    Fail("expected a member name");
+                std::string key = String();
+                if (!Peek(':'))
+                    Fail("expected ':'");
+                p_++;
+                v.members.emplace_back(std::move(key), Value(depth + 1));
+                if (Peek(',')) {
+                    p_++;
+                    continue;
+                }
+                if (Peek('}')) {
+                    p_++;
+                    return v;
+                }
+                Fail("expected ',' or '}'");
+            }
+        }
+        if (*p_ == '[') {
+            v.kind = Json::ARRAY;
+            p_++;
+            if (Peek(']')) {
+                p_++;
+                return v;
+            }
+            for (;;) {
+                v.items.push_back(Value(depth + 1));
+                if (Peek(',')) {
+                    p_++;
+                    continue;
+                }
+                if (Peek(']')) {
+                    p_++;
+                    return v;
+                }
+                Fail("expected ',' or ']'");
+            }
+        }
+        if (*p_ == '"') {
+            v.kind = Json::STRING;
+            v.str = String();
+            return v;
+        }
+        if (Literal("true")) {
+            v.kind = Json::BOOL;
+            v.b = true;
+            return v;
+        }
+        if (Literal("false")) {
+            v.kind = Json::BOOL;
+            return v;
+        }
+        if (Literal("null"))
+            return v;
+        if (*p_ == '-' || (*p_ >= '0' && *p_ <= '9')) {
+            const char *start = p_++;
+            while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' ||
+                                 *p_ == 'e' || *p_ == 'E' || *p_ == '+' ||
+                                 *p_ == '-'))
+                p_++;
+            v.kind = Json::NUMBER;
+            v.str.assign(start, p_);
+            return v;
+        }
+        Fail("unexpected character");
+    }
+
+    uint32_t Hex4() {
+        if (end_ - p_ < 4)
+            Fail("truncated \\u escape");
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p_++;
+            cp <<= 4;
+            if (c >= '0' && c <= '9')
+                cp |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                cp |= c - 'A' + 10;
+            else
+                Fail("bad \\u escape");
+        }
+        return cp;
+    }
+
+    static void AppendUtf8(std::string &out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += (char)cp;
+        } else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string String() {
+        std::string out;
+        p_++; // opening quote
+        while (p_ < end_ && *p_ != '"') {
+            char c = *p_++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p_ == end_)
+                break;
+            c = *p_++;
+            switch (c) {
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                uint32_t cp = Hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && Literal("\\u")) {
+                    uint32_t lo = Hex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                AppendUtf8(out, cp);
+                break;
+            }
+            default:
+                out += c;
+            }
+        }
+        if (p_ == end_)
+            Fail("unterminated string");
+        p_++;
+        return out;
+    }
+
+    const char *p_;
+    const char *end_;
+};
+
+static const Json &json_member(const Json &obj, const char *key) {
+    const Json *v = obj.get(key);
+    if (!v)
+        throw std::runtime_error(std::string("table metadata has no \"") + key +
+                                 "\"");
+    return *v;
+}
+
+static int64_t json_int(const Json &v) {
+    char *end;
+    errno = 0;
+    long long x = strtoll(v.str.c_str(), &end, 10);
+    if (v.kind != Json::NUMBER || *end != '\0' || errno != 0)
+        throw std::runtime_error("invalid table metadata: expected an integer");
+    return x;
+}
+
+/*
+ * Avro object container files: schema-driven decoding of the writer's schema
+ * into a generic tree, which is small enough for manifest entries.
+ */
+struct AvroSchema {
+    enum Type {
+        NUL, BOOLEAN, INT, LONG, FLOAT, DOUBLE, BYTES, STRING,
+        RECORD, ENUM, ARRAY, MAP, UNION, FIXED
+    } type = NUL;
+    std::vector<std::string> names;           // record field names
+    std::vector<int64_t> field_ids;           // their "field-id", -1 if none
+    std::vector<const AvroSchema *> children; // fields, branches or items
+    int64_t size = 0;                         // fixed
+
+    int Field(const char *name) const {
+        for (size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return (int)i;
+        return -1;
+    }
+};
+
+class AvroSchemaSet {
+public:
+    const AvroSchema *Parse(const Json &j, const std::string &ns) {
+        if (j.kind == Json::ARRAY) {
+            AvroSchema *s = New(AvroSchema::UNION);
+            for (const Json &branch : j.items)
+                s->children.push_back(Parse(branch, ns));
+            return s;
+        }
+        if (j.kind == Json::STRING)
+            return Named(j.str, ns);
+        if (j.kind != Json::OBJECT)
+            throw std::runtime_error("invalid Avro schema");
+
+        const Json &type = json_member(j, "type");
+        if (type.kind != Json::STRING)
+            return Parse(type, ns);
+        const std::string &t = type.str;
+        if (t == "record" || t == "error" || t == "enum" || t == "fixed") {
+            const Json *name = j.get("name");
+            const Json *jns = j.get("namespace");
+            std::string child_ns = jns ? jns->str : ns;
+            AvroSchema *s = New(t == "enum"    ? AvroSchema::ENUM
+                                : t == "fixed" ? AvroSchema::FIXED
+                                               : AvroSchema::RECORD);
+            if (name) {
+                std::string full = name->str;
+                if (full.find('.') == std::string::npos && !child_ns.empty())
+                    full = child_ns + "." + full;
+                else if (full.find('.') != std::string::npos)
+                    child_ns = full.substr(0, full.rfind('.'));
+                named_[full] = s;
+            }
+            if (s->type == AvroSchema::FIXED)
+                s->size = json_int(json_member(j, "size"));
+            if (s->type == AvroSchema::RECORD) {
+                for (const Json &f : json_member(j, "fields").items) {
+                    s->names.push_back(json_member(f, "name").str);
+                    const Json *id = f.get("field-id");
+                    s->field_ids.push_back(id ? json_int(*id) : -1);
+                    s->children.push_back(Parse(json_member(f, "type"), child_ns));
+                }
+            }
+            return s;
+        }
+        if (t == "array") {
+            AvroSchema *s = New(AvroSchema::ARRAY);
+            s->children.push_back(Parse(json_member(j, "items"), ns));
+            return s;
+        }
+        if (t == "map") {
+            AvroSchema *s = New(AvroSchema::MAP);
+            s->children.push_back(Parse(json_member(j, "values"), ns));
+            return s;
+        }
+        return Named(t, ns); // a primitive, possibly with a logicalType
+    }
+
+private:
+    AvroSchema *New(AvroSchema::Type type) {
+        nodes_.push_back(std::make_unique<AvroSchema>());
+        nodes_.back()->type = type;
+        return nodes_.back().get();
+    }
+
+    const AvroSchema *Named(const std::string &name, const std::string &ns) {
+        static const std::pair<const char *, AvroSchema::Type> primitives[] = {
+            {"null", AvroSchema::NUL},     {"boolean", AvroSchema::BOOLEAN},
+            {"int", AvroSchema::INT},      {"long", AvroSchema::LONG},
+            {"float", AvroSchema::FLOAT},  {"double", AvroSchema::DOUBLE},
+            {"bytes", AvroSchema::BYTES},  {"string", AvroSchema::STRING},
+        };
+        for (const auto &p : primitives)
+            if (name == p.first)
+                return New(p.second);
+        auto it = named_.find(ns.empty() ? name : ns + "." + name);
+        if (it == named_.end())
+            it = named_.find(name);
+        if (it == named_.end())
+            throw std::runtime_error("unknown Avro type \"" + name + "\"");
+        return it->second;
+    }
+
+    std::vector<std::unique_ptr<AvroSchema>> nodes_;
+    std::map<std::string, const AvroSchema *> named_;
+};
+
+struct AvroValue {
+    const AvroSchema *schema = nullptr; // the union branch taken, for unions
+    int64_t i = 0;                      // boolean, int, long, enum
+    double d = 0;                       // float, double
+    std::string s;                      // bytes, string, fixed
+    std::vector<AvroValue> items;       // record fields, array or map values
+    std::vector<std::string> keys;      // map keys
+
+    bool is_null() const {
+        return schema == nullptr || schema->type == AvroSchema::NUL;
+    }
+
+    /* A record field, or NULL if the record has none or it is null. */
+    const AvroValue *field(const char *name) const {
+        if (is_null() || schema->type != AvroSchema::RECORD)
+            return nullptr;
+        int idx = schema->Field(name);
+        if (idx < 0 || items[idx].is_null())
+            return nullptr;
+        return &items[idx];
+    }
+};
+
+class AvroDecoder {
+public:
+    AvroDecoder(const uint8_t *p, size_t n) : p_(p), end_(p + n) {}
+
+    bool done() const { return p_ == end_; }
+
+    int64_t Long() {
+        uint64_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            if (p_ == end_ || shift > 63)
+                Fail();
+            uint8_t b = *p_++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    std::string_view Raw(int64_t n) {
+        if (n < 0 || n > end_ - p_)
+            Fail();
+        std::string_view out(reinterpret_cast<const char *>(p_), n);
+        p_ += n;
+        return out;
+    }
+
+    void Value(const AvroSchema *s, AvroValue *out, int depth = 0) {
+        if (depth > 32)
+            Fail();
+        out->schema = s;
+        switch (s->type) {
+        case AvroSchema::NUL:
+            break;
+        case AvroSchema::BOOLEAN:
+            out->i = Raw(1)[0] != 0;
+            break;
+        case AvroSchema::INT:
+        case AvroSchema::LONG:
+        case AvroSchema::ENUM:
+            out->i = Long();
+            break;
+        case AvroSchema::FLOAT: {
+            float f;
+            memcpy(&f, Raw(4).data(), 4);
+            out->d = f;
+            break;
+        }
+        case AvroSchema::DOUBLE:
+            memcpy(&out->d, Raw(8).data(), 8);
+            break;
+        case AvroSchema::BYTES:
+        case AvroSchema::STRING:
+            out->s = Raw(Long());
+            break;
+        case AvroSchema::FIXED:
+            out->s = Raw(s->size);
+            break;
+        case AvroSchema::RECORD:
+            out->items.resize(s->children.size());
+            for (size_t i = 0; i < s->children.size(); i++)
+                Value(s->children[i], &out->items[i], depth + 1);
+            break;
+        case AvroSchema::ARRAY:
+        case AvroSchema::MAP:
+            for (;;) {
+                int64_t count = Long();
+                if (count == 0)
+                    break;
+                if (count < 0) {
+                    count = -count;
+                    Long(); // byte size of the block
+                }
+                if (count > end_ - p_ &&
+                    s->children[0]->type != AvroSchema::NUL)
+                    Fail();
+                for (int64_t i = 0; i < count; i++) {
+                    if (s->type == AvroSchema::MAP)
+                        out->keys.emplace_back(Raw(Long()));
+                    out->items.emplace_back();
+                    Value(s->children[0], &out->items.back(), depth + 1);
+                }
+            }
+            break;
+        case AvroSchema::UNION: {
+            int64_t branch = Long();
+            if (branch < 0 || branch >= (int64_t)s->children.size())
+                Fail();
+            Value(s->children[branch], out, depth + 1);
+            break;
+        }
+        }
+    }
+
+private:
+    [[noreturn]] void Fail() {
+        throw std::runtime_error("corrupt Avro data");
+    }
+
+    const uint8_t *p_;
+    const uint8_t *end_;
+};
+
+static void check(const arrow::Status &st, const std::string &what) {
+    if (!st.ok())
+        throw std::runtime_error(what + ": " + st.ToString());
+}
+
+/* Decompresses a whole stream of unknown decompressed size. */
+static std::string decompress(arrow::util::Codec *codec, std::string_view in,
+                              const std::string &what) {
+    auto decompressor = codec->MakeDecompressor();
+    check(decompressor.status(), what);
+    std::string out(std::max<size_t>(in.size() * 4, 4096), '\0');
+    size_t written = 0;
+    auto p = reinterpret_cast<const uint8_t *>(in.data());
+    int64_t left = in.size();
+    for (;;) {
+        auto r = (*decompressor)->Decompress(
+            left, p, out.size() - written,
+            reinterpret_cast<uint8_t *>(&out[written]));
+        check(r.status(), what);
+        p += r->bytes_read;
+        left -= r->bytes_read;
+        written += r->bytes_written;
+        if ((*decompressor)->IsFinished())
+            break;
+        if (r->need_more_output || written == out.size()) {
+            out.resize(out.size() * 2);
+            continue;
+        }
+        if (left == 0)
+            break;
+        if (r->bytes_read == 0 && r->bytes_written == 0)
+            throw std::runtime_error(what + ": truncated compressed data");
+    }
+    out.resize(written);
+    return out;
+}
+
+static std::string read_all(const IcebergOpenFn &open, const std::string &path) {
+    std::shared_ptr<arrow::io::RandomAccessFile> file = open(path);
+    auto size = file->GetSize();
+    check(size.status(), path);
+    auto buffer = file->ReadAt(0, *size);
+    check(buffer.status(), path);
+    return (*buffer)->ToString();
+}
+
+/* Calls fn for each record of the Avro object container file `data`. */
+template <typename Fn>
+static void avro_for_each(const std::string &data, const std::string &path,
+                          Fn &&fn) {
+    static const char kMagic[4] = {'O', 'b', 'j', 1};
+    if (data.size() < 4 || memcmp(data.data(), kMagic, 4) != 0)
+        throw std::runtime_error(path + ": not an Avro file");
+    AvroDecoder header(reinterpret_cast<const uint8_t *>(data.data()) + 4,
+                       data.size() - 4);
+
+    std::string schema_json, codec_name = "null";
+    for (;;) {
+        int64_t count = header.Long();
+        if (count == 0)
+            break;
+        if (count < 0) {
+            count = -count;
+            header.Long();
+        }
+        for (int64_t i = 0; i < count; i++) {
+            std::string key(header.Raw(header.Long()));
+            std::string value(header.Raw(header.Long()));
+            if (key == "avro.schema")
+                schema_json = std::move(value);
+            else if (key == "avro.codec")
+                codec_name = std::move(value);
+        }
+    }
+    std::string sync(header.Raw(16));
+
+    AvroSchemaSet schemas;
+    const AvroSchema *schema = schemas.Parse(JsonParser(schema_json).Parse(), "");
+
+    std::unique_ptr<arrow::util::Codec> codec;
+    if (codec_name == "deflate") {
+        arrow::util::GZipCodecOptions options;
+        options.gzip_format = arrow::util::GZipFormat::DEFLATE;
+        auto c = arrow::util::Codec::Create(arrow::Compression::GZIP, options);
+        check(c.status(), path);
+        codec = std::move(*c);
+    } else if (codec_name == "snappy" || codec_name == "zstandard") {
+        auto c = arrow::util::Codec::Create(codec_name == "snappy"
+                                                ? arrow::Compression::SNAPPY
+                                                : arrow::Compression::ZSTD);
+        check(c.status(), path);
+        codec = std::move(*c);
+    } else if (codec_name != "null") {
+        throw std::runtime_error(path + ": unsupported Avro codec " + codec_name);
+    }
+
+    AvroValue record;
+    while (!header.done()) {
+        int64_t count = header.Long();
+        std::string_view block = header.Raw(header.Long());
+        if (header.Raw(16) != sync)
+            throw std::runtime_error(path + ": corrupt Avro block");
+
+        std::string inflated;
+        if (codec_name == "snappy") {
+            /* Snappy blocks end with a CRC of the data; the length leads. */
+            if (block.size() < 4)
+                throw std::runtime_error(path + ": corrupt Avro block");
+            block.remove_suffix(4);
+            AvroDecoder varint(reinterpret_cast<const uint8_t *>(block.data()),
+                               block.size());
+            uint64_t len = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                uint8_t b = varint.Raw(1)[0];
+                len |= (uint64_t)(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    break;
+            }
+            inflated.resize(len);
+            auto n = codec->Decompress(
+                block.size(), reinterpret_cast<const uint8_t *>(block.data()),
+                len, reinterpret_cast<uint8_t *>(inflated.data()));
+            check(n.status(), path);
+            block = inflated;
+        } else if (codec) {
+            inflated = decompress(codec.get(), block, path);
+            block = inflated;
+        }
+
+        AvroDecoder records(reinterpret_cast<const uint8_t *>(block.data()),
+                            block.size());
+        for (int64_t i = 0; i < count; i++) {
+            record = AvroValue();
+            records.Value(schema, &record);
+            fn(record);
+        }
+    }
+}
+
+/* Partition transforms, with values in the Unix-epoch key domain. */
+
+static inline int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/* Year and month (1-12) of a day count from 1970-01-01. */
+static void civil_from_days(int64_t z, int64_t *year, int *month) {
+    z += 719468;
+    int64_t era = floor_div(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+static bool temporal_transform(const std::string &transform,
+                               const std::string &source_type, int64_t v,
+                               int64_t *out) {
+    int64_t days;
+    if (source_type == "date" && transform != "hour") {
+        days = v;
+    } else if (source_type == "timestamp" || source_type == "timestamptz") {
+        if (transform == "hour") {
+            *out = floor_div(v, 3600LL * 1000000);
+            return true;
+        }
+        days = floor_div(v, 86400LL * 1000000);
+    } else {
+        return false;
+    }
+    if (transform == "day") {
+        *out = days;
+        return true;
+    }
+    int64_t year;
+    int month;
+    civil_from_days(days, &year, &month);
+    *out = transform == "year" ? year - 1970 : (year - 1970) * 12 + month - 1;
+    return true;
+}
+
+/* The N of "bucket[N]" or "truncate[N]", or 0. */
+static int64_t transform_width(const std::string &transform, const char *name) {
+    size_t n = strlen(name);
+    if (transform.compare(0, n, name) != 0 || transform.size() < n + 3 ||
+        transform[n] != '[' || transform.back() != ']')
+        return 0;
+    return strtoll(transform.c_str() + n + 1, nullptr, 10);
+}
+
+static uint32_t murmur3_32(const uint8_t *data, size_t len) {
+    const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+    auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+    uint32_t h = 0, k;
+    size_t blocks = len / 4;
+    for (size_t i = 0; i < blocks; i++) {
+        memcpy(&k, data + i * 4, 4);
+        h ^= rotl(k * c1, 15) * c2;
+        h = rotl(h, 13) * 5 + 0xe6546b64;
+    }
+    const uint8_t *tail = data + blocks * 4;
+    k = 0;
+    switch (len & 3) {
+    case 3:
+        k ^= tail[2] << 16;
+        [[fallthrough]];
+    case 2:
+        k ^= tail[1] << 8;
+        [[fallthrough]];
+    case 1:
+        k ^= tail[0];
+        h ^= rotl(k * c1, 15) * c2;
+    }
+    h ^= (uint32_t)len;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* The type partition values of a field with this transform have. */
+static std::string partition_type(const std::string &source_type,
+                                  const std::string &transform) {
+    if (transform == "identity" || transform_width(transform, "truncate") > 0)
+        return source_type;
+    return "int";
+}
+
+/*
+ * A predicate on a partition field's values that every row satisfying `p`
+ * passes, if there is one. Transforms other than bucket are monotonic, so
+ * ranges become inclusive ranges; bucket only helps equality.
+ */
+static bool project_predicate(const IcebergPredicate &p,
+                              const std::string &source_type,
+                              const std::string &transform,
+                              IcebergPredicate *out) {
+    *out = p;
+    if (transform == "identity")
+        return true;
+    if (p.op == IcebergOp::NE)
+        return false;
+
+    auto project_range = [&](auto &&fn) {
+        int64_t lo, hi = 0;
+        if (!fn(p.lo, &lo) || (p.op == IcebergOp::BETWEEN && !fn(p.hi, &hi)))
+            return false;
+        out->kind = IcebergKeyKind::INT;
+        out->lo = IcebergKey();
+        out->lo.i = lo;
+        out->hi = IcebergKey();
+        out->hi.i = hi;
+        if (p.op == IcebergOp::LT)
+            out->op = IcebergOp::LE;
+        else if (p.op == IcebergOp::GT)
+            out->op = IcebergOp::GE;
+        return true;
+    };
+
+    if (transform == "year" || transform == "month" || transform == "day" ||
+        transform == "hour") {
+        if (p.kind != IcebergKeyKind::INT)
+            return false;
+        return project_range([&](const IcebergKey &k, int64_t *v) {
+            return temporal_transform(transform, source_type, k.i, v);
+        });
+    }
+
+    if (int64_t n = transform_width(transform, "bucket")) {
+        if (p.op != IcebergOp::EQ)
+            return false;
+        uint32_t hash;
+        if (p.kind == IcebergKeyKind::INT &&
+            (source_type == "int" || source_type == "long" ||
+             source_type == "date" || source_type == "time" ||
+             source_type == "timestamp" || source_type == "timestamptz")) {
+            int64_t v = p.lo.i; // little-endian, as the spec hashes it
+            hash = murmur3_32(reinterpret_cast<const uint8_t *>(&v), 8);
+        } else if (p.kind == IcebergKeyKind::BYTES && source_type == "string") {
+            hash = murmur3_32(reinterpret_cast<const uint8_t *>(p.lo.s.data()),
+                              p.lo.s.size());
+        } else {
+            return false;
+        }
+        out->kind = IcebergKeyKind::INT;
+        out->lo = IcebergKey();
+        out->lo.i = (int64_t)(hash & 0x7fffffff) % n;
+        return true;
+    }
+
+    if (int64_t w = transform_width(transform, "truncate")) {
+        if (p.kind == IcebergKeyKind::INT &&
+            (source_type == "int" || source_type == "long"))
+            return project_range([&](const IcebergKey &k, int64_t *v) {
+                *v = k.i - (((k.i % w) + w) % w);
+                return true;
+            });
+        if (p.kind == IcebergKeyKind::BYTES && source_type == "string" &&
+            p.op == IcebergOp::EQ) {
+            /* The first w code points. */
+            size_t end = 0;
+            for (int64_t chars = 0; end < p.lo.s.size(); end++)
+                if ((p.lo.s[end] & 0xC0) != 0x80 && chars++ == w)
+                    break;
+            out->lo.s = p.lo.s.substr(0, end);
+            return true;
+        }
+    }
+    return false;
+}
+
+IcebergKeyKind iceberg_key_kind(const std::string &type) {
+    if (type == "boolean" || type == "int" || type == "long" ||
+        type == "date" || type == "time" || type == "timestamp" ||
+        type == "timestamptz")
+        return IcebergKeyKind::INT;
+    if (type == "float" || type == "double")
+        return IcebergKeyKind::FLOAT;
+    if (type == "string" || type == "binary" || type == "uuid" ||
+        type.rfind("fixed[", 0) == 0)
+        return IcebergKeyKind::BYTES;
+    return IcebergKeyKind::NONE;
+}
+
+/*
+ * Decodes a bound in Iceberg's single-value serialization. Widths are taken
+ * from the data, since a promoted int or float column keeps its old bounds.
+ */
+static bool decode_bound(const std::string &type, const std::string &raw,
+                         IcebergKey *key) {
+    switch (iceberg_key_kind(type)) {
+    case IcebergKeyKind::INT:
+        if (raw.size() == 1) {
+            key->i = (uint8_t)raw[0];
+        } else if (raw.size() == 4) {
+            int32_t v;
+            memcpy(&v, raw.data(), 4);
+            key->i = v;
+        } else if (raw.size() == 8) {
+            memcpy(&key->i, raw.data(), 8);
+        } else {
+            return false;
+        }
+        return true;
+    case IcebergKeyKind::FLOAT:
+        if (raw.size() == 4) {
+            float v;
+            memcpy(&v, raw.data(), 4);
+            key->f = v;
+        } else if (raw.size() == 8) {
+            memcpy(&key->f, raw.data(), 8);
+        } else {
+            return false;
+        }
+        return true;
+    case IcebergKeyKind::BYTES:
+        key->s = raw;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool avro_key(const AvroValue &v, IcebergKeyKind kind, IcebergKey *key) {
+    switch (v.schema->type) {
+    case AvroSchema::BOOLEAN:
+    case AvroSchema::INT:
+    case AvroSchema::LONG:
+        key->i = v.i;
+        return kind == IcebergKeyKind::INT;
+    case AvroSchema::FLOAT:
+    case AvroSchema::DOUBLE:
+        key->f = v.d;
+        return kind == IcebergKeyKind::FLOAT;
+    case AvroSchema::BYTES:
+    case AvroSchema::STRING:
+    case AvroSchema::FIXED:
+        key->s = v.s;
+        return kind == IcebergKeyKind::BYTES;
+    default:
+        return false;
+    }
+}
+
+/* Whether any value in [min, max] can satisfy `op` against v1 (and v2). */
+template <typename T>
+static bool range_may_match(IcebergOp op, const T &min, const T &max,
+                            const T &v1, const T &v2) {
+    switch (op) {
+    case IcebergOp::EQ:
+        return !(v1 < min) && !(max < v1);
+    case IcebergOp::NE:
+        return !(min == v1 && max == v1);
+    case IcebergOp::LT:
+        return min < v1;
+    case IcebergOp::LE:
+        return !(v1 < min);
+    case IcebergOp::GT:
+        return v1 < max;
+    case IcebergOp::GE:
+        return !(max < v1);
+    case IcebergOp::BETWEEN:
+        return !(max < v1) && !(v2 < min);
+    }
+    return true;
+}
+
+static bool key_may_match(const IcebergPredicate &p, const IcebergKey &min,
+                          const IcebergKey &max) {
+    switch (p.kind) {
+    case IcebergKeyKind::INT:
+        return range_may_match(p.op, min.i, max.i, p.lo.i, p.hi.i);
+    case IcebergKeyKind::FLOAT:
+        /* Bounds leave NaN out; Postgres sorts it above all other values. */
+        if (p.op == IcebergOp::NE || p.op == IcebergOp::GT ||
+            p.op == IcebergOp::GE || std::isnan(p.lo.f) || std::isnan(p.hi.f) ||
+            std::isnan(min.f) || std::isnan(max.f))
+            return true;
+        return range_may_match(p.op, min.f, max.f, p.lo.f, p.hi.f);
+    case IcebergKeyKind::BYTES:
+        /* Byte order only agrees with the collation on equality. */
+        if (p.op != IcebergOp::EQ)
+            return true;
+        return range_may_match(p.op, std::string_view(min.s),
+                               std::string_view(max.s),
+                               std::string_view(p.lo.s), std::string_view());
+    default:
+        return true;
+    }
+}
+
+/* The value for key `id` of an Iceberg int-keyed map, or NULL. */
+static const AvroValue *int_map_get(const AvroValue *map, int id) {
+    if (!map)
+        return nullptr;
+    for (size_t i = 0; i < map->items.size(); i++) {
+        const AvroValue &item = map->items[i];
+        if (map->schema->type == AvroSchema::MAP) {
+            if (map->keys[i] == std::to_string(id))
+                return item.is_null() ? nullptr : &item;
+            continue;
+        }
+        const AvroValue *key = item.field("key");
+        if (key && key->i == id)
+            return item.field("value");
+    }
+    return nullptr;
+}
+
+/*
+ * The value of field j of `spec` in a data file's partition record, null
+ * included; NULL if the record has no such field. Found by field id where
+ * both record it, else by position, as the record follows the spec's field
+ * order. Not by name: writers rename fields whose names Avro does not allow.
+ */
+static const AvroValue *
+partition_value(const AvroValue *partition,
+                const std::vector<IcebergTable::PartitionField> &spec,
+                size_t j) {
+    if (!partition || partition->is_null() ||
+        partition->schema->type != AvroSchema::RECORD)
+        return nullptr;
+    const AvroSchema &record = *partition->schema;
+    if (spec[j].field_id >= 0)
+        for (size_t i = 0; i < record.field_ids.size(); i++)
+            if (record.field_ids[i] == spec[j].field_id)
+                return &partition->items[i];
+    if (record.names.size() != spec.size())
+        return nullptr;
+    return &partition->items[j];
+}
+
+/* A manifest as listed by the manifest list. */
+struct ManifestRef {
+    std::string path;
+    int spec_id = 0;
+    int content = 0; // 0 data, 1 deletes
+    struct Summary {
+        bool has_bounds;
+        bool maybe_nan;
+        std::string lower, upper;
+    };
+    std::vector<Summary> partitions; // per spec field; empty if unknown
+};
+
+std::unique_ptr<IcebergTable> IcebergTable::Load(const std::string &metadata_location,
+                                                 const IcebergOpenFn &open) {
+    std::string text = read_all(open, metadata_location);
+    static const std::string kGzipSuffix = ".gz.metadata.json";
+    if (metadata_location.size() > kGzipSuffix.size() &&
+        metadata_location.compare(metadata_location.size() - kGzipSuffix.size(),
+                                  kGzipSuffix.size(), kGzipSuffix) == 0) {
+        auto codec = arrow::util::Codec::Create(arrow::Compression::GZIP);
+        check(codec.status(), metadata_location);
+        text = decompress(codec->get(), text, metadata_location);
+    }
+    Json root = JsonParser(text).Parse();
+    std::unique_ptr<IcebergTable> table(new IcebergTable());
+
+    const Json *schema = root.get("schema");
+    if (const Json *schemas = root.get("schemas")) {
+        int64_t current = json_int(json_member(root, "current-schema-id"));
+        for (const Json &s : schemas->items)
+            if (json_int(json_member(s, "schema-id")) == current)
+                schema = &s;
+    }
+    if (!schema)
+        throw std::runtime_error(metadata_location + ": no current schema");
+    for (const Json &f : json_member(*schema, "fields").items) {
+        const Json &type = json_member(f, "type");
+        table->schema_.push_back(
+            {(int)json_int(json_member(f, "id")), json_member(f, "name").str,
+             type.kind == Json::STRING ? type.str : json_member(type, "type").str});
+    }
+
+    auto read_spec = [](const Json &fields) {
+        std::vector<PartitionField> spec;
+        for (const Json &f : fields.items) {
+            const Json *id = f.get("field-id");
+            spec.push_back({(int)json_int(json_member(f, "source-id")),
+                            id ? (int)json_int(*id) : -1,
+                            json_member(f, "name").str,
+                            json_member(f, "transform").str});
+        }
+        return spec;
+    };
+    if (const Json *specs = root.get("partition-specs")) {
+        for (const Json &s : specs->items)
+            table->specs_.emplace_back(json_int(json_member(s, "spec-id")),
+                                       read_spec(json_member(s, "fields")));
+        table->default_spec_ = json_int(json_member(root, "default-spec-id"));
+    } else if (const Json *spec = root.get("partition-spec")) {
+        table->specs_.emplace_back(0, read_spec(*spec));
+    }
+
+    if (const Json *snapshots = root.get("snapshots")) {
+        for (const Json &s : snapshots->items) {
+            Snapshot snap;
+            snap.id = json_int(json_member(s, "snapshot-id"));
+            if (const Json *list = s.get("manifest-list"))
+                snap.manifest_list = list->str;
+            else
+                for (const Json &m : json_member(s, "manifests").items)
+                    snap.manifests.push_back(m.str);
+            const Json *summary = s.get("summary");
+            const Json *total = summary ? summary->get("total-records") : nullptr;
+            if (total)
+                snap.total_records = strtoll(total->str.c_str(), nullptr, 10);
+            table->snapshots_.push_back(std::move(snap));
+        }
+    }
+    if (const Json *current = root.get("current-snapshot-id"))
+        table->current_snapshot_ = json_int(*current);
+    return table;
+}
+
+std::string IcebergTable::CurrentMetadata(const std::string &table_location,
+                                          const IcebergOpenFn &open) {
+    std::string hint =
+        read_all(open, table_location + "/metadata/version-hint.text");
+    char *end;
+    long long version = strtoll(hint.c_str(), &end, 10);
+    while (*end == ' ' || *end == '\n' || *end == '\r' || *end == '\t')
+        end++;
+    if (end == hint.c_str() || *end != '\0')
+        throw std::runtime_error(table_location +
+                                 "/metadata/version-hint.text: invalid version");
+    return table_location + "/metadata/v" + std::to_string(version) +
+           ".metadata.json";
+}
+
+const IcebergTable::Snapshot *IcebergTable::FindSnapshot(int64_t snapshot_id) const {
+    int64_t id = snapshot_id ? snapshot_id : current_snapshot_;
+    for (const Snapshot &s : snapshots_)
+        if (s.id == id)
+            return &s;
+    if (snapshot_id)
+        throw std::runtime_error("snapshot " + std::to_string(snapshot_id) +
+                                 " does not exist");
+    return nullptr; // a table without snapshots is empty
+}
+
+std::string IcebergTable::FieldType(int field_id) const {
+    for (const IcebergField &f : schema_)
+        if (f.id == field_id)
+            return f.type;
+    return "";
+}
+
+int64_t IcebergTable::TotalRecords(int64_t snapshot_id) const {
+    const Snapshot *snap = FindSnapshot(snapshot_id);
+    return snap ? snap->total_records : 0;
+}
+
+IcebergScanPlan IcebergTable::PlanScan(int64_t snapshot_id,
+                                       const std::vector<IcebergPredicate> &preds,
+                                       const std::vector<int> &columns,
+                                       const IcebergOpenFn &open) const {
+    IcebergScanPlan plan;
+    const Snapshot *snap = FindSnapshot(snapshot_id);
+    if (!snap)
+        return plan;
+
+    std::vector<ManifestRef> manifests;
+    if (snap->manifest_list.empty()) {
+        for (const std::string &path : snap->manifests) {
+            manifests.emplace_back();
+            manifests.back().path = path;
+            manifests.back().spec_id = default_spec_;
+        }
+    } else {
+        avro_for_each(read_all(open, snap->manifest_list), snap->manifest_list,
+                      [&](const AvroValue &m) {
+            const AvroValue *path = m.field("manifest_path");
+            if (!path)
+                throw std::runtime_error(snap->manifest_list +
+                                         ": manifest without a path");
+            /* Manifests holding only deleted entries add nothing. */
+            const AvroValue *added = m.field("added_files_count");
+            const AvroValue *existing = m.field("existing_files_count");
+            if (!added)
+                added = m.field("added_data_files_count");
+            if (!existing)
+                existing = m.field("existing_data_files_count");
+            if (added && existing && added->i == 0 && existing->i == 0)
+                return;
+
+            ManifestRef ref;
+            ref.path = path->s;
+            if (const AvroValue *spec = m.field("partition_spec_id"))
+                ref.spec_id = spec->i;
+            if (const AvroValue *content = m.field("content"))
+                ref.content = content->i;
+            if (const AvroValue *parts = m.field("partitions")) {
+                for (const AvroValue &s : parts->items) {
+                    const AvroValue *lower = s.field("lower_bound");
+                    const AvroValue *upper = s.field("upper_bound");
+                    const AvroValue *nan = s.field("contains_nan");
+                    ref.partitions.push_back(
+                        {lower && upper, !nan || nan->i != 0,
+                         lower ? lower->s : "", upper ? upper->s : ""});
+                }
+            }
+            manifests.push_back(std::move(ref));
+        });
+    }
+
+    for (const ManifestRef &m : manifests) {
+        const std::vector<PartitionField> *spec = nullptr;
+        for (const auto &s : specs_)
+            if (s.first == m.spec_id)
+                spec = &s.second;
+        if (m.content == 0)
+            plan.manifests++;
+
+        /*
+         * Each predicate on a partition source column is projected through the
+         * field's transform and tested against the summary's bounds. No bounds
+         * means every value is null, or NaN when the summary says so.
+         */
+        bool may_match = true;
+        if (spec && m.partitions.size() == spec->size()) {
+            for (const IcebergPredicate &p : preds) {
+                for (size_t j = 0; may_match && j < spec->size(); j++) {
+                    const PartitionField &f = (*spec)[j];
+                    const ManifestRef::Summary &s = m.partitions[j];
+                    IcebergPredicate pp;
+                    std::string source_type = FieldType(p.field_id);
+                    if (f.source_id != p.field_id ||
+                        !project_predicate(p, source_type, f.transform, &pp))
+                        continue;
+                    if (!s.has_bounds) {
+                        may_match = pp.kind == IcebergKeyKind::FLOAT && s.maybe_nan;
+                        continue;
+                    }
+                    std::string type = partition_type(source_type, f.transform);
+                    IcebergKey lo, hi;
+                    if (decode_bound(type, s.lower, &lo) &&
+                        decode_bound(type, s.upper, &hi))
+                        may_match = key_may_match(pp, lo, hi);
+                }
+            }
+        }
+        if (!may_match) {
+            if (m.content == 0)
+                plan.manifests_pruned++;
+            continue;
+        }
+
+        avro_for_each(read_all(open, m.path), m.path, [&](const AvroValue &entry) {
+            const AvroValue *status = entry.field("status");
+            const AvroValue *file = entry.field("data_file");
+            if (!status || !file)
+                throw std::runtime_error(m.path + ": not a manifest");
+            if (status->i == 2) // deleted
+                return;
+
+            const AvroValue *partition = file->field("partition");
+            std::vector<IcebergColumnStats> stats(preds.size());
+            for (size_t i = 0; i < preds.size(); i++) {
+                const IcebergPredicate &p = preds[i];
+                std::string source_type = FieldType(p.field_id);
+                for (size_t j = 0; spec && j < spec->size(); j++) {
+                    const PartitionField &f = (*spec)[j];
+                    IcebergPredicate pp;
+                    if (f.source_id != p.field_id ||
+                        !project_predicate(p, source_type, f.transform, &pp))
+                        continue;
+                    const AvroValue *value =
+                        partition_value(partition, *spec, j);
+                    if (!value)
+                        continue;
+                    IcebergKey key;
+                    if (value->is_null() ||
+                        (avro_key(*value, pp.kind, &key) &&
+                         !key_may_match(pp, key, key))) {
+                        plan.files_pruned += m.content == 0;
+                        return;
+                    }
+                }
+                /* Delete files' bounds describe deleted rows, not ours. */
+                if (m.content != 0)
+                    continue;
+
+                const AvroValue *values =
+                    int_map_get(file->field("value_counts"), p.field_id);
+                const AvroValue *nulls =
+                    int_map_get(file->field("null_value_counts"), p.field_id);
+                const AvroValue *lower =
+                    int_map_get(file->field("lower_bounds"), p.field_id);
+                const AvroValue *upper =
+                    int_map_get(file->field("upper_bounds"), p.field_id);
+                IcebergColumnStats &st = stats[i];
+                st.has_bounds = lower && upper &&
+                                decode_bound(source_type, lower->s, &st.lower) &&
+                                decode_bound(source_type, upper->s, &st.upper);
+                st.null_count = nulls ? nulls->i : -1;
+                if ((values && nulls && values->i == nulls->i) ||
+                    (st.has_bounds && !key_may_match(p, st.lower, st.upper))) {
+                    plan.files_pruned++;
+                    return;
+                }
+            }
+
+            if (m.content != 0)
+                throw std::runtime_error(
+                    "tables with delete files are not supported");
+            const AvroValue *path = file->field("file_path");
+            const AvroValue *format = file->field("file_format");
+            if (!path)
+                throw std::runtime_error(m.path + ": data file without a path");
+            if (format && strcasecmp(format->s.c_str(), "PARQUET") != 0)
+                throw std::runtime_error(path->s + ": " + format->s +
+                                         " data files are not supported");
+            const AvroValue *rows = file->field("record_count");
+            const AvroValue *size = file->field("file_size_in_bytes");
+            IcebergDataFile data{path->s, rows ? rows->i : -1,
+                                 size ? size->i : -1, 0, std::move(stats)};
+            const AvroValue *sizes = file->field("column_sizes");
+            for (int id : columns) {
+                const AvroValue *column = int_map_get(sizes, id);
+                if (!column) {
+                    data.scan_size = data.file_size;
+                    break;
+                }
+                data.scan_size += column->i;
+            }
+            plan.files.push_back(std::move(data));
+        });
+    }
+    return plan;
+}
@@ -0,0 +1,142 @@
+#ifndef ICEBERGC_MANIFEST_H
+#define ICEBERGC_MANIFEST_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arrow/io/interfaces.h>
+
+/*
+ * Reading Iceberg table metadata and planning scans: metadata.json, the
+ * snapshot's Avro manifest list and its manifests. Knows nothing of Postgres;
+ * errors are thrown as std::runtime_error.
+ */
+
+/* Opens a metadata file, manifest list or manifest for reading. */
+typedef std::function<std::shared_ptr<arrow::io::RandomAccessFile>(
+    const std::string &path)>
+    IcebergOpenFn;
+
+/*
+ * A top-level field of the table schema. type is the Iceberg type name, e.g.
+ * "long" or "decimal(9,2)"; nested types are "struct", "list" or "map".
+ */
+struct IcebergField {
+    int id;
+    std::string name;
+    std::string type;
+};
+
+/*
+ * Predicates and bounds are compared in one of three domains: integers
+ * (booleans, ints, longs, dates in days and timestamps in microseconds, both
+ * from the Unix epoch), doubles, or raw bytes.
+ */
+enum class IcebergKeyKind { NONE, INT, FLOAT, BYTES };
+
+struct IcebergKey {
+    int64_t i = 0;
+    double f = 0;
+    std::string s;
+};
+
+enum class IcebergOp { EQ, NE, LT, LE, GT, GE, BETWEEN };
+
+/* "field op lo", or "field BETWEEN lo AND hi"; a NULL field never matches. */
+struct IcebergPredicate {
+    int field_id;
+    IcebergKeyKind kind;
+    IcebergOp op;
+    IcebergKey lo, hi;
+};
+
+/* A data file's statistics for a predicate's column, as PlanScan found them. */
+struct IcebergColumnStats {
+    bool has_bounds = false;
+    IcebergKey lower, upper;  // may be truncated for strings
+    int64_t null_count = -1;  // -1 if unknown
+};
+
+struct IcebergDataFile {
+    std::string path;
+    int64_t record_count;
+    int64_t file_size;
+    int64_t scan_size;                     // bytes of the requested columns
+    std::vector<IcebergColumnStats> stats; // one per predicate
+};
+
+struct IcebergScanPlan {
+    std::vector<IcebergDataFile> files; // data files that may hold matching rows
+    int64_t manifests = 0;              // data manifests of the snapshot
+    int64_t manifests_pruned = 0;       // skipped using partition summaries
+    int64_t files_pruned = 0;           // skipped using partitions or bounds
+};
+
+/* The domain values of an Iceberg primitive type compare in. */
+IcebergKeyKind iceberg_key_kind(const std::string &type);
+
+class IcebergTable {
+public:
+    /* Reads a table metadata file, format version 1 or 2. */
+    static std::unique_ptr<IcebergTable> Load(const std::string &metadata_location,
+                                              const IcebergOpenFn &open);
+
+    /*
+     * The current metadata file of a table directory laid out by the Hadoop
+     * catalog, as named by metadata/version-hint.text.
+     */
+    static std::string CurrentMetadata(const std::string &table_location,
+                                       const IcebergOpenFn &open);
+
+    /* The current schema. */
+    const std::vector<IcebergField> &schema() const { return schema_; }
+
+    /*
+     * The snapshot's "total-records" summary, or -1 if it has none. A zero
+     * snapshot_id means the current snapshot.
+     */
+    int64_t TotalRecords(int64_t snapshot_id) const;
+
+    /*
+     * Lists the live data files of a snapshot (zero for the current one) that
+     * may hold rows satisfying every predicate. Manifests are skipped using
+     * the partition summaries of the manifest list, files using their
+     * partition values and column bounds. Each file's scan_size sums the
+     * sizes recorded for the columns with the given field ids (the whole file
+     * when they are missing). Throws if the snapshot does not exist or has
+     * delete files that may apply.
+     */
+    IcebergScanPlan PlanScan(int64_t snapshot_id,
+                             const std::vector<IcebergPredicate> &preds,
+                             const std::vector<int> &columns,
+                             const IcebergOpenFn &open) const;
+
+    struct PartitionField {
+        int source_id;
+        int field_id; // -1 if the spec has none
+        std::string name;
+        std::string transform;
+    };
+    struct Snapshot {
+        int64_t id;
+        std::string manifest_list;          // empty for format v1 "manifests"
+        std::vector<std::string> manifests;
+        int64_t total_records = -1;
+    };
+
+private:
+    IcebergTable() = default;
+    const Snapshot *FindSnapshot(int64_t snapshot_id) const;
+    std::string FieldType(int field_id) const;
+
+    std::vector<IcebergField> schema_;
+    std::vector<std::pair<int, std::vector<PartitionField>>> specs_;
+    int default_spec_ = 0;
+    std::vector<Snapshot> snapshots_;
+    int64_t current_snapshot_ = -1;
+};
+
+#endif // ICEBERGC_MANIFEST_H
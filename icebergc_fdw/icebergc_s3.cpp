@@ -0,0 +1,580 @@
+#include <aws/auth/credentials.h>
+#include <aws/common/thread.h>
+#include <aws/common/uri.h>
+#include <aws/http/request_response.h>
+#include <aws/io/channel_bootstrap.h>
+#include <aws/io/event_loop.h>
+#include <aws/io/host_resolver.h>
+#include <aws/s3/s3.h>
+#include <aws/s3/s3_client.h>
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/result.h>
+#include <arrow/status.h>
+#include <arrow/util/future.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+extern "C" {
+#include "postgres.h"
+#include "storage/ipc.h"
+}
+
+#include "icebergc_s3.h"
+
+/* Parquet reads this much from the end of the file to find the footer. */
+static const int64_t kTailReadSize = 64 * 1024;
+
+static void aws_init_once() {
+    static std::once_flag once;
+    std::call_once(once, [] { aws_s3_library_init(aws_default_allocator()); });
+}
+
+static std::runtime_error aws_failure(const char *what) {
+    return std::runtime_error(std::string(what) + ": " +
+                              aws_error_str(aws_last_error()));
+}
+
+/*
+ * Event loops, DNS resolver and bootstrap. One per backend, shared by every
+ * client; the threads and connections live until the backend exits.
+ */
+class S3Runtime {
+public:
+    S3Runtime();
+    ~S3Runtime() { release(); }
+    S3Runtime(const S3Runtime &) = delete;
+    S3Runtime &operator=(const S3Runtime &) = delete;
+
+    aws_client_bootstrap *bootstrap() const { return bootstrap_; }
+
+private:
+    void release();
+
+    aws_event_loop_group *event_loops_ = NULL;
+    aws_host_resolver *resolver_ = NULL;
+    aws_client_bootstrap *bootstrap_ = NULL;
+};
+
+S3Runtime::S3Runtime() {
+    aws_init_once();
+    aws_allocator *alloc = aws_default_allocator();
+
+    try {
+        event_loops_ = aws_event_loop_group_new_default(alloc, 0, NULL);
+        if (!event_loops_)
+            throw aws_failure("could not start aws event loops");
+
+        aws_host_resolver_default_options resolver_opts;
+        AWS_ZERO_STRUCT(resolver_opts);
+        resolver_opts.el_group = event_loops_;
+        resolver_opts.max_entries = 8;
+        resolver_ = aws_host_resolver_new_default(alloc, &resolver_opts);
+        if (!resolver_)
+            throw aws_failure("could not create host resolver");
+
+        aws_client_bootstrap_options bootstrap_opts;
+        AWS_ZERO_STRUCT(bootstrap_opts);
+        bootstrap_opts.event_loop_group = event_loops_;
+        bootstrap_opts.host_resolver = resolver_;
+        bootstrap_ = aws_client_bootstrap_new(alloc, &bootstrap_opts);
+        if (!bootstrap_)
+            throw aws_failure("could not create client bootstrap");
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+void S3Runtime::release() {
+    if (bootstrap_)
+        aws_client_bootstrap_release(bootstrap_);
+    if (resolver_)
+        aws_host_resolver_release(resolver_);
+    if (event_loops_)
+        aws_event_loop_group_release(event_loops_);
+    bootstrap_ = NULL;
+    resolver_ = NULL;
+    event_loops_ = NULL;
+}
+
+/*
+ * Credentials and the aws-c-s3 client (with its connection pool) for one set
+ * of options. Clients are kept in a registry for the life of the backend;
+ * requests in flight also hold a reference.
+ */
+class S3Client {
+public:
+    S3Client(std::shared_ptr<S3Runtime> runtime, const IcebergcS3Options &opts);
+    ~S3Client() { release(); }
+    S3Client(const S3Client &) = delete;
+    S3Client &operator=(const S3Client &) = delete;
+
+    aws_s3_client *client() const { return client_; }
+    /* Where to connect when an endpoint was given, else NULL for AWS. */
+    const aws_uri *endpoint() const { return has_endpoint_ ? &endpoint_ : NULL; }
+    std::string host(const std::string &bucket) const;
+    std::string path(const std::string &bucket, const std::string &key) const;
+
+private:
+    void release();
+
+    std::shared_ptr<S3Runtime> runtime_;
+    std::string region_;
+    std::string endpoint_str_;
+    aws_uri endpoint_;
+    bool has_endpoint_ = false;
+    aws_credentials_provider *credentials_ = NULL;
+    aws_signing_config_aws signing_;
+    aws_s3_client *client_ = NULL;
+};
+
+S3Client::S3Client(std::shared_ptr<S3Runtime> runtime,
+                   const IcebergcS3Options &opts)
+    : runtime_(std::move(runtime)) {
+    aws_allocator *alloc = aws_default_allocator();
+    region_ = opts.region ? opts.region : "us-east-1";
+
+    try {
+        bool tls = true;
+        if (opts.endpoint) {
+            endpoint_str_ = opts.endpoint;
+            aws_byte_cursor cur = aws_byte_cursor_from_c_str(endpoint_str_.c_str());
+            if (aws_uri_init_parse(&endpoint_, alloc, &cur) != AWS_OP_SUCCESS)
+                throw aws_failure("invalid s3_endpoint");
+            has_endpoint_ = true;
+            const aws_byte_cursor *scheme = aws_uri_scheme(&endpoint_);
+            tls = !aws_byte_cursor_eq_c_str_ignore_case(scheme, "http");
+        }
+
+        if (opts.access_key_id && opts.secret_access_key) {
+            aws_credentials_provider_static_options static_opts;
+            AWS_ZERO_STRUCT(static_opts);
+            static_opts.access_key_id =
+                aws_byte_cursor_from_c_str(opts.access_key_id);
+            static_opts.secret_access_key =
+                aws_byte_cursor_from_c_str(opts.secret_access_key);
+            credentials_ = aws_credentials_provider_new_static(alloc, &static_opts);
+        } else {
+            aws_credentials_provider_chain_default_options chain_opts;
+            AWS_ZERO_STRUCT(chain_opts);
+            chain_opts.bootstrap = runtime_->bootstrap();
+            credentials_ =
+                aws_credentials_provider_new_chain_default(alloc, &chain_opts);
+        }
+        if (!credentials_)
+            throw aws_failure("could not create credentials provider");
+
+        aws_byte_cursor region = aws_byte_cursor_from_c_str(region_.c_str());
+        aws_s3_init_default_signing_config(&signing_, region, credentials_);
+
+        aws_s3_client_config cfg;
+        AWS_ZERO_STRUCT(cfg);
+        cfg.region = region;
+        cfg.client_bootstrap = runtime_->bootstrap();
+        cfg.signing_config = &signing_;
+        cfg.tls_mode = tls ? AWS_MR_TLS_ENABLED : AWS_MR_TLS_DISABLED;
+        cfg.max_active_connections_override = opts.max_connections;
+        cfg.part_size = opts.part_size;
+        cfg.throughput_target_gbps = opts.throughput_target_gbps;
+        client_ = aws_s3_client_new(alloc, &cfg);
+        if (!client_)
+            throw aws_failure("could not create s3 client");
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+void S3Client::release() {
+    if (client_)
+        aws_s3_client_release(client_);
+    if (credentials_)
+        aws_credentials_provider_release(credentials_);
+    if (has_endpoint_)
+        aws_uri_clean_up(&endpoint_);
+    client_ = NULL;
+    credentials_ = NULL;
+    has_endpoint_ = false;
+}
+
+/* Virtual-hosted style on AWS, path style against an explicit endpoint. */
+std::string S3Client::host(const std::string &bucket) const {
+    if (has_endpoint_) {
+        const aws_byte_cursor *authority = aws_uri_authority(&endpoint_);
+        return std::string(reinterpret_cast<const char *>(authority->ptr),
+                           authority->len);
+    }
+    return bucket + ".s3." + region_ + ".amazonaws.com";
+}
+
+std::string S3Client::path(const std::string &bucket,
+                           const std::string &key) const {
+    std::string raw = has_endpoint_ ? "/" + bucket + "/" + key : "/" + key;
+    aws_byte_cursor cur = aws_byte_cursor_from_array(raw.data(), raw.size());
+    aws_byte_buf buf;
+    aws_byte_buf_init(&buf, aws_default_allocator(), raw.size() * 3);
+    aws_byte_buf_append_encoding_uri_path(&buf, &cur);
+    std::string encoded(reinterpret_cast<const char *>(buf.buffer), buf.len);
+    aws_byte_buf_clean_up(&buf);
+    return encoded;
+}
+
+struct S3Response {
+    std::shared_ptr<arrow::Buffer> body;
+    int64_t object_size; // from Content-Range, -1 if not given
+    std::string etag;
+};
+
+/*
+ * One GET in flight. Callbacks run on CRT event loop threads; the state is
+ * freed once the meta request has shut down.
+ */
+struct S3Request {
+    std::shared_ptr<S3Client> client;
+    std::shared_ptr<arrow::ResizableBuffer> body;
+    int64_t received = 0;
+    int64_t object_size = -1;
+    std::string etag;
+    arrow::Future<S3Response> done = arrow::Future<S3Response>::Make();
+};
+
+static std::string header_value(const aws_http_headers *headers,
+                                const char *name) {
+    aws_byte_cursor value;
+    if (aws_http_headers_get(headers, aws_byte_cursor_from_c_str(name), &value) !=
+        AWS_OP_SUCCESS)
+        return std::string();
+    return std::string(reinterpret_cast<const char *>(value.ptr), value.len);
+}
+
+static int on_headers(aws_s3_meta_request *, const aws_http_headers *headers,
+                      int, void *user_data) {
+    S3Request *req = static_cast<S3Request *>(user_data);
+    std::string etag = header_value(headers, "ETag");
+    if (!etag.empty())
+        req->etag = etag;
+    /* "bytes first-last/size" */
+    std::string range = header_value(headers, "Content-Range");
+    size_t slash = range.rfind('/');
+    if (slash != std::string::npos && range[slash + 1] != '*')
+        req->object_size = std::strtoll(range.c_str() + slash + 1, NULL, 10);
+    return AWS_OP_SUCCESS;
+}
+
+static int on_body(aws_s3_meta_request *, const aws_byte_cursor *body,
+                   uint64_t, void *user_data) {
+    S3Request *req = static_cast<S3Request *>(user_data);
+    /* Parts arrive in order, so the range offset isn't needed. */
+    if (req->received + static_cast<int64_t>(body->len) > req->body->size())
+        return aws_raise_error(AWS_ERROR_SHORT_BUFFER);
+    memcpy(req->body->mutable_data() + req->received, body->ptr, body->len);
+    req->received += body->len;
+    return AWS_OP_SUCCESS;
+}
+
+static void on_finish(aws_s3_meta_request *meta_request,
+                      const aws_s3_meta_request_result *result,
+                      void *user_data) {
+    S3Request *req = static_cast<S3Request *>(user_data);
+    if (result->error_code != AWS_ERROR_SUCCESS) {
+        req->done.MarkFinished(arrow::Status::IOError(
+            "s3 GET failed with HTTP status ", result->response_status, ": ",
+            aws_error_str(result->error_code)));
+    } else {
+        arrow::Status st = req->body->Resize(req->received, false);
+        if (st.ok())
+            req->done.MarkFinished(
+                S3Response{req->body, req->object_size, req->etag});
+        else
+            req->done.MarkFinished(st);
+    }
+    aws_s3_meta_request_release(meta_request);
+}
+
+static void on_shutdown(void *user_data) {
+    delete static_cast<S3Request *>(user_data);
+}
+
+/*
+ * Starts a GET of `range` (a Range header value) returning at most `capacity`
+ * bytes. A non-empty `if_match` makes the request fail if the object has been
+ * replaced since that ETag was seen.
+ */
+static arrow::Future<S3Response>
+s3_get(const std::shared_ptr<S3Client> &client, const std::string &bucket,
+       const std::string &key, const std::string &range, int64_t capacity,
+       const std::string &if_match, aws_s3_meta_request_type type) {
+    aws_allocator *alloc = aws_default_allocator();
+
+    auto body = arrow::AllocateResizableBuffer(capacity);
+    if (!body.ok())
+        return arrow::Future<S3Response>::MakeFinished(body.status());
+
+    S3Request *req = new S3Request();
+    req->client = client;
+    req->body = std::move(*body);
+    arrow::Future<S3Response> done = req->done;
+
+    std::string host = client->host(bucket);
+    std::string path = client->path(bucket, key);
+    aws_http_message *message = aws_http_message_new_request(alloc);
+    aws_http_message_set_request_method(message, aws_http_method_get);
+    aws_http_message_set_request_path(message,
+                                      aws_byte_cursor_from_c_str(path.c_str()));
+    aws_http_header headers[] = {
+        {aws_byte_cursor_from_c_str("Host"),
+         aws_byte_cursor_from_c_str(host.c_str())},
+        {aws_byte_cursor_from_c_str("Range"),
+         aws_byte_cursor_from_c_str(range.c_str())},
+        {aws_byte_cursor_from_c_str("If-Match"),
+         aws_byte_cursor_from_c_str(if_match.c_str())},
+    };
+    aws_http_message_add_header_array(message, headers, if_match.empty() ? 2 : 3);
+
+    aws_s3_meta_request_options opts;
+    AWS_ZERO_STRUCT(opts);
+    opts.type = type;
+    opts.operation_name = aws_byte_cursor_from_c_str("GetObject");
+    opts.message = message;
+    opts.endpoint = client->endpoint();
+    opts.user_data = req;
+    opts.headers_callback = on_headers;
+    opts.body_callback = on_body;
+    opts.finish_callback = on_finish;
+    opts.shutdown_callback = on_shutdown;
+
+    aws_s3_meta_request *meta_request =
+        aws_s3_client_make_meta_request(client->client(), &opts);
+    aws_http_message_release(message);
+    if (!meta_request) {
+        delete req;
+        return arrow::Future<S3Response>::MakeFinished(arrow::Status::IOError(
+            "could not start s3 GET: ", aws_error_str(aws_last_error())));
+    }
+    return done;
+}
+
+/*
+ * Random access to one object through ranged GETs. The tail fetched by Open()
+ * answers the footer reads; everything else goes to S3, pinned to the ETag
+ * seen then. Parquet's pre-buffering coalesces the column chunk ranges of a
+ * row group and issues them through ReadAsync() concurrently.
+ */
+class S3File : public arrow::io::RandomAccessFile {
+public:
+    S3File(std::shared_ptr<S3Client> client, std::string bucket, std::string key)
+        : client_(std::move(client)), bucket_(std::move(bucket)),
+          key_(std::move(key)) {}
+
+    /*
+     * Fetches the last tail_size bytes along with the object's size and ETag.
+     * Completes on a CRT thread, which only touches this object.
+     */
+    arrow::Future<> OpenAsync(int64_t tail_size) {
+        std::shared_ptr<S3File> self =
+            std::dynamic_pointer_cast<S3File>(shared_from_this());
+        return s3_get(client_, bucket_, key_,
+                      "bytes=-" + std::to_string(tail_size), tail_size,
+                      std::string(), AWS_S3_META_REQUEST_TYPE_DEFAULT)
+            .Then([self](const S3Response &tail) {
+                self->size_ = tail.object_size >= 0 ? tail.object_size
+                                                    : tail.body->size();
+                self->tail_ = tail.body;
+                self->tail_offset_ = self->size_ - self->tail_->size();
+                self->etag_ = tail.etag;
+            });
+    }
+
+    arrow::Status Open() {
+        /* Keep the future alive: status() refers into its shared state. */
+        arrow::Future<> opened = OpenAsync(kTailReadSize);
+        return opened.status();
+    }
+
+    const std::string &etag() const { return etag_; }
+
+    using arrow::io::RandomAccessFile::ReadAsync;
+    using arrow::io::RandomAccessFile::ReadAt;
+
+    arrow::Status Close() override {
+        closed_ = true;
+        tail_.reset();
+        return arrow::Status::OK();
+    }
+    bool closed() const override { return closed_; }
+
+    arrow::Result<int64_t> GetSize() override { return size_; }
+    arrow::Result<int64_t> Tell() const override { return pos_; }
+    arrow::Status Seek(int64_t position) override {
+        if (position < 0)
+            return arrow::Status::Invalid("negative seek position");
+        pos_ = position;
+        return arrow::Status::OK();
+    }
+
+    arrow::Result<int64_t> Read(int64_t nbytes, void *out) override {
+        ARROW_ASSIGN_OR_RAISE(int64_t n, ReadAt(pos_, nbytes, out));
+        pos_ += n;
+        return n;
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override {
+        ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(pos_, nbytes));
+        pos_ += buf->size();
+        return buf;
+    }
+
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  bool allow_short_read, void *out) override {
+        ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(position, nbytes, allow_short_read));
+        memcpy(out, buf->data(), buf->size());
+        return buf->size();
+    }
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  void *out) override {
+        return ReadAt(position, nbytes, true, out);
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>>
+    ReadAt(int64_t position, int64_t nbytes, bool allow_short_read) override {
+        return Fetch(position, nbytes, allow_short_read).result();
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position,
+                                                         int64_t nbytes) override {
+        return ReadAt(position, nbytes, true);
+    }
+
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &, int64_t position, int64_t nbytes,
+              bool allow_short_read) override {
+        return Fetch(position, nbytes, allow_short_read);
+    }
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &ctx, int64_t position,
+              int64_t nbytes) override {
+        return ReadAsync(ctx, position, nbytes, true);
+    }
+
+private:
+    typedef arrow::Future<std::shared_ptr<arrow::Buffer>> BufferFuture;
+
+    BufferFuture Fetch(int64_t position, int64_t nbytes, bool allow_short_read) {
+        if (closed_)
+            return BufferFuture::MakeFinished(
+                arrow::Status::Invalid("s3 file is closed"));
+        if (position < 0 || nbytes < 0)
+            return BufferFuture::MakeFinished(
+                arrow::Status::Invalid("invalid read range"));
+        int64_t n = std::min(nbytes, std::max<int64_t>(size_ - position, 0));
+        if (n < nbytes && !allow_short_read)
+            return BufferFuture::MakeFinished(arrow::Status::IOError(
+                "read past the end of s3://", bucket_, "/", key_));
+        if (n == 0)
+            return BufferFuture::MakeFinished(std::make_shared<arrow::Buffer>(
+                static_cast<const uint8_t *>(NULL), 0));
+        if (position >= tail_offset_)
+            return BufferFuture::MakeFinished(
+                arrow::SliceBuffer(tail_, position - tail_offset_, n));
+
+        std::string range = "bytes=" + std::to_string(position) + "-" +
+                            std::to_string(position + n - 1);
+        return s3_get(client_, bucket_, key_, range, n, etag_,
+                      AWS_S3_META_REQUEST_TYPE_GET_OBJECT)
+            .Then([n](const S3Response &r)
+                      -> arrow::Result<std::shared_ptr<arrow::Buffer>> {
+                if (r.body->size() != n)
+                    return arrow::Status::IOError("short s3 read");
+                return r.body;
+            });
+    }
+
+    std::shared_ptr<S3Client> client_;
+    std::string bucket_;
+    std::string key_;
+    std::string etag_;
+    std::shared_ptr<arrow::Buffer> tail_; // last bytes of the object
+    int64_t tail_offset_ = 0;
+    int64_t size_ = 0;
+    int64_t pos_ = 0;
+    bool closed_ = false;
+};
+
+/*
+ * Clients by option set. Only the backend thread touches the registry; both
+ * it and the runtime are released by s3_at_exit. Heap-allocated so no static
+ * destructor runs after the CRT has been cleaned up.
+ */
+static std::map<std::string, std::shared_ptr<S3Client>> *s3_clients;
+static std::shared_ptr<S3Runtime> *s3_runtime;
+
+/* How long backend exit waits for CRT threads to finish. */
+static const uint64_t kShutdownTimeoutNs = 2000000000ULL;
+
+static void s3_at_exit(int, Datum) {
+    if (!s3_runtime)
+        return;
+    delete s3_clients;
+    delete s3_runtime;
+    s3_clients = NULL;
+    s3_runtime = NULL;
+    /* Requests still in flight keep their client; don't wait on them long. */
+    aws_thread_set_managed_join_timeout_ns(kShutdownTimeoutNs);
+    aws_s3_library_clean_up();
+}
+
+static std::string client_key(const IcebergcS3Options &opts) {
+    std::string key;
+    for (const char *part : {opts.endpoint, opts.region, opts.access_key_id,
+                             opts.secret_access_key}) {
+        key += part ? part : "";
+        key += '\0';
+    }
+    key += std::to_string(opts.max_connections) + '/' +
+           std::to_string(opts.part_size) + '/' +
+           std::to_string(opts.throughput_target_gbps);
+    return key;
+}
+
+static std::shared_ptr<S3Client> s3_client_for(const IcebergcS3Options &opts) {
+    if (!s3_runtime) {
+        s3_runtime = new std::shared_ptr<S3Runtime>(std::make_shared<S3Runtime>());
+        s3_clients = new std::map<std::string, std::shared_ptr<S3Client>>();
+        on_proc_exit(s3_at_exit, 0);
+    }
+    std::shared_ptr<S3Client> &client = (*s3_clients)[client_key(opts)];
+    if (!client)
+        client = std::make_shared<S3Client>(*s3_runtime, opts);
+    return client;
+}
+
+std::shared_ptr<arrow::io::RandomAccessFile>
+s3_open_file(const IcebergcS3Options &opts, const std::string &bucket,
+             const std::string &key, std::string *etag) {
+    auto file = std::make_shared<S3File>(s3_client_for(opts), bucket, key);
+    arrow::Status st = file->Open();
+    if (!st.ok())
+        throw std::runtime_error("s3://" + bucket + "/" + key + ": " +
+                                 st.ToString());
+    if (etag)
+        *etag = file->etag();
+    return file;
+}
+
+arrow::Future<S3OpenedFile>
+s3_open_file_async(const IcebergcS3Options &opts, const std::string &bucket,
+                   const std::string &key, int64_t tail_size) {
+    auto file = std::make_shared<S3File>(s3_client_for(opts), bucket, key);
+    std::string where = "s3://" + bucket + "/" + key + ": ";
+    return file->OpenAsync(std::max(tail_size, kTailReadSize))
+        .Then(
+            [file]() -> arrow::Result<S3OpenedFile> {
+                return S3OpenedFile{file, file->etag()};
+            },
+            [where](const arrow::Status &st) -> arrow::Result<S3OpenedFile> {
+                return arrow::Status::IOError(where, st.message());
+            });
+}
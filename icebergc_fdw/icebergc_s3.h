@@ -0,0 +1,56 @@
+#ifndef ICEBERGC_S3_H
+#define ICEBERGC_S3_H
+
+#include <stdint.h>
+
+/*
+ * How to reach S3 or an S3-compatible store such as MinIO. NULL fields take
+ * the defaults: AWS endpoints for the region, us-east-1, and the default
+ * credentials chain (environment, profile, instance metadata). Zero tuning
+ * fields leave the choice to aws-c-s3.
+ */
+typedef struct IcebergcS3Options {
+    const char *endpoint;          /* e.g. http://localhost:9000; path-style */
+    const char *region;
+    const char *access_key_id;
+    const char *secret_access_key;
+    int max_connections;           /* connection pool size */
+    int64_t part_size;             /* bytes per GET when splitting a range */
+    double throughput_target_gbps; /* sizes the pool when max_connections is 0 */
+} IcebergcS3Options;
+
+#ifdef __cplusplus
+#include <memory>
+#include <string>
+
+#include <arrow/io/interfaces.h>
+#include <arrow/util/future.h>
+
+/*
+ * Opens s3://bucket/key for random access. The last 64 KiB, which normally
+ * hold the Parquet footer, are fetched up front along with the object size;
+ * other reads become ranged GETs. The S3 client behind it is created once per
+ * distinct set of options and reused until the backend exits. The object's
+ * ETag is stored in *etag if given. Throws std::runtime_error on failure.
+ */
+std::shared_ptr<arrow::io::RandomAccessFile>
+s3_open_file(const IcebergcS3Options &opts, const std::string &bucket,
+             const std::string &key, std::string *etag = nullptr);
+
+struct S3OpenedFile {
+    std::shared_ptr<arrow::io::RandomAccessFile> file;
+    std::string etag;
+};
+
+/*
+ * Like s3_open_file, but returns as soon as the request is sent; only the
+ * choice of client happens on the calling thread. At least tail_size bytes
+ * are fetched from the end, so asking for the object's size reads all of it
+ * in that one request. Failures come back through the future.
+ */
+arrow::Future<S3OpenedFile>
+s3_open_file_async(const IcebergcS3Options &opts, const std::string &bucket,
+                   const std::string &key, int64_t tail_size);
+#endif
+
+#endif // ICEBERGC_S3_H
@@ -0,0 +1,132 @@
+#include "postgres.h"
+
+#include <math.h>
+
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+
+#include "icebergc_stats.h"
+
+const char *const icebergc_stat_names[ICEBERGC_NUM_STATS] = {
+    "scans",
+    "files_opened",
+    "files_pruned",
+    "row_groups",
+    "row_groups_pruned",
+    "row_groups_summarized",
+    "rows_filtered",
+    "local_bytes_read",
+    "s3_bytes_read",
+    "hdfs_bytes_read",
+    "remote_bytes_fetched",
+    "hms_calls",
+    "hms_cache_hits",
+    "hms_errors",
+};
+
+const char *const icebergc_latency_names[ICEBERGC_NUM_LATENCIES] = {
+    "file_open_ms",
+    "hms_call_ms",
+};
+
+typedef struct IcebergcSharedStats {
+  pg_atomic_uint64 counters[ICEBERGC_NUM_STATS];
+  pg_atomic_uint64 latencies[ICEBERGC_NUM_LATENCIES][ICEBERGC_LATENCY_BUCKETS];
+} IcebergcSharedStats;
+
+/* NULL unless the library was preloaded. */
+static IcebergcSharedStats *shared_stats;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook;
+
+#if PG_VERSION_NUM >= 150000
+static void stats_shmem_request(void) {
+  if (prev_shmem_request_hook)
+    prev_shmem_request_hook();
+  RequestAddinShmemSpace(sizeof(IcebergcSharedStats));
+}
+#endif
+
+static void stats_shmem_startup(void) {
+  bool found;
+
+  if (prev_shmem_startup_hook)
+    prev_shmem_startup_hook();
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  shared_stats = ShmemInitStruct("icebergc_fdw stats",
+                                 sizeof(IcebergcSharedStats), &found);
+  if (!found) {
+    for (int i = 0; i < ICEBERGC_NUM_STATS; i++)
+      pg_atomic_init_u64(&shared_stats->counters[i], 0);
+    for (int i = 0; i < ICEBERGC_NUM_LATENCIES; i++)
+      for (int b = 0; b < ICEBERGC_LATENCY_BUCKETS; b++)
+        pg_atomic_init_u64(&shared_stats->latencies[i][b], 0);
+  }
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void icebergc_stats_init(void) {
+  if (!process_shared_preload_libraries_in_progress)
+    return;
+#if PG_VERSION_NUM >= 150000
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = stats_shmem_request;
+#else
+  RequestAddinShmemSpace(sizeof(IcebergcSharedStats));
+#endif
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = stats_shmem_startup;
+}
+
+void icebergc_stats_add(IcebergcStat stat, int64_t n) {
+  if (shared_stats && n > 0)
+    pg_atomic_fetch_add_u64(&shared_stats->counters[stat], (uint64)n);
+}
+
+void icebergc_stats_observe(IcebergcLatency latency, double ms) {
+  int bucket = 0;
+
+  if (!shared_stats)
+    return;
+  while (bucket < ICEBERGC_LATENCY_BUCKETS - 1 &&
+         ms >= icebergc_latency_bound(bucket))
+    bucket++;
+  pg_atomic_fetch_add_u64(&shared_stats->latencies[latency][bucket], 1);
+}
+
+double icebergc_latency_bound(int bucket) {
+  if (bucket >= ICEBERGC_LATENCY_BUCKETS - 1)
+    return INFINITY;
+  return (double)((int64)1 << bucket);
+}
+
+bool icebergc_stats_read(IcebergcStatsSnapshot *snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  if (!shared_stats)
+    return false;
+  for (int i = 0; i < ICEBERGC_NUM_STATS; i++)
+    snapshot->counters[i] =
+        (int64_t)pg_atomic_read_u64(&shared_stats->counters[i]);
+  for (int i = 0; i < ICEBERGC_NUM_LATENCIES; i++)
+    for (int b = 0; b < ICEBERGC_LATENCY_BUCKETS; b++)
+      snapshot->latencies[i][b] =
+          (int64_t)pg_atomic_read_u64(&shared_stats->latencies[i][b]);
+  return true;
+}
+
+void icebergc_stats_reset(void) {
+  if (!shared_stats)
+    return;
+  for (int i = 0; i < ICEBERGC_NUM_STATS; i++)
+    pg_atomic_write_u64(&shared_stats->counters[i], 0);
+  for (int i = 0; i < ICEBERGC_NUM_LATENCIES; i++)
+    for (int b = 0; b < ICEBERGC_LATENCY_BUCKETS; b++)
+      pg_atomic_write_u64(&shared_stats->latencies[i][b], 0);
+}
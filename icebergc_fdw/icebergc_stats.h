@@ -0,0 +1,80 @@
+#ifndef ICEBERGC_STATS_H
+#define ICEBERGC_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Counters of all backends, kept in shared memory when icebergc_fdw is in
+ * shared_preload_libraries. Without it nothing is counted.
+ */
+typedef enum IcebergcStat {
+    ICEBERGC_STAT_SCANS,                /* foreign scans executed */
+    ICEBERGC_STAT_FILES_OPENED,         /* Parquet files opened by scans */
+    ICEBERGC_STAT_FILES_PRUNED,         /* Iceberg data files skipped */
+    ICEBERGC_STAT_ROW_GROUPS,           /* in the files opened */
+    ICEBERGC_STAT_ROW_GROUPS_PRUNED,    /* skipped using column statistics */
+    ICEBERGC_STAT_ROW_GROUPS_SUMMARIZED, /* answered from them by aggregates */
+    ICEBERGC_STAT_ROWS_FILTERED,        /* decoded rows dropped by the reader */
+    ICEBERGC_STAT_LOCAL_BYTES,          /* read from local files */
+    ICEBERGC_STAT_S3_BYTES,             /* read from S3 files, cache included */
+    ICEBERGC_STAT_HDFS_BYTES,           /* read from HDFS files, cache included */
+    ICEBERGC_STAT_REMOTE_BYTES,         /* of those, fetched over the network */
+    ICEBERGC_STAT_HMS_CALLS,            /* Hive Metastore requests */
+    ICEBERGC_STAT_HMS_CACHE_HITS,       /* lookups answered by the cache */
+    ICEBERGC_STAT_HMS_ERRORS,           /* requests that failed */
+    ICEBERGC_NUM_STATS
+} IcebergcStat;
+
+/*
+ * Latencies are counted in buckets whose upper bounds double from 1ms;
+ * the last one has none.
+ */
+typedef enum IcebergcLatency {
+    ICEBERGC_LATENCY_FILE_OPEN, /* opening a file and reading its footer */
+    ICEBERGC_LATENCY_HMS_CALL,  /* a Hive Metastore request */
+    ICEBERGC_NUM_LATENCIES
+} IcebergcLatency;
+
+#define ICEBERGC_LATENCY_BUCKETS 16
+
+typedef struct IcebergcStatsSnapshot {
+    int64_t counters[ICEBERGC_NUM_STATS];
+    int64_t latencies[ICEBERGC_NUM_LATENCIES][ICEBERGC_LATENCY_BUCKETS];
+} IcebergcStatsSnapshot;
+
+/* Names of the counters and latencies, as icebergc_fdw_stats() shows them. */
+extern const char *const icebergc_stat_names[ICEBERGC_NUM_STATS];
+extern const char *const icebergc_latency_names[ICEBERGC_NUM_LATENCIES];
+
+/*
+ * Sets up the shared counters if the library is being preloaded. Called from
+ * _PG_init.
+ */
+void icebergc_stats_init(void);
+
+/* Lock-free and safe from any thread; no-ops without shared memory. */
+void icebergc_stats_add(IcebergcStat stat, int64_t n);
+void icebergc_stats_observe(IcebergcLatency latency, double ms);
+
+/* Upper bound of a latency bucket in ms, infinite for the last one. */
+double icebergc_latency_bound(int bucket);
+
+/*
+ * Reads every counter. Returns false, with *snapshot zeroed, if the counters
+ * are not in shared memory.
+ */
+bool icebergc_stats_read(IcebergcStatsSnapshot *snapshot);
+
+/* Zeroes every counter. */
+void icebergc_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ICEBERGC_STATS_H */
@@ -0,0 +1,423 @@
+/*
+ * Benchmarks of the Parquet read path, run without a server against a file
+ * it generates: opening a file's footer, decoding column chunks, converting
+ * decoded values to Datums and evaluating pushed-down filters each have
+ * their own cases. Conversion and filtering are not timed apart from the
+ * decoding they need: compare convert/<type> and filter/<type> against
+ * decode/<type>. Row groups are decoded on the benchmark's thread.
+ *
+ *   parquet_bench [--rows=N] [--columns=N] [--row-group-rows=N]
+ *                 [--encoding=dictionary|plain] [--compression=NAME]
+ *                 [--benchmark_format=json] [other Google Benchmark options]
+ *
+ * Columns cycle through the types foreign tables may declare; decimal
+ * columns are read as float8, as numeric needs the backend.
+ */
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/util/compression.h>
+#include <benchmark/benchmark.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/exception.h>
+#include <parquet/properties.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+extern "C" {
+#include "postgres.h"
+#include "catalog/pg_type.h"
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+/* parquet_bench_shim.c: frees what the read path palloc'd. */
+void parquet_bench_reset_memory(void);
+}
+
+#include "parquet_utils.h"
+
+struct BenchOptions {
+    int64_t rows = 1000000;
+    int columns = 12;
+    int64_t row_group_rows = 128 * 1024;
+    bool dictionary = true;
+    arrow::Compression::type compression = arrow::Compression::SNAPPY;
+};
+
+/* A column type of the generated file and the attribute type it is read as. */
+struct ColumnKind {
+    const char *name;
+    Oid typid;
+    std::shared_ptr<arrow::DataType> type;
+};
+
+static const ColumnKind kKinds[] = {
+    {"bool", BOOLOID, arrow::boolean()},
+    {"int2", INT2OID, arrow::int16()},
+    {"int4", INT4OID, arrow::int32()},
+    {"int8", INT8OID, arrow::int64()},
+    {"float4", FLOAT4OID, arrow::float32()},
+    {"float8", FLOAT8OID, arrow::float64()},
+    {"numeric", FLOAT8OID, arrow::decimal128(18, 2)},
+    {"text", TEXTOID, arrow::utf8()},
+    {"varchar", VARCHAROID, arrow::utf8()},
+    {"timestamp", TIMESTAMPOID, arrow::timestamp(arrow::TimeUnit::MICRO)},
+    {"timestamptz", TIMESTAMPTZOID,
+     arrow::timestamp(arrow::TimeUnit::MICRO, "UTC")},
+    {"date", DATEOID, arrow::date32()},
+};
+
+static const int kNumKinds = sizeof(kKinds) / sizeof(kKinds[0]);
+
+/* int4 values are uniform below this; text values are "value-N", N < 1000. */
+static const int32_t kInt4Range = 1000000;
+static const int kTextValues = 1000;
+
+/* 2020-01-01 in days and microseconds since the Unix epoch. */
+static const int32_t kBaseDays = 18262;
+static const int64_t kBaseUsecs = kBaseDays * 86400LL * 1000000;
+
+/* The generated file, and the tuple descriptor scans read it with. */
+static std::string bench_path;
+static int64_t bench_rows;
+static std::vector<uint8_t> bench_data;
+static TupleDesc bench_tupdesc;
+
+static const ColumnKind &column_kind(int column) {
+    return kKinds[column % kNumKinds];
+}
+
+/* One percent of the values are NULL. */
+template <typename Builder, typename Gen>
+static std::shared_ptr<arrow::Array>
+generate(const std::shared_ptr<arrow::DataType> &type, int64_t rows,
+         std::mt19937_64 &rng, Gen gen) {
+    Builder builder(type, arrow::default_memory_pool());
+    PARQUET_THROW_NOT_OK(builder.Reserve(rows));
+    for (int64_t i = 0; i < rows; ++i) {
+        if (rng() % 100 == 0)
+            PARQUET_THROW_NOT_OK(builder.AppendNull());
+        else
+            PARQUET_THROW_NOT_OK(builder.Append(gen()));
+    }
+    std::shared_ptr<arrow::Array> array;
+    PARQUET_THROW_NOT_OK(builder.Finish(&array));
+    return array;
+}
+
+static std::shared_ptr<arrow::Array> generate_column(const ColumnKind &kind,
+                                                     int64_t rows,
+                                                     std::mt19937_64 &rng) {
+    const std::shared_ptr<arrow::DataType> &type = kind.type;
+    std::uniform_real_distribution<double> real(-1e6, 1e6);
+    switch (type->id()) {
+    case arrow::Type::BOOL:
+        return generate<arrow::BooleanBuilder>(type, rows, rng,
+                                               [&] { return rng() % 2 == 0; });
+    case arrow::Type::INT16:
+        return generate<arrow::Int16Builder>(type, rows, rng, [&] {
+            return static_cast<int16_t>(rng() % 20000 - 10000);
+        });
+    case arrow::Type::INT32:
+        return generate<arrow::Int32Builder>(type, rows, rng, [&] {
+            return static_cast<int32_t>(rng() % kInt4Range);
+        });
+    case arrow::Type::INT64:
+        return generate<arrow::Int64Builder>(
+            type, rows, rng, [&] { return static_cast<int64_t>(rng()); });
+    case arrow::Type::FLOAT:
+        return generate<arrow::FloatBuilder>(
+            type, rows, rng, [&] { return static_cast<float>(real(rng)); });
+    case arrow::Type::DOUBLE:
+        return generate<arrow::DoubleBuilder>(type, rows, rng,
+                                              [&] { return real(rng); });
+    case arrow::Type::DECIMAL128:
+        return generate<arrow::Decimal128Builder>(type, rows, rng, [&] {
+            return arrow::Decimal128(static_cast<int64_t>(rng() % 100000000));
+        });
+    case arrow::Type::STRING:
+        return generate<arrow::StringBuilder>(type, rows, rng, [&] {
+            return "value-" + std::to_string(rng() % kTextValues);
+        });
+    case arrow::Type::TIMESTAMP:
+        return generate<arrow::TimestampBuilder>(type, rows, rng, [&] {
+            return kBaseUsecs + static_cast<int64_t>(rng() % (366LL * 86400 * 1000000));
+        });
+    case arrow::Type::DATE32:
+        return generate<arrow::Date32Builder>(type, rows, rng, [&] {
+            return static_cast<int32_t>(kBaseDays + rng() % 3650);
+        });
+    default:
+        throw std::runtime_error("no generator for " + type->ToString());
+    }
+}
+
+static std::string column_name(int column) {
+    return "c" + std::to_string(column) + "_" + column_kind(column).name;
+}
+
+static void write_file(const BenchOptions &opts, const std::string &path) {
+    std::mt19937_64 rng(42);
+    arrow::FieldVector fields;
+    arrow::ArrayVector arrays;
+    for (int i = 0; i < opts.columns; ++i) {
+        fields.push_back(arrow::field(column_name(i), column_kind(i).type));
+        arrays.push_back(generate_column(column_kind(i), opts.rows, rng));
+    }
+    std::shared_ptr<arrow::Table> table =
+        arrow::Table::Make(arrow::schema(fields), arrays, opts.rows);
+
+    parquet::WriterProperties::Builder props;
+    props.compression(opts.compression);
+    props.max_row_group_length(opts.row_group_rows);
+    if (opts.dictionary)
+        props.enable_dictionary();
+    else
+        props.disable_dictionary();
+
+    std::shared_ptr<arrow::io::FileOutputStream> out;
+    PARQUET_ASSIGN_OR_THROW(out, arrow::io::FileOutputStream::Open(path));
+    PARQUET_THROW_NOT_OK(parquet::arrow::WriteTable(
+        *table, arrow::default_memory_pool(), out, opts.row_group_rows,
+        props.build()));
+    PARQUET_THROW_NOT_OK(out->Close());
+}
+
+/* What a foreign table over the generated file would declare. */
+static TupleDesc make_tupdesc(int columns) {
+    TupleDesc desc = static_cast<TupleDesc>(
+        calloc(1, offsetof(TupleDescData, attrs) +
+                      columns * sizeof(FormData_pg_attribute)));
+    desc->natts = columns;
+    desc->tdtypeid = RECORDOID;
+    desc->tdtypmod = -1;
+    for (int i = 0; i < columns; ++i) {
+        Form_pg_attribute attr = TupleDescAttr(desc, i);
+        snprintf(NameStr(attr->attname), NAMEDATALEN, "%s",
+                 column_name(i).c_str());
+        attr->attnum = i + 1;
+        attr->atttypid = column_kind(i).typid;
+        attr->atttypmod = -1;
+    }
+    return desc;
+}
+
+/* Reads the attributes of spec: converting every row, or only decoding. */
+static int64_t scan_file(const ParquetScanSpec &spec, bool convert) {
+    ParquetReader *reader = parquet_reader_open(bench_path.c_str(), &spec);
+    int64_t rows = 0;
+    if (convert) {
+        std::vector<Datum> values(bench_tupdesc->natts);
+        std::unique_ptr<bool[]> nulls(new bool[bench_tupdesc->natts]);
+        while (parquet_reader_next(reader, values.data(), nulls.get()))
+            rows++;
+    } else {
+        rows = parquet_reader_skip(reader, std::numeric_limits<int64>::max());
+    }
+    parquet_reader_close(reader);
+    parquet_bench_reset_memory();
+    return rows;
+}
+
+static void count_rows(benchmark::State &state, int64_t rows) {
+    state.counters["rows"] = benchmark::Counter(
+        static_cast<double>(rows), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+/* One attribute, or all of them for column -1. */
+static std::unique_ptr<bool[]> attrs_for(int column) {
+    std::unique_ptr<bool[]> used(new bool[bench_tupdesc->natts]);
+    for (int i = 0; i < bench_tupdesc->natts; ++i)
+        used[i] = column < 0 || i == column;
+    return used;
+}
+
+static void bench_open(benchmark::State &state, bool cached) {
+    int cache_size = icebergc_metadata_cache_size;
+    if (!cached)
+        icebergc_metadata_cache_size = 0;
+    ParquetScanSpec spec = {};
+    spec.tupdesc = bench_tupdesc;
+    for (auto _ : state) {
+        ParquetReader *reader = parquet_reader_open(bench_path.c_str(), &spec);
+        parquet_reader_close(reader);
+        parquet_bench_reset_memory();
+    }
+    icebergc_metadata_cache_size = cache_size;
+}
+
+static void bench_scan(benchmark::State &state, int column, bool convert) {
+    std::unique_ptr<bool[]> used = attrs_for(column);
+    ParquetScanSpec spec = {};
+    spec.tupdesc = bench_tupdesc;
+    spec.attrs_used = used.get();
+    int64_t rows = 0;
+    for (auto _ : state)
+        rows = scan_file(spec, convert);
+    count_rows(state, rows);
+}
+
+static void bench_filter(benchmark::State &state, ParquetFilter filter) {
+    std::unique_ptr<bool[]> used = attrs_for(filter.attnum);
+    ParquetScanSpec spec = {};
+    spec.tupdesc = bench_tupdesc;
+    spec.attrs_used = used.get();
+    spec.filters = &filter;
+    spec.nfilters = 1;
+    int64_t selected = 0;
+    for (auto _ : state)
+        selected = scan_file(spec, false);
+    count_rows(state, bench_rows);
+    state.counters["selected"] = static_cast<double>(selected);
+}
+
+/* The row-by-row reader behind parse_parquet_buffer, from memory. */
+static void bench_parse_buffer(benchmark::State &state) {
+    int64_t rows = 0;
+    for (auto _ : state) {
+        std::vector<RowTuple> tuples = parse_parquet_buffer(
+            bench_data.data(), bench_data.size(), bench_rows);
+        rows = static_cast<int64_t>(tuples.size());
+        benchmark::DoNotOptimize(tuples.data());
+    }
+    count_rows(state, rows);
+}
+
+static void register_benchmarks(const BenchOptions &opts) {
+    benchmark::RegisterBenchmark("open/uncached", bench_open, false);
+    benchmark::RegisterBenchmark("open/cached", bench_open, true);
+
+    int kinds = std::min(opts.columns, kNumKinds);
+    for (int i = -1; i < kinds; ++i) {
+        std::string name = i < 0 ? "all" : column_kind(i).name;
+        benchmark::RegisterBenchmark(("decode/" + name).c_str(), bench_scan, i,
+                                     false)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("convert/" + name).c_str(), bench_scan, i,
+                                     true)
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    /* About half the rows pass; statistics prune no row group. */
+    int int4_column = 2, text_column = 7;
+    if (int4_column < opts.columns) {
+        ParquetFilter filter = {int4_column, PARQUET_FILTER_LT,
+                                Int32GetDatum(kInt4Range / 2), 0};
+        benchmark::RegisterBenchmark("filter/int4", bench_filter, filter)
+            ->Unit(benchmark::kMillisecond);
+    }
+    /* One value in kTextValues passes. */
+    if (text_column < opts.columns) {
+        const char *value = "value-7";
+        size_t len = strlen(value);
+        text *t = static_cast<text *>(malloc(VARHDRSZ + len));
+        SET_VARSIZE(t, VARHDRSZ + len);
+        memcpy(VARDATA(t), value, len);
+        ParquetFilter filter = {text_column, PARQUET_FILTER_EQ,
+                                PointerGetDatum(t), 0};
+        benchmark::RegisterBenchmark("filter/text", bench_filter, filter)
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::RegisterBenchmark("parse_buffer", bench_parse_buffer)
+        ->Unit(benchmark::kMillisecond);
+}
+
+static bool parse_int(const char *arg, const char *name, int64_t *value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=')
+        return false;
+    char *end;
+    *value = strtoll(arg + len + 1, &end, 10);
+    if (*end != '\0' || *value <= 0)
+        throw std::runtime_error(std::string("invalid value in ") + arg);
+    return true;
+}
+
+static BenchOptions parse_options(int argc, char **argv) {
+    BenchOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        int64_t n;
+        if (parse_int(arg, "--rows", &opts.rows)) {
+        } else if (parse_int(arg, "--columns", &n)) {
+            opts.columns = static_cast<int>(std::min<int64_t>(n, 1000));
+        } else if (parse_int(arg, "--row-group-rows", &opts.row_group_rows)) {
+        } else if (strcmp(arg, "--encoding=dictionary") == 0) {
+            opts.dictionary = true;
+        } else if (strcmp(arg, "--encoding=plain") == 0) {
+            opts.dictionary = false;
+        } else if (strncmp(arg, "--compression=", 14) == 0) {
+            arrow::Result<arrow::Compression::type> type =
+                arrow::util::Codec::GetCompressionType(arg + 14);
+            if (!type.ok() ||
+                !arrow::util::Codec::IsAvailable(type.ValueUnsafe()))
+                throw std::runtime_error(std::string("unsupported ") + arg);
+            opts.compression = type.ValueUnsafe();
+        } else {
+            throw std::runtime_error(std::string("unknown option ") + arg);
+        }
+    }
+    return opts;
+}
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    BenchOptions opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n"
+                  << "usage: " << argv[0]
+                  << " [--rows=N] [--columns=N] [--row-group-rows=N]"
+                     " [--encoding=dictionary|plain] [--compression=NAME]"
+                     " [benchmark options]\n";
+        return 1;
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    bench_path = std::string(tmpdir ? tmpdir : "/tmp") + "/parquet_bench-" +
+                 std::to_string(getpid()) + ".parquet";
+    try {
+        write_file(opts, bench_path);
+    } catch (const std::exception &e) {
+        std::cerr << "could not write " << bench_path << ": " << e.what() << "\n";
+        unlink(bench_path.c_str());
+        return 1;
+    }
+    std::ifstream in(bench_path, std::ios::binary);
+    bench_data.assign(std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>());
+    bench_tupdesc = make_tupdesc(opts.columns);
+    bench_rows = opts.rows;
+
+    benchmark::AddCustomContext("rows", std::to_string(opts.rows));
+    benchmark::AddCustomContext("columns", std::to_string(opts.columns));
+    benchmark::AddCustomContext("row_group_rows",
+                                std::to_string(opts.row_group_rows));
+    benchmark::AddCustomContext("encoding",
+                                opts.dictionary ? "dictionary" : "plain");
+    benchmark::AddCustomContext(
+        "compression", arrow::util::Codec::GetCodecAsString(opts.compression));
+    benchmark::AddCustomContext("file_bytes", std::to_string(bench_data.size()));
+
+    /* Decode on this thread, so the cases time the work and not a handoff. */
+    icebergc_prefetch_row_groups = 0;
+    register_benchmarks(opts);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    unlink(bench_path.c_str());
+    return 0;
+}
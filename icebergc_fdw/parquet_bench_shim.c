@@ -0,0 +1,201 @@
+/*
+ * Stand-ins for the backend functions the Parquet read path calls, so that
+ * parquet_bench runs without a server. Memory comes from an arena the
+ * benchmark resets between iterations; errors end the process. Conversions
+ * that need the catalog or numeric arithmetic are not available: the
+ * benchmark reads decimal columns as float8.
+ */
+#include "postgres.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fmgr.h"
+#include "storage/ipc.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/numeric.h"
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+void parquet_bench_reset_memory(void);
+
+/* palloc: bump allocation from 1MB blocks, or a block of its own. */
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  Size size;
+  Size used;
+  char data[FLEXIBLE_ARRAY_MEMBER];
+} ArenaBlock;
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+static ArenaBlock *arena;
+
+static void *arena_alloc(Size size) {
+  void *p;
+
+  size = MAXALIGN(size);
+  if (!arena || arena->used + size > arena->size) {
+    Size block = Max(size, ARENA_BLOCK_SIZE);
+    ArenaBlock *b = malloc(offsetof(ArenaBlock, data) + block);
+    if (!b) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    b->next = arena;
+    b->size = block;
+    b->used = 0;
+    arena = b;
+  }
+  p = arena->data + arena->used;
+  arena->used += size;
+  return p;
+}
+
+/* Frees everything palloc'd so far. */
+void parquet_bench_reset_memory(void) {
+  while (arena) {
+    ArenaBlock *next = arena->next;
+    free(arena);
+    arena = next;
+  }
+}
+
+void *palloc(Size size) { return arena_alloc(size); }
+
+char *pstrdup(const char *in) { return pnstrdup(in, strlen(in)); }
+
+char *pnstrdup(const char *in, Size len) {
+  char *out;
+
+  len = strnlen(in, len);
+  out = arena_alloc(len + 1);
+  memcpy(out, in, len);
+  out[len] = '\0';
+  return out;
+}
+
+text *cstring_to_text_with_len(const char *s, int len) {
+  text *result = arena_alloc(len + VARHDRSZ);
+  SET_VARSIZE(result, len + VARHDRSZ);
+  memcpy(VARDATA(result), s, len);
+  return result;
+}
+
+/* ereport: messages of level ERROR and up end the process. */
+static int error_level;
+static char error_message[1024];
+
+bool errstart(int elevel, const char *domain) {
+  error_level = elevel;
+  error_message[0] = '\0';
+  return elevel >= ERROR;
+}
+
+bool errstart_cold(int elevel, const char *domain) {
+  return errstart(elevel, domain);
+}
+
+int errcode(int sqlerrcode) { return 0; }
+
+int errmsg(const char *fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  vsnprintf(error_message, sizeof(error_message), fmt, args);
+  va_end(args);
+  return 0;
+}
+
+void errfinish(const char *filename, int lineno, const char *funcname) {
+  fprintf(stderr, "ERROR: %s\n", error_message);
+  exit(1);
+}
+
+static void unsupported(const char *what) {
+  fprintf(stderr, "ERROR: %s is not available in the benchmark\n", what);
+  exit(1);
+}
+
+void fmgr_info(Oid functionId, FmgrInfo *finfo) {
+  unsupported("a type input function");
+}
+
+void getTypeInputInfo(Oid type, Oid *typInput, Oid *typIOParam) {
+  unsupported("a type input function");
+}
+
+Datum InputFunctionCall(FmgrInfo *flinfo, char *str, Oid typioparam,
+                        int32 typmod) {
+  unsupported("a type input function");
+  return (Datum)0;
+}
+
+Datum DirectFunctionCall1Coll(PGFunction func, Oid collation, Datum arg1) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Datum DirectFunctionCall2Coll(PGFunction func, Oid collation, Datum arg1,
+                              Datum arg2) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Datum DirectFunctionCall3Coll(PGFunction func, Oid collation, Datum arg1,
+                              Datum arg2, Datum arg3) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Datum numeric(PG_FUNCTION_ARGS) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Datum numeric_in(PG_FUNCTION_ARGS) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Datum float8_numeric(PG_FUNCTION_ARGS) {
+  unsupported("numeric");
+  return (Datum)0;
+}
+
+Numeric int64_to_numeric(int64 val) {
+  unsupported("numeric");
+  return NULL;
+}
+
+Numeric int64_div_fast_to_numeric(int64 val1, int log10val2) {
+  unsupported("numeric");
+  return NULL;
+}
+
+/* on_proc_exit: callbacks run when the benchmark exits. */
+#define MAX_EXIT_CALLBACKS 8
+
+static pg_on_exit_callback exit_callbacks[MAX_EXIT_CALLBACKS];
+static Datum exit_args[MAX_EXIT_CALLBACKS];
+static int nexit_callbacks;
+
+static void run_exit_callbacks(void) {
+  while (nexit_callbacks > 0) {
+    nexit_callbacks--;
+    exit_callbacks[nexit_callbacks](0, exit_args[nexit_callbacks]);
+  }
+}
+
+void on_proc_exit(pg_on_exit_callback function, Datum arg) {
+  if (nexit_callbacks == 0)
+    atexit(run_exit_callbacks);
+  if (nexit_callbacks < MAX_EXIT_CALLBACKS) {
+    exit_callbacks[nexit_callbacks] = function;
+    exit_args[nexit_callbacks] = arg;
+    nexit_callbacks++;
+  }
+}
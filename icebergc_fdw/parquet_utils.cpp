@@ -1,210 +1,3567 @@
-#include "parquet_utils.h"
-
-#include <aws/common/init.h>
-#include <aws/s3/s3.h>
 #include <hdfs/hdfs.h>
 #include <arrow/api.h>
+#include <arrow/io/file.h>
 #include <arrow/io/memory.h>
 #include <parquet/arrow/reader.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/bloom_filter.h>
+#include <parquet/bloom_filter_reader.h>
+#include <parquet/exception.h>
 #include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/page_index.h>
+#include <parquet/statistics.h>
 
 #include <stdexcept>
 #include <algorithm>
-#include <fstream>
-#include <limits>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/stat.h>
 
 extern "C" {
 #include "postgres.h"
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/lsyscache.h"
+#include "utils/numeric.h"
 #include "utils/palloc.h"
+#include "utils/selfuncs.h"
+#include "utils/timestamp.h"
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
 }
 
+#include "icebergc_cache.h"
+#include "icebergc_manifest.h"
+#include "parquet_utils.h"
+
 std::vector<uint8_t> download_s3_to_buffer(const std::string &bucket,
                                            const std::string &key) {
-    aws_common_library_init(aws_default_allocator());
+    IcebergcS3Options opts = {};
+    std::shared_ptr<arrow::io::RandomAccessFile> file =
+        s3_open_file(opts, bucket, key);
+    int64_t size;
+    std::shared_ptr<arrow::Buffer> buf;
+    PARQUET_ASSIGN_OR_THROW(size, file->GetSize());
+    PARQUET_ASSIGN_OR_THROW(buf, file->ReadAt(0, size));
+    return std::vector<uint8_t>(buf->data(), buf->data() + buf->size());
+}
 
-    struct aws_allocator *alloc = aws_default_allocator();
-    struct aws_s3_client_config cfg;
-    AWS_ZERO_STRUCT(cfg);
-    struct aws_s3_client *client = aws_s3_client_new(alloc, &cfg);
+/*
+ * Random access to one HDFS file. libhdfs3 streams are not thread-safe, so
+ * reads are serialized; each one seeks and reads the whole range.
+ */
+class HdfsFile : public arrow::io::RandomAccessFile {
+public:
+    explicit HdfsFile(const std::string &path) : path_(path) {}
+    ~HdfsFile() override { Release(); }
 
-    struct aws_byte_buf body_buf;
-    aws_byte_buf_init(&body_buf, alloc, 16 * 1024);
+    /* Opens the file; *version identifies this revision of it. */
+    void Open(std::string *version) {
+        fs_ = hdfsConnect("default", 0);
+        if (!fs_)
+            throw std::runtime_error("failed to connect to hdfs");
+        hdfsFileInfo *info = hdfsGetPathInfo(fs_, path_.c_str());
+        if (!info)
+            throw std::runtime_error("failed to stat hdfs file " + path_);
+        size_ = info->mSize;
+        if (version)
+            *version = std::to_string((long long)info->mLastMod) + ":" +
+                       std::to_string((long long)info->mSize);
+        hdfsFreeFileInfo(info, 1);
+        file_ = hdfsOpenFile(fs_, path_.c_str(), O_RDONLY, 0, 0, 0);
+        if (!file_)
+            throw std::runtime_error("failed to open hdfs file " + path_);
+    }
+
+    using arrow::io::RandomAccessFile::ReadAt;
+
+    arrow::Status Close() override {
+        std::lock_guard<std::mutex> guard(mu_);
+        Release();
+        return arrow::Status::OK();
+    }
+    bool closed() const override { return file_ == NULL; }
+
+    arrow::Result<int64_t> GetSize() override { return size_; }
+    arrow::Result<int64_t> Tell() const override { return pos_; }
+    arrow::Status Seek(int64_t position) override {
+        if (position < 0)
+            return arrow::Status::Invalid("negative seek position");
+        pos_ = position;
+        return arrow::Status::OK();
+    }
+
+    arrow::Result<int64_t> Read(int64_t nbytes, void *out) override {
+        ARROW_ASSIGN_OR_RAISE(int64_t n, ReadAt(pos_, nbytes, out));
+        pos_ += n;
+        return n;
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override {
+        ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(pos_, nbytes));
+        pos_ += buf->size();
+        return buf;
+    }
 
-    struct aws_s3_get_object_request_options opt;
-    AWS_ZERO_STRUCT(opt);
-    opt.bucket_name = aws_byte_cursor_from_c_str(bucket.c_str());
-    opt.object_key = aws_byte_cursor_from_c_str(key.c_str());
-    opt.out_body = &body_buf;
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  bool allow_short_read, void *out) override {
+        if (position < 0 || nbytes < 0)
+            return arrow::Status::Invalid("invalid read range");
+        int64_t n = std::min(nbytes, std::max<int64_t>(size_ - position, 0));
+        if (n < nbytes && !allow_short_read)
+            return arrow::Status::IOError("read past the end of ", path_);
+        std::lock_guard<std::mutex> guard(mu_);
+        if (!file_)
+            return arrow::Status::Invalid("hdfs file is closed");
+        if (n > 0 && hdfsSeek(fs_, file_, position) != 0)
+            return arrow::Status::IOError("hdfs seek failed: ", path_);
+        int64_t done = 0;
+        while (done < n) {
+            tSize chunk = static_cast<tSize>(
+                std::min<int64_t>(n - done, std::numeric_limits<tSize>::max()));
+            tSize got = hdfsRead(fs_, file_, static_cast<uint8_t *>(out) + done,
+                                 chunk);
+            if (got <= 0)
+                return arrow::Status::IOError("hdfs read error: ", path_);
+            done += got;
+        }
+        return n;
+    }
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  void *out) override {
+        return ReadAt(position, nbytes, true, out);
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>>
+    ReadAt(int64_t position, int64_t nbytes, bool allow_short_read) override {
+        int64_t n = std::min(nbytes, std::max<int64_t>(size_ - position, 0));
+        ARROW_ASSIGN_OR_RAISE(std::unique_ptr<arrow::Buffer> buf,
+                              arrow::AllocateBuffer(n));
+        ARROW_RETURN_NOT_OK(
+            ReadAt(position, nbytes, allow_short_read, buf->mutable_data()));
+        return std::shared_ptr<arrow::Buffer>(std::move(buf));
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position,
+                                                         int64_t nbytes) override {
+        return ReadAt(position, nbytes, true);
+    }
 
-    if (aws_s3_client_make_get_object_request(client, &opt)) {
-        aws_s3_client_release(client);
-        throw std::runtime_error("failed to download object from s3");
+private:
+    void Release() {
+        if (file_)
+            hdfsCloseFile(fs_, file_);
+        if (fs_)
+            hdfsDisconnect(fs_);
+        file_ = NULL;
+        fs_ = NULL;
     }
-    aws_s3_client_release(client);
 
-    std::vector<uint8_t> result(body_buf.buffer, body_buf.buffer + body_buf.len);
-    aws_byte_buf_clean_up(&body_buf);
-    return result;
+    std::string path_;
+    hdfsFS fs_ = NULL;
+    hdfsFile file_ = NULL;
+    int64_t size_ = 0;
+    int64_t pos_ = 0;
+    std::mutex mu_;
+};
+
+static std::shared_ptr<arrow::io::RandomAccessFile>
+hdfs_open_file(const std::string &path, std::string *version) {
+    auto file = std::make_shared<HdfsFile>(path);
+    file->Open(version);
+    return file;
 }
 
 std::vector<uint8_t> download_hdfs_to_buffer(const std::string &path) {
-    hdfsFS fs = hdfsConnect("default", 0);
-    if (!fs)
-        throw std::runtime_error("failed to connect to hdfs");
-    hdfsFile file = hdfsOpenFile(fs, path.c_str(), O_RDONLY, 0, 0, 0);
-    if (!file)
-        throw std::runtime_error("failed to open hdfs file");
-    tOffset size = hdfsAvailable(fs, file);
-    std::vector<uint8_t> buf(size);
-    tSize n = hdfsRead(fs, file, buf.data(), size);
-    if (n != size)
-        throw std::runtime_error("hdfs read error");
-    hdfsCloseFile(fs, file);
-    hdfsDisconnect(fs);
-    return buf;
+    std::shared_ptr<arrow::io::RandomAccessFile> file =
+        hdfs_open_file(path, NULL);
+    int64_t size;
+    std::shared_ptr<arrow::Buffer> buf;
+    PARQUET_ASSIGN_OR_THROW(size, file->GetSize());
+    PARQUET_ASSIGN_OR_THROW(buf, file->ReadAt(0, size));
+    return std::vector<uint8_t>(buf->data(), buf->data() + buf->size());
 }
 
-std::vector<RowTuple> parse_parquet_buffer(const uint8_t *data,
-                                           size_t length,
-                                           size_t max_rows) {
-    auto buffer = std::make_shared<arrow::Buffer>(data, length);
-    auto pf = parquet::ParquetFileReader::Open(
-        std::make_shared<arrow::io::BufferReader>(buffer));
+/*
+ * For remote sources (S3, HDFS) the column chunks of each row group are
+ * pre-buffered up front: nearby ranges are merged and all of them requested concurrently.
+ * Pages and arrays are allocated from `pool`. The leaf columns in
+ * `dictionary_leaves` decode to dictionary arrays.
+ */
+static std::unique_ptr<parquet::arrow::FileReader>
+open_arrow_reader(std::shared_ptr<arrow::io::RandomAccessFile> source,
+                  bool remote = false,
+                  std::shared_ptr<parquet::FileMetaData> metadata = nullptr,
+                  arrow::MemoryPool *pool = arrow::default_memory_pool(),
+                  const std::vector<int> *dictionary_leaves = nullptr) {
+    parquet::ArrowReaderProperties props =
+        parquet::default_arrow_reader_properties();
+    for (size_t i = 0; dictionary_leaves && i < dictionary_leaves->size(); ++i)
+        props.set_read_dictionary((*dictionary_leaves)[i], true);
+    if (remote) {
+        props.set_pre_buffer(true);
+        props.set_cache_options(arrow::io::CacheOptions::Defaults());
+    }
     std::unique_ptr<parquet::arrow::FileReader> arrow_reader;
-    parquet::arrow::FileReader::Make(arrow::default_memory_pool(), std::move(pf),
-                                     &arrow_reader);
+    PARQUET_ASSIGN_OR_THROW(
+        arrow_reader,
+        parquet::arrow::FileReader::Make(
+            pool,
+            parquet::ParquetFileReader::Open(std::move(source),
+                                             parquet::ReaderProperties(pool),
+                                             std::move(metadata)),
+            props));
+    return arrow_reader;
+}
 
-    std::shared_ptr<arrow::Table> table;
-    arrow_reader->ReadTable(&table);
+static ColumnValue read_cell(const arrow::Array &arr, int64_t r) {
+    ColumnValue cell{};
+    switch (arr.type_id()) {
+    case arrow::Type::BOOL:
+        cell.type = ColumnValue::BOOL;
+        cell.value = static_cast<const arrow::BooleanArray &>(arr).Value(r);
+        break;
+    case arrow::Type::INT32:
+        cell.type = ColumnValue::INT32;
+        cell.value = static_cast<const arrow::Int32Array &>(arr).Value(r);
+        break;
+    case arrow::Type::INT64:
+        cell.type = ColumnValue::INT64;
+        cell.value = static_cast<const arrow::Int64Array &>(arr).Value(r);
+        break;
+    case arrow::Type::FLOAT:
+        cell.type = ColumnValue::FLOAT;
+        cell.value = static_cast<const arrow::FloatArray &>(arr).Value(r);
+        break;
+    case arrow::Type::DOUBLE:
+        cell.type = ColumnValue::DOUBLE;
+        cell.value = static_cast<const arrow::DoubleArray &>(arr).Value(r);
+        break;
+    case arrow::Type::STRING:
+    case arrow::Type::BINARY:
+        cell.type = ColumnValue::STRING;
+        cell.value = static_cast<const arrow::BinaryArray &>(arr).GetString(r);
+        break;
+    case arrow::Type::TIMESTAMP:
+        cell.type = ColumnValue::TIMESTAMP;
+        cell.value = static_cast<const arrow::TimestampArray &>(arr).Value(r);
+        break;
+    case arrow::Type::DECIMAL128:
+        cell.type = ColumnValue::DECIMAL;
+        cell.value = static_cast<const arrow::Decimal128Array &>(arr).FormatValue(r);
+        break;
+    default:
+        cell.type = ColumnValue::STRING;
+        cell.value = std::string();
+    }
+    return cell;
+}
 
-    std::vector<RowTuple> rows;
-    int num_cols = table->num_columns();
-    int64_t rows_to_read = std::min<int64_t>(table->num_rows(), max_rows);
-
-    for (int64_t r = 0; r < rows_to_read; ++r) {
-        RowTuple row;
-        row.columns.reserve(num_cols);
-        for (int c = 0; c < num_cols; ++c) {
-            auto arr = table->column(c)->chunk(0);
-            ColumnValue cell{};
-            switch (arr->type_id()) {
-            case arrow::Type::BOOL:
-                cell.type = ColumnValue::BOOL;
-                cell.value = std::static_pointer_cast<arrow::BooleanArray>(arr)->Value(r);
-                break;
-            case arrow::Type::INT32:
-                cell.type = ColumnValue::INT32;
-                cell.value = std::static_pointer_cast<arrow::Int32Array>(arr)->Value(r);
-                break;
-            case arrow::Type::INT64:
-                cell.type = ColumnValue::INT64;
-                cell.value = std::static_pointer_cast<arrow::Int64Array>(arr)->Value(r);
-                break;
-            case arrow::Type::FLOAT:
-                cell.type = ColumnValue::FLOAT;
-                cell.value = std::static_pointer_cast<arrow::FloatArray>(arr)->Value(r);
-                break;
-            case arrow::Type::DOUBLE:
-                cell.type = ColumnValue::DOUBLE;
-                cell.value = std::static_pointer_cast<arrow::DoubleArray>(arr)->Value(r);
-                break;
-            case arrow::Type::STRING:
-            case arrow::Type::BINARY:
-                cell.type = ColumnValue::STRING;
-                cell.value = std::static_pointer_cast<arrow::BinaryArray>(arr)->GetString(r);
-                break;
-            case arrow::Type::TIMESTAMP:
-                cell.type = ColumnValue::TIMESTAMP;
-                cell.value = std::static_pointer_cast<arrow::TimestampArray>(arr)->Value(r);
-                break;
-            case arrow::Type::DECIMAL128:
-                cell.type = ColumnValue::DECIMAL;
-                cell.value = std::static_pointer_cast<arrow::Decimal128Array>(arr)
-                                 ->FormatValue(r);
-                break;
-            default:
-                cell.type = ColumnValue::STRING;
-                cell.value = "";
-            }
-            row.columns.push_back(std::move(cell));
+/*
+ * Arrow -> Datum conversion. A converter is picked once per attribute when
+ * the reader is opened, from the Arrow field type and the attribute's
+ * Postgres type, so the per-row path is one indirect call per cell. Pairs
+ * without a direct path fall back to the type's input function.
+ */
+struct ColumnConverter;
+struct TextDictionary;
+
+typedef Datum (*ConvertFn)(const arrow::Array &arr, int64_t row,
+                           const ColumnConverter &conv);
+
+struct ColumnConverter {
+    int field;              // arrow field index, -1 to always return NULL
+    ConvertFn convert;
+    int64_t unit_multiplier; // arrow time unit -> microseconds or days
+    int64_t unit_divisor;
+    int32_t scale;          // decimal scale
+    int32 typmod;
+    Oid typioparam;
+    FmgrInfo infunc;        // used by the text fallbacks only
+    TextDictionary *dict;   // dictionary_to_text only; owned by the reader
+};
+
+static const int64_t kUnixEpochDays = POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE;
+static const int64_t kUnixEpochUsecs = kUnixEpochDays * USECS_PER_DAY;
+static const int64_t kMsecsPerDay = 86400000;
+
+static inline int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static void out_of_range(const char *type_name) {
+    ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                    errmsg("parquet value out of range for type %s", type_name)));
+}
+
+static Datum bool_to_bool(const arrow::Array &arr, int64_t row,
+                          const ColumnConverter &) {
+    return BoolGetDatum(static_cast<const arrow::BooleanArray &>(arr).Value(row));
+}
+
+template <typename ArrayType>
+struct IntConvert {
+    static int64_t get(const arrow::Array &arr, int64_t row) {
+        return static_cast<int64_t>(static_cast<const ArrayType &>(arr).Value(row));
+    }
+    static Datum to_int2(const arrow::Array &arr, int64_t row,
+                         const ColumnConverter &) {
+        int64_t v = get(arr, row);
+        if (v < PG_INT16_MIN || v > PG_INT16_MAX)
+            out_of_range("smallint");
+        return Int16GetDatum(static_cast<int16>(v));
+    }
+    static Datum to_int4(const arrow::Array &arr, int64_t row,
+                         const ColumnConverter &) {
+        int64_t v = get(arr, row);
+        if (v < PG_INT32_MIN || v > PG_INT32_MAX)
+            out_of_range("integer");
+        return Int32GetDatum(static_cast<int32>(v));
+    }
+    static Datum to_int8(const arrow::Array &arr, int64_t row,
+                         const ColumnConverter &) {
+        return Int64GetDatum(get(arr, row));
+    }
+    static Datum to_float4(const arrow::Array &arr, int64_t row,
+                           const ColumnConverter &) {
+        return Float4GetDatum(static_cast<float4>(get(arr, row)));
+    }
+    static Datum to_float8(const arrow::Array &arr, int64_t row,
+                           const ColumnConverter &) {
+        return Float8GetDatum(static_cast<float8>(get(arr, row)));
+    }
+    static Datum to_numeric(const arrow::Array &arr, int64_t row,
+                            const ColumnConverter &) {
+        return NumericGetDatum(int64_to_numeric(get(arr, row)));
+    }
+
+    static ConvertFn pick(Oid typid) {
+        switch (typid) {
+        case INT2OID:
+            return to_int2;
+        case INT4OID:
+            return to_int4;
+        case INT8OID:
+            return to_int8;
+        case FLOAT4OID:
+            return to_float4;
+        case FLOAT8OID:
+            return to_float8;
+        case NUMERICOID:
+            return to_numeric;
+        default:
+            return NULL;
+        }
+    }
+};
+
+template <typename ArrayType>
+struct FloatConvert {
+    static double get(const arrow::Array &arr, int64_t row) {
+        return static_cast<double>(static_cast<const ArrayType &>(arr).Value(row));
+    }
+    static Datum to_float4(const arrow::Array &arr, int64_t row,
+                           const ColumnConverter &) {
+        return Float4GetDatum(static_cast<float4>(get(arr, row)));
+    }
+    static Datum to_float8(const arrow::Array &arr, int64_t row,
+                           const ColumnConverter &) {
+        return Float8GetDatum(get(arr, row));
+    }
+    static Datum to_numeric(const arrow::Array &arr, int64_t row,
+                            const ColumnConverter &) {
+        return DirectFunctionCall1(float8_numeric, Float8GetDatum(get(arr, row)));
+    }
+
+    static ConvertFn pick(Oid typid) {
+        switch (typid) {
+        case FLOAT4OID:
+            return to_float4;
+        case FLOAT8OID:
+            return to_float8;
+        case NUMERICOID:
+            return to_numeric;
+        default:
+            return NULL;
         }
-        rows.push_back(std::move(row));
     }
+};
 
-    return rows;
+/* Text Datums cannot hold NUL bytes, which textin would stop at. */
+static void check_text_bytes(std::string_view view) {
+    if (memchr(view.data(), '\0', view.size()))
+        ereport(ERROR, (errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
+                        errmsg("parquet string value contains a null byte")));
 }
 
-struct ParquetReader {
-    std::vector<RowTuple> rows;
-    size_t index;
-};
-
-static std::string column_value_to_string(const ColumnValue &cell) {
-    switch (cell.type) {
-    case ColumnValue::BOOL:
-        return std::get<bool>(cell.value) ? "t" : "f";
-    case ColumnValue::INT32:
-        return std::to_string(std::get<int32_t>(cell.value));
-    case ColumnValue::INT64:
-        return std::to_string(std::get<int64_t>(cell.value));
-    case ColumnValue::FLOAT:
-        return std::to_string(std::get<float>(cell.value));
-    case ColumnValue::DOUBLE:
-        return std::to_string(std::get<double>(cell.value));
-    case ColumnValue::STRING:
-    case ColumnValue::DECIMAL:
-        return std::get<std::string>(cell.value);
-    case ColumnValue::TIMESTAMP:
-        return std::to_string(std::get<int64_t>(cell.value));
-    default:
-        return "";
+/* Strings as text or unconstrained varchar, which need no input function. */
+static bool text_without_typmod(Oid typid, int32 typmod) {
+    return typid == TEXTOID || (typid == VARCHAROID && typmod < 0);
+}
+
+template <typename ArrayType>
+static Datum string_to_text(const arrow::Array &arr, int64_t row,
+                            const ColumnConverter &) {
+    auto view = static_cast<const ArrayType &>(arr).GetView(row);
+    check_text_bytes(view);
+    return PointerGetDatum(cstring_to_text_with_len(view.data(), view.size()));
+}
+
+template <typename ArrayType>
+static Datum string_via_input(const arrow::Array &arr, int64_t row,
+                              const ColumnConverter &conv) {
+    auto view = static_cast<const ArrayType &>(arr).GetView(row);
+    return InputFunctionCall(const_cast<FmgrInfo *>(&conv.infunc),
+                             pnstrdup(view.data(), view.size()),
+                             conv.typioparam, conv.typmod);
+}
+
+/*
+ * Text of the entries of the dictionary a dictionary-encoded column was last
+ * read with. Each entry is built into a text Datum the first time a row
+ * refers to it, and rows share it until the next dictionary, normally that
+ * of the next row group. Datums are only read until the next row is, so they
+ * outlive their use.
+ */
+struct TextDictionary {
+    std::shared_ptr<arrow::ArrayData> source; // held, so it is not reused
+    std::vector<std::unique_ptr<char[]>> entries; // text varlenas, or null
+};
+
+static Datum dictionary_to_text(const arrow::Array &arr, int64_t row,
+                                const ColumnConverter &conv) {
+    const auto &a = static_cast<const arrow::DictionaryArray &>(arr);
+    TextDictionary &dict = *conv.dict;
+    /* The batches of a row group are slices sharing its dictionary. */
+    if (dict.source != a.data()->dictionary) {
+        dict.source = a.data()->dictionary;
+        dict.entries.clear();
+        dict.entries.resize(dict.source->length);
+    }
+    const auto &values = static_cast<const arrow::BinaryArray &>(*a.dictionary());
+
+    int32_t index =
+        static_cast<const arrow::Int32Array &>(*a.indices()).Value(row);
+    std::unique_ptr<char[]> &entry = dict.entries[index];
+    if (!entry) {
+        std::string_view view = values.GetView(index);
+        check_text_bytes(view);
+        entry.reset(new char[VARHDRSZ + view.size()]);
+        SET_VARSIZE(entry.get(), VARHDRSZ + view.size());
+        memcpy(VARDATA(entry.get()), view.data(), view.size());
     }
+    return PointerGetDatum(entry.get());
+}
+
+static Datum scalar_via_input(const arrow::Array &arr, int64_t row,
+                              const ColumnConverter &conv) {
+    char *str;
+    {
+        auto scalar = arr.GetScalar(row);
+        if (!scalar.ok())
+            throw std::runtime_error(scalar.status().ToString());
+        str = pstrdup((*scalar)->ToString().c_str());
+    }
+    return InputFunctionCall(const_cast<FmgrInfo *>(&conv.infunc), str,
+                             conv.typioparam, conv.typmod);
+}
+
+/*
+ * Microseconds since the Unix epoch of a raw value in the unit set up by
+ * pick_converter. Raises an error if they do not fit in 64 bits.
+ */
+static inline int64_t scale_usecs(int64_t v, int64_t mult, int64_t div) {
+    if (div > 1)
+        return floor_div(v, div);
+    int64_t usecs;
+    if (__builtin_mul_overflow(v, mult, &usecs))
+        out_of_range("timestamp");
+    return usecs;
+}
+
+static inline int64_t timestamp_usecs(const arrow::Array &arr, int64_t row,
+                                      const ColumnConverter &conv) {
+    int64_t v = static_cast<const arrow::TimestampArray &>(arr).Value(row);
+    return scale_usecs(v, conv.unit_multiplier, conv.unit_divisor);
+}
+
+static Datum timestamp_to_timestamp(const arrow::Array &arr, int64_t row,
+                                    const ColumnConverter &conv) {
+    Timestamp ts;
+    if (__builtin_sub_overflow(timestamp_usecs(arr, row, conv),
+                               kUnixEpochUsecs, &ts) ||
+        !IS_VALID_TIMESTAMP(ts))
+        out_of_range("timestamp");
+    return TimestampGetDatum(ts);
+}
+
+/* The date `days` after the Unix epoch, if Postgres can represent it. */
+static Datum days_to_date(int64_t days) {
+    int64_t date = days - kUnixEpochDays;
+    if (!IS_VALID_DATE(date))
+        out_of_range("date");
+    return DateADTGetDatum(static_cast<DateADT>(date));
+}
+
+static Datum timestamp_to_date(const arrow::Array &arr, int64_t row,
+                               const ColumnConverter &conv) {
+    return days_to_date(
+        floor_div(timestamp_usecs(arr, row, conv), USECS_PER_DAY));
+}
+
+/* Days since the Unix epoch for date32 (days) and date64 (milliseconds). */
+static inline int64_t date_days(const arrow::Array &arr, int64_t row,
+                                const ColumnConverter &conv) {
+    if (arr.type_id() == arrow::Type::DATE32)
+        return static_cast<const arrow::Date32Array &>(arr).Value(row);
+    return floor_div(static_cast<const arrow::Date64Array &>(arr).Value(row),
+                     conv.unit_divisor);
+}
+
+static Datum date_to_date(const arrow::Array &arr, int64_t row,
+                          const ColumnConverter &conv) {
+    return days_to_date(date_days(arr, row, conv));
+}
+
+static Datum date_to_timestamp(const arrow::Array &arr, int64_t row,
+                               const ColumnConverter &conv) {
+    Timestamp ts;
+    if (__builtin_mul_overflow(date_days(arr, row, conv) - kUnixEpochDays,
+                               USECS_PER_DAY, &ts) ||
+        !IS_VALID_TIMESTAMP(ts))
+        out_of_range("timestamp");
+    return TimestampGetDatum(ts);
 }
 
-extern "C" ParquetReader *parquet_reader_open(const char *path) {
-    std::vector<uint8_t> data;
-    std::string spath(path);
-    if (spath.rfind("s3://", 0) == 0) {
-        auto pos = spath.find('/', 5);
-        std::string bucket = spath.substr(5, pos - 5);
-        std::string key = spath.substr(pos + 1);
-        data = download_s3_to_buffer(bucket, key);
-    } else if (spath.rfind("hdfs://", 0) == 0) {
-        data = download_hdfs_to_buffer(spath);
+static Datum decimal_to_numeric(const arrow::Array &arr, int64_t row,
+                                const ColumnConverter &conv) {
+    arrow::Decimal128 v(
+        static_cast<const arrow::Decimal128Array &>(arr).GetValue(row));
+    Datum d;
+    bool fits_int64 = (v.high_bits() == 0 && (int64_t)v.low_bits() >= 0) ||
+                      (v.high_bits() == -1 && (int64_t)v.low_bits() < 0);
+
+    if (fits_int64 && conv.scale >= 0) {
+        d = NumericGetDatum(int64_div_fast_to_numeric(
+            static_cast<int64_t>(v.low_bits()), conv.scale));
     } else {
-        std::ifstream file(path, std::ios::binary);
-        if (!file)
-            return NULL;
-        data = std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
-                                    std::istreambuf_iterator<char>());
+        char *str = pstrdup(v.ToString(conv.scale).c_str());
+        d = DirectFunctionCall3(numeric_in, CStringGetDatum(str),
+                                ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1));
+    }
+    if (conv.typmod >= 0)
+        d = DirectFunctionCall2(numeric, d, Int32GetDatum(conv.typmod));
+    return d;
+}
+
+static Datum decimal_to_float8(const arrow::Array &arr, int64_t row,
+                               const ColumnConverter &conv) {
+    arrow::Decimal128 v(
+        static_cast<const arrow::Decimal128Array &>(arr).GetValue(row));
+    return Float8GetDatum(v.ToDouble(conv.scale));
+}
+
+/* Factors that turn an Arrow timestamp into microseconds. */
+static void timestamp_unit_factors(const arrow::DataType &type,
+                                   int64_t *multiplier, int64_t *divisor) {
+    *multiplier = 1;
+    *divisor = 1;
+    switch (static_cast<const arrow::TimestampType &>(type).unit()) {
+    case arrow::TimeUnit::SECOND:
+        *multiplier = USECS_PER_SEC;
+        break;
+    case arrow::TimeUnit::MILLI:
+        *multiplier = 1000;
+        break;
+    case arrow::TimeUnit::MICRO:
+        break;
+    case arrow::TimeUnit::NANO:
+        *divisor = 1000;
+        break;
+    }
+}
+
+/*
+ * Chooses the direct converter for an Arrow type / Postgres type pair and
+ * fills in the unit and scale parameters it needs. Returns NULL when the pair
+ * has to go through the text fallback.
+ */
+static ConvertFn pick_converter(const arrow::DataType &type, Oid typid,
+                                ColumnConverter &conv) {
+    switch (type.id()) {
+    case arrow::Type::BOOL:
+        return typid == BOOLOID ? bool_to_bool : NULL;
+    case arrow::Type::INT8:
+        return IntConvert<arrow::Int8Array>::pick(typid);
+    case arrow::Type::INT16:
+        return IntConvert<arrow::Int16Array>::pick(typid);
+    case arrow::Type::INT32:
+        return IntConvert<arrow::Int32Array>::pick(typid);
+    case arrow::Type::INT64:
+        return IntConvert<arrow::Int64Array>::pick(typid);
+    case arrow::Type::UINT8:
+        return IntConvert<arrow::UInt8Array>::pick(typid);
+    case arrow::Type::UINT16:
+        return IntConvert<arrow::UInt16Array>::pick(typid);
+    case arrow::Type::UINT32:
+        return IntConvert<arrow::UInt32Array>::pick(typid);
+    case arrow::Type::FLOAT:
+        return FloatConvert<arrow::FloatArray>::pick(typid);
+    case arrow::Type::DOUBLE:
+        return FloatConvert<arrow::DoubleArray>::pick(typid);
+    case arrow::Type::STRING:
+    case arrow::Type::BINARY:
+        if (text_without_typmod(typid, conv.typmod))
+            return string_to_text<arrow::BinaryArray>;
+        return string_via_input<arrow::BinaryArray>;
+    case arrow::Type::LARGE_STRING:
+    case arrow::Type::LARGE_BINARY:
+        if (text_without_typmod(typid, conv.typmod))
+            return string_to_text<arrow::LargeBinaryArray>;
+        return string_via_input<arrow::LargeBinaryArray>;
+    case arrow::Type::TIMESTAMP:
+        timestamp_unit_factors(type, &conv.unit_multiplier, &conv.unit_divisor);
+        if (typid == TIMESTAMPOID || typid == TIMESTAMPTZOID)
+            return timestamp_to_timestamp;
+        if (typid == DATEOID)
+            return timestamp_to_date;
+        return NULL;
+    case arrow::Type::DATE32:
+    case arrow::Type::DATE64:
+        conv.unit_divisor = kMsecsPerDay;
+        if (typid == DATEOID)
+            return date_to_date;
+        if (typid == TIMESTAMPOID || typid == TIMESTAMPTZOID)
+            return date_to_timestamp;
+        return NULL;
+    case arrow::Type::DECIMAL128:
+        conv.scale = static_cast<const arrow::Decimal128Type &>(type).scale();
+        if (typid == NUMERICOID)
+            return decimal_to_numeric;
+        if (typid == FLOAT8OID)
+            return decimal_to_float8;
+        return NULL;
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Sets up the converter for one tuple attribute read from arrow field `field`
+ * (or -1 when the file has nothing for it).
+ */
+static void init_converter(ColumnConverter &conv, int field,
+                           const arrow::Field *arrow_field,
+                           Form_pg_attribute attr) {
+    memset(&conv, 0, sizeof(conv));
+    conv.field = field;
+    conv.typmod = attr->atttypmod;
+    if (field < 0)
+        return;
+
+    conv.convert = pick_converter(*arrow_field->type(), attr->atttypid, conv);
+    if (conv.convert && conv.convert != string_via_input<arrow::BinaryArray> &&
+        conv.convert != string_via_input<arrow::LargeBinaryArray>)
+        return;
+
+    Oid infunc;
+    getTypeInputInfo(attr->atttypid, &infunc, &conv.typioparam);
+    fmgr_info(infunc, &conv.infunc);
+    if (!conv.convert)
+        conv.convert = scalar_via_input;
+}
+
+/*
+ * Row-group pruning. Filter constants and column statistics are both mapped
+ * to the domain Postgres compares the attribute in: int64 for booleans,
+ * integers, dates (days) and timestamps (microseconds, Postgres epoch),
+ * double for floats and raw bytes for text.
+ */
+enum class KeyKind { NONE, INT, FLOAT, BYTES };
+
+struct FilterKey {
+    int64_t i = 0;
+    double f = 0;
+    std::string s;
+};
+
+struct PushedFilter;
+
+typedef void (*FilterFn)(const arrow::Array &arr, const PushedFilter &f,
+                         const ColumnConverter &conv, uint8_t *keep);
+
+struct PushedFilter {
+    int attnum;
+    int column;                            // index into the decoded batch, -1 if absent
+    int leaf;                              // parquet leaf column, -1 if not primitive
+    ParquetFilterOp op;
+    KeyKind kind;
+    Oid typid;
+    std::shared_ptr<arrow::DataType> type; // arrow type of the column
+    FilterKey lo, hi;                      // value1 and value2
+    FilterFn eval;                         // clears `keep` for failing rows
+    /* Lookups: the column index per row group, see load_lookups. */
+    std::vector<std::shared_ptr<parquet::ColumnIndex>> pages;
+};
+
+static KeyKind key_kind(Oid typid) {
+    switch (typid) {
+    case BOOLOID:
+    case INT2OID:
+    case INT4OID:
+    case INT8OID:
+    case DATEOID:
+    case TIMESTAMPOID:
+    case TIMESTAMPTZOID:
+        return KeyKind::INT;
+    case FLOAT4OID:
+    case FLOAT8OID:
+        return KeyKind::FLOAT;
+    case TEXTOID:
+    case VARCHAROID:
+        return KeyKind::BYTES;
+    default:
+        return KeyKind::NONE;
+    }
+}
+
+/*
+ * Whether comparing keys gives the same answer as the Postgres operator, so
+ * rows can be dropped without a recheck. Byte order only agrees with the
+ * (deterministic) collation on equality.
+ */
+static bool filter_exact(KeyKind kind, ParquetFilterOp op) {
+    if (kind == KeyKind::BYTES)
+        return op == PARQUET_FILTER_EQ || op == PARQUET_FILTER_NE;
+    return kind != KeyKind::NONE;
+}
+
+static FilterKey datum_key(Datum d, Oid typid) {
+    FilterKey k;
+    switch (typid) {
+    case BOOLOID:
+        k.i = DatumGetBool(d);
+        break;
+    case INT2OID:
+        k.i = DatumGetInt16(d);
+        break;
+    case INT4OID:
+        k.i = DatumGetInt32(d);
+        break;
+    case INT8OID:
+        k.i = DatumGetInt64(d);
+        break;
+    case DATEOID:
+        k.i = DatumGetDateADT(d);
+        break;
+    case TIMESTAMPOID:
+    case TIMESTAMPTZOID:
+        k.i = DatumGetTimestamp(d);
+        break;
+    case FLOAT4OID:
+        k.f = DatumGetFloat4(d);
+        break;
+    case FLOAT8OID:
+        k.f = DatumGetFloat8(d);
+        break;
+    case TEXTOID:
+    case VARCHAROID: {
+        text *t = reinterpret_cast<text *>(DatumGetPointer(d));
+        k.s.assign(VARDATA_ANY(t), VARSIZE_ANY_EXHDR(t));
+        break;
     }
+    }
+    return k;
+}
 
-    auto rows = parse_parquet_buffer(data.data(), data.size(),
-                                     std::numeric_limits<size_t>::max());
+/*
+ * Maps a raw integer statistic of an Arrow `type` column to the key of
+ * attribute type `typid`, using the same monotonic conversion the row
+ * converters apply. Returns false for pairs that are not pruned on.
+ */
+static bool stat_int_key(int64_t raw, const arrow::DataType &type, Oid typid,
+                         int64_t *key) {
+    bool int_attr = typid == BOOLOID || typid == INT2OID ||
+                    typid == INT4OID || typid == INT8OID;
+    int64_t mult, div;
+
+    switch (type.id()) {
+    case arrow::Type::BOOL:
+    case arrow::Type::INT8:
+    case arrow::Type::INT16:
+    case arrow::Type::INT32:
+    case arrow::Type::INT64:
+    case arrow::Type::UINT8:
+    case arrow::Type::UINT16:
+        *key = raw;
+        return int_attr;
+    case arrow::Type::UINT32:
+        *key = static_cast<uint32_t>(raw);
+        return int_attr;
+    case arrow::Type::TIMESTAMP:
+        timestamp_unit_factors(type, &mult, &div);
+        if (div > 1)
+            raw = floor_div(raw, div);
+        else if (__builtin_mul_overflow(raw, mult, &raw))
+            return false;
+        if (typid == TIMESTAMPOID || typid == TIMESTAMPTZOID)
+            return !__builtin_sub_overflow(raw, kUnixEpochUsecs, key);
+        if (typid == DATEOID) {
+            *key = floor_div(raw, USECS_PER_DAY) - kUnixEpochDays;
+            return true;
+        }
+        return false;
+    case arrow::Type::DATE32:
+        if (typid == DATEOID) {
+            *key = raw - kUnixEpochDays;
+            return true;
+        }
+        if (typid == TIMESTAMPOID || typid == TIMESTAMPTZOID) {
+            *key = (raw - kUnixEpochDays) * USECS_PER_DAY;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
 
-    ParquetReader *reader = new ParquetReader();
-    reader->rows = std::move(rows);
-    reader->index = 0;
-    return reader;
+static bool stat_float_key(double raw, const arrow::DataType &type, Oid typid,
+                           double *key) {
+    if (type.id() != arrow::Type::FLOAT && type.id() != arrow::Type::DOUBLE)
+        return false;
+    *key = typid == FLOAT4OID ? static_cast<float>(raw) : raw;
+    return true;
 }
 
-extern "C" bool parquet_reader_next(ParquetReader *reader, char **values, int ncols) {
-    if (!reader || reader->index >= reader->rows.size())
+/* Min/max of a column chunk as filter keys, or false if unusable. */
+static bool stats_keys(const parquet::Statistics &st, KeyKind kind,
+                       const arrow::DataType &type, Oid typid, FilterKey *min,
+                       FilterKey *max) {
+    switch (st.physical_type()) {
+    case parquet::Type::BOOLEAN: {
+        const auto &t = static_cast<const parquet::BoolStatistics &>(st);
+        return kind == KeyKind::INT &&
+               stat_int_key(t.min(), type, typid, &min->i) &&
+               stat_int_key(t.max(), type, typid, &max->i);
+    }
+    case parquet::Type::INT32: {
+        const auto &t = static_cast<const parquet::Int32Statistics &>(st);
+        return kind == KeyKind::INT &&
+               stat_int_key(t.min(), type, typid, &min->i) &&
+               stat_int_key(t.max(), type, typid, &max->i);
+    }
+    case parquet::Type::INT64: {
+        const auto &t = static_cast<const parquet::Int64Statistics &>(st);
+        return kind == KeyKind::INT &&
+               stat_int_key(t.min(), type, typid, &min->i) &&
+               stat_int_key(t.max(), type, typid, &max->i);
+    }
+    case parquet::Type::FLOAT: {
+        const auto &t = static_cast<const parquet::FloatStatistics &>(st);
+        return kind == KeyKind::FLOAT &&
+               stat_float_key(t.min(), type, typid, &min->f) &&
+               stat_float_key(t.max(), type, typid, &max->f);
+    }
+    case parquet::Type::DOUBLE: {
+        const auto &t = static_cast<const parquet::DoubleStatistics &>(st);
+        return kind == KeyKind::FLOAT &&
+               stat_float_key(t.min(), type, typid, &min->f) &&
+               stat_float_key(t.max(), type, typid, &max->f);
+    }
+    case parquet::Type::BYTE_ARRAY: {
+        const auto &t = static_cast<const parquet::ByteArrayStatistics &>(st);
+        switch (type.id()) {
+        case arrow::Type::STRING:
+        case arrow::Type::BINARY:
+        case arrow::Type::LARGE_STRING:
+        case arrow::Type::LARGE_BINARY:
+            break;
+        default:
+            return false;
+        }
+        if (kind != KeyKind::BYTES)
+            return false;
+        min->s.assign(reinterpret_cast<const char *>(t.min().ptr), t.min().len);
+        max->s.assign(reinterpret_cast<const char *>(t.max().ptr), t.max().len);
+        return true;
+    }
+    default:
         return false;
+    }
+}
 
-    const RowTuple &row = reader->rows[reader->index++];
-    int cols = std::min<int>(ncols, row.columns.size());
-    for (int i = 0; i < cols; ++i) {
-        std::string s = column_value_to_string(row.columns[i]);
-        values[i] = pstrdup(s.c_str());
+/* Whether any value in [min, max] can satisfy `op` against v1 (and v2). */
+template <typename T>
+static bool range_may_match(ParquetFilterOp op, const T &min, const T &max,
+                            const T &v1, const T &v2) {
+    switch (op) {
+    case PARQUET_FILTER_EQ:
+        return !(v1 < min) && !(max < v1);
+    case PARQUET_FILTER_NE:
+        return !(min == v1 && max == v1);
+    case PARQUET_FILTER_LT:
+        return min < v1;
+    case PARQUET_FILTER_LE:
+        return !(v1 < min);
+    case PARQUET_FILTER_GT:
+        return v1 < max;
+    case PARQUET_FILTER_GE:
+        return !(max < v1);
+    case PARQUET_FILTER_BETWEEN:
+        return !(max < v1) && !(v2 < min);
     }
-    for (int i = cols; i < ncols; ++i)
-        values[i] = NULL;
     return true;
 }
 
-extern "C" void parquet_reader_close(ParquetReader *reader) {
-    delete reader;
+static bool filter_may_match(const PushedFilter &f, const FilterKey &min,
+                             const FilterKey &max) {
+    switch (f.kind) {
+    case KeyKind::INT:
+        return range_may_match(f.op, min.i, max.i, f.lo.i, f.hi.i);
+    case KeyKind::FLOAT:
+        /* Parquet leaves NaN out of min/max; Postgres sorts it above all. */
+        if (f.op == PARQUET_FILTER_NE || f.op == PARQUET_FILTER_GT ||
+            f.op == PARQUET_FILTER_GE || std::isnan(f.lo.f) ||
+            std::isnan(f.hi.f) || std::isnan(min.f) || std::isnan(max.f))
+            return true;
+        return range_may_match(f.op, min.f, max.f, f.lo.f, f.hi.f);
+    case KeyKind::BYTES:
+        /* Byte order only agrees with the collation on equality. */
+        if (f.op != PARQUET_FILTER_EQ)
+            return true;
+        return range_may_match(f.op, std::string_view(min.s),
+                               std::string_view(max.s),
+                               std::string_view(f.lo.s), std::string_view());
+    default:
+        return true;
+    }
+}
+
+/* Whether every value in [min, max] satisfies `op` against v1 (and v2). */
+template <typename T>
+static bool range_all_match(ParquetFilterOp op, const T &min, const T &max,
+                            const T &v1, const T &v2) {
+    switch (op) {
+    case PARQUET_FILTER_EQ:
+        return min == v1 && max == v1;
+    case PARQUET_FILTER_NE:
+        return v1 < min || max < v1;
+    case PARQUET_FILTER_LT:
+        return max < v1;
+    case PARQUET_FILTER_LE:
+        return !(v1 < max);
+    case PARQUET_FILTER_GT:
+        return v1 < min;
+    case PARQUET_FILTER_GE:
+        return !(min < v1);
+    case PARQUET_FILTER_BETWEEN:
+        return !(min < v1) && !(v2 < max);
+    }
+    return false;
+}
+
+/* Whether every non-NULL value between min and max passes the filter. */
+static bool filter_all_match(const PushedFilter &f, const FilterKey &min,
+                             const FilterKey &max) {
+    switch (f.kind) {
+    case KeyKind::INT:
+        return range_all_match(f.op, min.i, max.i, f.lo.i, f.hi.i);
+    case KeyKind::BYTES:
+        /* Only (in)equality is pushed for text, and bytes decide it. */
+        return range_all_match(f.op, std::string_view(min.s),
+                               std::string_view(max.s),
+                               std::string_view(f.lo.s), std::string_view());
+    default:
+        /* NaN is left out of the statistics. */
+        return false;
+    }
+}
+
+/*
+ * An integer key as a Datum of attribute type `typid`, or false if it is out
+ * of the type's range.
+ */
+static bool int_key_datum(const FilterKey &k, Oid typid, Datum *d) {
+    switch (typid) {
+    case BOOLOID:
+        if (k.i != 0 && k.i != 1)
+            return false;
+        *d = BoolGetDatum(k.i != 0);
+        return true;
+    case INT2OID:
+        if (k.i < PG_INT16_MIN || k.i > PG_INT16_MAX)
+            return false;
+        *d = Int16GetDatum((int16)k.i);
+        return true;
+    case INT4OID:
+        if (k.i < PG_INT32_MIN || k.i > PG_INT32_MAX)
+            return false;
+        *d = Int32GetDatum((int32)k.i);
+        return true;
+    case DATEOID:
+        if (k.i < PG_INT32_MIN || k.i > PG_INT32_MAX)
+            return false;
+        *d = DateADTGetDatum((DateADT)k.i);
+        return true;
+    case INT8OID:
+        *d = Int64GetDatum(k.i);
+        return true;
+    case TIMESTAMPOID:
+    case TIMESTAMPTZOID:
+        *d = TimestampGetDatum(k.i);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Planner estimates. The estimable filters on an attribute are folded into
+ * one inclusive range plus the values it must differ from. The share of a row
+ * group's or data file's rows passing them is read off its min/max and null
+ * count, taking the values to be spread evenly between min and max and the
+ * attributes to be independent. Without statistics Postgres's default
+ * selectivities apply.
+ */
+struct AttrEstimate {
+    int attnum;
+    Oid typid;
+    KeyKind kind;
+    bool empty = false; // the filters contradict each other
+    bool has_lo = false, has_hi = false;
+    FilterKey lo, hi;
+    std::vector<FilterKey> ne;
+};
+
+/* What the statistics of a row group or data file say of one attribute. */
+struct AttrStats {
+    bool has_bounds = false;
+    FilterKey min, max;
+    int64_t nulls = -1; // -1 if unknown
+};
+
+static inline bool key_less(const FilterKey &a, const FilterKey &b,
+                            KeyKind kind) {
+    switch (kind) {
+    case KeyKind::INT:
+        return a.i < b.i;
+    case KeyKind::FLOAT:
+        return a.f < b.f;
+    default:
+        return a.s < b.s;
+    }
+}
+
+/*
+ * Adds a filter to the estimate of its attribute. Returns false if it can't
+ * be estimated this way: text compares by collation, not bytes, so only
+ * (in)equality is.
+ */
+static bool fold_filter(std::vector<AttrEstimate> &attrs, int attnum, Oid typid,
+                        ParquetFilterOp op, const FilterKey &v1,
+                        const FilterKey &v2) {
+    KeyKind kind = key_kind(typid);
+    if (kind == KeyKind::NONE)
+        return false;
+    if (kind == KeyKind::BYTES && op != PARQUET_FILTER_EQ &&
+        op != PARQUET_FILTER_NE)
+        return false;
+    if (kind == KeyKind::FLOAT && (std::isnan(v1.f) || std::isnan(v2.f)))
+        return false;
+
+    AttrEstimate *a = nullptr;
+    for (AttrEstimate &e : attrs)
+        if (e.attnum == attnum)
+            a = &e;
+    if (!a) {
+        attrs.emplace_back();
+        a = &attrs.back();
+        a->attnum = attnum;
+        a->typid = typid;
+        a->kind = kind;
+    }
+    auto raise_lo = [a](const FilterKey &v) {
+        if (!a->has_lo || key_less(a->lo, v, a->kind))
+            a->lo = v;
+        a->has_lo = true;
+    };
+    auto lower_hi = [a](const FilterKey &v) {
+        if (!a->has_hi || key_less(v, a->hi, a->kind))
+            a->hi = v;
+        a->has_hi = true;
+    };
+    /* Integers turn strict bounds into inclusive ones. */
+    FilterKey step = v1;
+    switch (op) {
+    case PARQUET_FILTER_EQ:
+        raise_lo(v1);
+        lower_hi(v1);
+        break;
+    case PARQUET_FILTER_NE:
+        a->ne.push_back(v1);
+        break;
+    case PARQUET_FILTER_LT:
+        if (kind == KeyKind::INT && __builtin_sub_overflow(v1.i, 1, &step.i))
+            a->empty = true;
+        else
+            lower_hi(step);
+        break;
+    case PARQUET_FILTER_LE:
+        lower_hi(v1);
+        break;
+    case PARQUET_FILTER_GT:
+        if (kind == KeyKind::INT && __builtin_add_overflow(v1.i, 1, &step.i))
+            a->empty = true;
+        else
+            raise_lo(step);
+        break;
+    case PARQUET_FILTER_GE:
+        raise_lo(v1);
+        break;
+    case PARQUET_FILTER_BETWEEN:
+        raise_lo(v1);
+        lower_hi(v2);
+        break;
+    }
+    return true;
+}
+
+/* Share of `rows` rows holding one given value that lies in [min, max]. */
+static double value_share(const AttrEstimate &a, const AttrStats &st,
+                          double rows) {
+    if (a.kind == KeyKind::INT)
+        return 1.0 / std::max(1.0, std::min((double)st.max.i - st.min.i + 1,
+                                            rows));
+    if (!key_less(st.min, st.max, a.kind))
+        return 1.0;
+    return DEFAULT_EQ_SEL;
+}
+
+/* Share of `rows` rows, described by `st`, that pass the filters of `a`. */
+static double attr_share(const AttrEstimate &a, const AttrStats &st,
+                         double rows) {
+    if (a.empty || rows <= 0)
+        return 0;
+    if (a.has_lo && a.has_hi && key_less(a.hi, a.lo, a.kind))
+        return 0;
+    double nonnull = 1;
+    if (st.nulls >= 0)
+        nonnull = std::max(0.0, 1 - st.nulls / rows);
+    bool point = a.has_lo && a.has_hi && !key_less(a.lo, a.hi, a.kind);
+    double share;
+
+    if (!st.has_bounds || (a.kind == KeyKind::FLOAT &&
+                           (std::isnan(st.min.f) || std::isnan(st.max.f)))) {
+        if (point)
+            share = DEFAULT_EQ_SEL;
+        else if (a.has_lo && a.has_hi)
+            share = DEFAULT_RANGE_INEQ_SEL;
+        else if (a.has_lo || a.has_hi)
+            share = DEFAULT_INEQ_SEL;
+        else
+            share = 1;
+        for (size_t i = 0; i < a.ne.size(); i++)
+            share *= 1 - DEFAULT_EQ_SEL;
+        return share * nonnull;
+    }
+
+    const FilterKey &lo =
+        a.has_lo && key_less(st.min, a.lo, a.kind) ? a.lo : st.min;
+    const FilterKey &hi =
+        a.has_hi && key_less(a.hi, st.max, a.kind) ? a.hi : st.max;
+    if (key_less(hi, lo, a.kind))
+        return 0;
+    if (point) {
+        share = value_share(a, st, rows);
+    } else if (a.kind == KeyKind::INT) {
+        share = ((double)hi.i - lo.i + 1) / ((double)st.max.i - st.min.i + 1);
+    } else if (a.kind == KeyKind::FLOAT && st.max.f > st.min.f) {
+        share = (hi.f - lo.f) / (st.max.f - st.min.f);
+        share = std::isfinite(share) ? std::max(share, 1 / rows)
+                                     : DEFAULT_INEQ_SEL;
+    } else {
+        share = 1;
+    }
+    for (const FilterKey &v : a.ne)
+        if (!key_less(v, st.min, a.kind) && !key_less(st.max, v, a.kind))
+            share *= 1 - value_share(a, st, rows);
+    return share * nonnull;
+}
+
+/*
+ * Row filtering. Each pushed filter clears the `keep` byte of the batch rows
+ * that fail it; rows still set afterwards form the selection vector. Keys are
+ * loaded with the same arithmetic as the row converters and compared in
+ * Postgres order, so filtered rows never reach the executor's quals. The
+ * loops are instantiated per operator to keep the compare out of a switch.
+ */
+static inline int key_cmp(int64_t a, int64_t b) {
+    return (a > b) - (a < b);
+}
+
+/* float8_cmp_internal: NaN equals itself and sorts above everything else. */
+static inline int key_cmp(double a, double b) {
+    if (std::isnan(a))
+        return std::isnan(b) ? 0 : 1;
+    if (std::isnan(b))
+        return -1;
+    return (a > b) - (a < b);
+}
+
+static inline int key_cmp(std::string_view a, std::string_view b) {
+    return a.compare(b);
+}
+
+template <ParquetFilterOp Op, typename K>
+static inline bool op_holds(const K &v, const K &lo, const K &hi) {
+    if constexpr (Op == PARQUET_FILTER_EQ)
+        return key_cmp(v, lo) == 0;
+    else if constexpr (Op == PARQUET_FILTER_NE)
+        return key_cmp(v, lo) != 0;
+    else if constexpr (Op == PARQUET_FILTER_LT)
+        return key_cmp(v, lo) < 0;
+    else if constexpr (Op == PARQUET_FILTER_LE)
+        return key_cmp(v, lo) <= 0;
+    else if constexpr (Op == PARQUET_FILTER_GT)
+        return key_cmp(v, lo) > 0;
+    else if constexpr (Op == PARQUET_FILTER_GE)
+        return key_cmp(v, lo) >= 0;
+    else
+        return key_cmp(v, lo) >= 0 && key_cmp(v, hi) <= 0;
+}
+
+template <ParquetFilterOp Op, typename K, typename Load>
+static void keep_matching(Load load, int64_t n, const K &lo, const K &hi,
+                          uint8_t *keep) {
+    for (int64_t i = 0; i < n; ++i)
+        keep[i] &= op_holds<Op, K>(load(i), lo, hi);
+}
+
+template <typename K, typename Load>
+static void keep_matching(ParquetFilterOp op, Load load, int64_t n,
+                          const K &lo, const K &hi, uint8_t *keep) {
+    switch (op) {
+    case PARQUET_FILTER_EQ:
+        return keep_matching<PARQUET_FILTER_EQ, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_NE:
+        return keep_matching<PARQUET_FILTER_NE, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_LT:
+        return keep_matching<PARQUET_FILTER_LT, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_LE:
+        return keep_matching<PARQUET_FILTER_LE, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_GT:
+        return keep_matching<PARQUET_FILTER_GT, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_GE:
+        return keep_matching<PARQUET_FILTER_GE, K>(load, n, lo, hi, keep);
+    case PARQUET_FILTER_BETWEEN:
+        return keep_matching<PARQUET_FILTER_BETWEEN, K>(load, n, lo, hi, keep);
+    }
+}
+
+static void filter_bools(const arrow::Array &arr, const PushedFilter &f,
+                         const ColumnConverter &, uint8_t *keep) {
+    const auto &a = static_cast<const arrow::BooleanArray &>(arr);
+    keep_matching(
+        f.op, [&a](int64_t i) { return static_cast<int64_t>(a.Value(i)); },
+        arr.length(), f.lo.i, f.hi.i, keep);
+}
+
+template <typename ArrayType>
+static void filter_ints(const arrow::Array &arr, const PushedFilter &f,
+                        const ColumnConverter &, uint8_t *keep) {
+    const auto *v = static_cast<const ArrayType &>(arr).raw_values();
+    keep_matching(
+        f.op, [v](int64_t i) { return static_cast<int64_t>(v[i]); },
+        arr.length(), f.lo.i, f.hi.i, keep);
+}
+
+template <typename ArrayType>
+static void filter_floats(const arrow::Array &arr, const PushedFilter &f,
+                          const ColumnConverter &, uint8_t *keep) {
+    const auto *v = static_cast<const ArrayType &>(arr).raw_values();
+    if (f.typid == FLOAT4OID)
+        keep_matching(
+            f.op,
+            [v](int64_t i) {
+                return static_cast<double>(static_cast<float4>(v[i]));
+            },
+            arr.length(), f.lo.f, f.hi.f, keep);
+    else
+        keep_matching(
+            f.op, [v](int64_t i) { return static_cast<double>(v[i]); },
+            arr.length(), f.lo.f, f.hi.f, keep);
 }
 
+/*
+ * Arithmetic for the time filters, clamped to the int64 range. The kernels
+ * raise no errors: they also run over NULL slots, whose contents are
+ * undefined. An out-of-range value still orders past every bound, and its
+ * converter rejects it if the row passes.
+ */
+static inline int64_t clamped_mul(int64_t a, int64_t b) {
+    int64_t r;
+    if (__builtin_mul_overflow(a, b, &r))
+        return (a < 0) != (b < 0) ? std::numeric_limits<int64_t>::min()
+                                  : std::numeric_limits<int64_t>::max();
+    return r;
+}
+
+static inline int64_t clamped_sub(int64_t a, int64_t b) {
+    int64_t r;
+    if (__builtin_sub_overflow(a, b, &r))
+        return b > 0 ? std::numeric_limits<int64_t>::min()
+                     : std::numeric_limits<int64_t>::max();
+    return r;
+}
+
+/* Timestamp columns read as timestamp or timestamptz. */
+static void filter_timestamps(const arrow::Array &arr, const PushedFilter &f,
+                              const ColumnConverter &conv, uint8_t *keep) {
+    const int64_t *v = static_cast<const arrow::TimestampArray &>(arr).raw_values();
+    int64_t mult = conv.unit_multiplier, div = conv.unit_divisor;
+    if (div > 1)
+        keep_matching(
+            f.op,
+            [v, div](int64_t i) {
+                return clamped_sub(floor_div(v[i], div), kUnixEpochUsecs);
+            },
+            arr.length(), f.lo.i, f.hi.i, keep);
+    else
+        keep_matching(
+            f.op,
+            [v, mult](int64_t i) {
+                return clamped_sub(clamped_mul(v[i], mult), kUnixEpochUsecs);
+            },
+            arr.length(), f.lo.i, f.hi.i, keep);
+}
+
+/* date32 columns read as date, timestamp or timestamptz. */
+static void filter_dates(const arrow::Array &arr, const PushedFilter &f,
+                         const ColumnConverter &, uint8_t *keep) {
+    const int32_t *v = static_cast<const arrow::Date32Array &>(arr).raw_values();
+    if (f.typid == DATEOID)
+        keep_matching(
+            f.op,
+            [v](int64_t i) { return static_cast<int64_t>(v[i]) - kUnixEpochDays; },
+            arr.length(), f.lo.i, f.hi.i, keep);
+    else
+        keep_matching(
+            f.op,
+            [v](int64_t i) {
+                return clamped_mul(static_cast<int64_t>(v[i]) - kUnixEpochDays,
+                                   USECS_PER_DAY);
+            },
+            arr.length(), f.lo.i, f.hi.i, keep);
+}
+
+template <typename ArrayType>
+static void filter_strings(const arrow::Array &arr, const PushedFilter &f,
+                           const ColumnConverter &, uint8_t *keep) {
+    const auto &a = static_cast<const ArrayType &>(arr);
+    keep_matching(
+        f.op, [&a](int64_t i) { return std::string_view(a.GetView(i)); },
+        arr.length(), std::string_view(f.lo.s), std::string_view(f.hi.s), keep);
+}
+
+/*
+ * Dictionary-encoded strings: compares each entry of the dictionary once and
+ * looks the rows' entries up.
+ */
+static void filter_dictionary_strings(const arrow::Array &arr,
+                                      const PushedFilter &f,
+                                      const ColumnConverter &conv,
+                                      uint8_t *keep) {
+    const auto &a = static_cast<const arrow::DictionaryArray &>(arr);
+    const arrow::Array &values = *a.dictionary();
+    std::vector<uint8_t> match(values.length(), 1);
+    filter_strings<arrow::BinaryArray>(values, f, conv, match.data());
+
+    const int32_t *index =
+        static_cast<const arrow::Int32Array &>(*a.indices()).raw_values();
+    for (int64_t i = 0; i < arr.length(); ++i)
+        if (keep[i])
+            keep[i] = match[index[i]];
+}
+
+/*
+ * Any other column/attribute pair: converts the rows still kept and compares
+ * the resulting Datums.
+ */
+static void filter_via_datum(const arrow::Array &arr, const PushedFilter &f,
+                             const ColumnConverter &conv, uint8_t *keep) {
+    auto key = [&](int64_t i) {
+        return keep[i] ? datum_key(conv.convert(arr, i, conv), f.typid)
+                       : FilterKey();
+    };
+    switch (f.kind) {
+    case KeyKind::INT:
+        keep_matching(
+            f.op, [&](int64_t i) { return key(i).i; }, arr.length(), f.lo.i,
+            f.hi.i, keep);
+        break;
+    case KeyKind::FLOAT:
+        keep_matching(
+            f.op, [&](int64_t i) { return key(i).f; }, arr.length(), f.lo.f,
+            f.hi.f, keep);
+        break;
+    case KeyKind::BYTES:
+        keep_matching(
+            f.op, [&](int64_t i) { return std::move(key(i).s); }, arr.length(),
+            f.lo.s, f.hi.s, keep);
+        break;
+    case KeyKind::NONE:
+        break;
+    }
+}
+
+/* The kernel for a filter on an Arrow `type` column read as `typid`. */
+static FilterFn pick_filter(const arrow::DataType &type, Oid typid) {
+    bool int_attr = typid == INT2OID || typid == INT4OID || typid == INT8OID;
+    bool float_attr = typid == FLOAT4OID || typid == FLOAT8OID;
+    bool ts_attr = typid == TIMESTAMPOID || typid == TIMESTAMPTZOID;
+    bool text_attr = typid == TEXTOID || typid == VARCHAROID;
+
+    switch (type.id()) {
+    case arrow::Type::BOOL:
+        return typid == BOOLOID ? filter_bools : filter_via_datum;
+    case arrow::Type::INT8:
+        return int_attr ? filter_ints<arrow::Int8Array> : filter_via_datum;
+    case arrow::Type::INT16:
+        return int_attr ? filter_ints<arrow::Int16Array> : filter_via_datum;
+    case arrow::Type::INT32:
+        return int_attr ? filter_ints<arrow::Int32Array> : filter_via_datum;
+    case arrow::Type::INT64:
+        return int_attr ? filter_ints<arrow::Int64Array> : filter_via_datum;
+    case arrow::Type::UINT8:
+        return int_attr ? filter_ints<arrow::UInt8Array> : filter_via_datum;
+    case arrow::Type::UINT16:
+        return int_attr ? filter_ints<arrow::UInt16Array> : filter_via_datum;
+    case arrow::Type::UINT32:
+        return int_attr ? filter_ints<arrow::UInt32Array> : filter_via_datum;
+    case arrow::Type::FLOAT:
+        return float_attr ? filter_floats<arrow::FloatArray> : filter_via_datum;
+    case arrow::Type::DOUBLE:
+        return float_attr ? filter_floats<arrow::DoubleArray> : filter_via_datum;
+    case arrow::Type::TIMESTAMP:
+        return ts_attr ? filter_timestamps : filter_via_datum;
+    case arrow::Type::DATE32:
+        return ts_attr || typid == DATEOID ? filter_dates : filter_via_datum;
+    case arrow::Type::STRING:
+    case arrow::Type::BINARY:
+        return text_attr ? filter_strings<arrow::BinaryArray> : filter_via_datum;
+    case arrow::Type::LARGE_STRING:
+    case arrow::Type::LARGE_BINARY:
+        return text_attr ? filter_strings<arrow::LargeBinaryArray>
+                         : filter_via_datum;
+    default:
+        return filter_via_datum;
+    }
+}
+
+int icebergc_prefetch_row_groups = 1;
+int icebergc_scan_memory_limit = 1024 * 1024;
+
+/* Buffers from this size up are kept for reuse when freed. */
+static const int64_t kReusableSize = 64 * 1024;
+
+/*
+ * What an allocation of `size` takes from the pool: reusable ones are rounded
+ * up to one of eight steps per power of two, so that a buffer freed by one
+ * row group fits the like-sized one of the next, wasting at most an eighth.
+ */
+static int64_t pool_capacity(int64_t size) {
+    if (size < kReusableSize)
+        return size;
+    int64_t step = (int64_t{1} << (63 - __builtin_clzll(size))) / 8;
+    return (size + step - 1) / step * step;
+}
+
+/*
+ * The pool behind ParquetMemoryPool. It allocates from Arrow's default pool,
+ * as the prefetch thread allocates too and palloc cannot be used there, and
+ * counts what its readers hold. Freed reusable buffers go to a free list by
+ * capacity, bounded by the cache size; they count towards the limit and are
+ * released first when an allocation would exceed it.
+ */
+class ScanMemoryPool : public arrow::MemoryPool {
+public:
+    ScanMemoryPool(int64_t limit, int64_t cache_size)
+        : limit_(limit), cache_size_(cache_size) {}
+    ~ScanMemoryPool() override { ReleaseUnused(); }
+
+    arrow::Status Allocate(int64_t size, int64_t alignment,
+                           uint8_t **out) override {
+        int64_t capacity = pool_capacity(size);
+        if (Reuse(capacity, alignment, out))
+            return arrow::Status::OK();
+        ARROW_RETURN_NOT_OK(Reserve(capacity));
+        arrow::Status st = backing_->Allocate(capacity, alignment, out);
+        if (!st.ok())
+            allocated_ -= capacity;
+        return st;
+    }
+
+    arrow::Status Reallocate(int64_t old_size, int64_t new_size,
+                             int64_t alignment, uint8_t **ptr) override {
+        int64_t old_capacity = pool_capacity(old_size);
+        int64_t new_capacity = pool_capacity(new_size);
+        if (new_capacity == old_capacity)
+            return arrow::Status::OK();
+        int64_t growth = std::max<int64_t>(new_capacity - old_capacity, 0);
+        ARROW_RETURN_NOT_OK(Reserve(growth));
+        arrow::Status st =
+            backing_->Reallocate(old_capacity, new_capacity, alignment, ptr);
+        allocated_ -= st.ok() ? std::max<int64_t>(old_capacity - new_capacity, 0)
+                              : growth;
+        return st;
+    }
+
+    void Free(uint8_t *buffer, int64_t size, int64_t alignment) override {
+        int64_t capacity = pool_capacity(size);
+        allocated_ -= capacity;
+        if (capacity >= kReusableSize) {
+            std::lock_guard<std::mutex> guard(mu_);
+            if (cached_ + capacity <= cache_size_) {
+                free_[{capacity, alignment}].push_back(buffer);
+                cached_ += capacity;
+                return;
+            }
+        }
+        backing_->Free(buffer, capacity, alignment);
+    }
+
+    void ReleaseUnused() override {
+        std::lock_guard<std::mutex> guard(mu_);
+        for (auto &entry : free_)
+            for (uint8_t *buffer : entry.second)
+                backing_->Free(buffer, entry.first.first, entry.first.second);
+        free_.clear();
+        cached_ = 0;
+    }
+
+    int64_t bytes_allocated() const override { return allocated_; }
+    int64_t max_memory() const override { return peak_; }
+    int64_t total_bytes_allocated() const override { return total_; }
+    int64_t num_allocations() const override { return allocations_; }
+    std::string backend_name() const override { return "icebergc_fdw"; }
+
+    /* Whether readers should stop decoding ahead. */
+    bool crowded() const { return limit_ > 0 && allocated_ > limit_ / 2; }
+
+private:
+    bool Reuse(int64_t capacity, int64_t alignment, uint8_t **out) {
+        if (capacity < kReusableSize)
+            return false;
+        std::lock_guard<std::mutex> guard(mu_);
+        auto it = free_.find({capacity, alignment});
+        if (it == free_.end() || it->second.empty())
+            return false;
+        *out = it->second.back();
+        it->second.pop_back();
+        cached_ -= capacity;
+        Count(allocated_ += capacity, capacity);
+        return true;
+    }
+
+    arrow::Status Reserve(int64_t n) {
+        int64_t held = allocated_ += n;
+        if (limit_ > 0 && held + cached_ > limit_) {
+            ReleaseUnused();
+            if (held > limit_) {
+                allocated_ -= n;
+                return arrow::Status::OutOfMemory(
+                    "icebergc_fdw.scan_memory_limit of ", limit_ / 1024,
+                    " kB exceeded");
+            }
+        }
+        Count(held, n);
+        return arrow::Status::OK();
+    }
+
+    void Count(int64_t held, int64_t n) {
+        total_ += n;
+        allocations_++;
+        int64_t peak = peak_;
+        while (held > peak && !peak_.compare_exchange_weak(peak, held))
+            ;
+    }
+
+    arrow::MemoryPool *backing_ = arrow::default_memory_pool();
+    const int64_t limit_;      // bytes, 0 for none
+    const int64_t cache_size_; // bytes the free list may hold
+    std::atomic<int64_t> allocated_{0};
+    std::atomic<int64_t> peak_{0};
+    std::atomic<int64_t> total_{0};
+    std::atomic<int64_t> allocations_{0};
+    std::mutex mu_;            // guards free_ and updates of cached_
+    std::map<std::pair<int64_t, int64_t>, std::vector<uint8_t *>> free_;
+    std::atomic<int64_t> cached_{0};
+};
+
+struct ParquetMemoryPool {
+    std::shared_ptr<ScanMemoryPool> pool;
+};
+
+/*
+ * What a reader's file reads and, when it is timed, where its time goes; see
+ * ParquetReaderStats. Reads complete on Arrow's I/O threads and row groups
+ * are decoded on the prefetch thread, so the counters are atomic. Reads
+ * still in flight when the reader is closed keep them alive.
+ */
+struct ReaderCounters {
+    const bool timed;
+    std::atomic<int64_t> bytes{0};        // read from the file
+    std::atomic<int64_t> remote_bytes{0}; // fetched from S3 or HDFS
+    std::atomic<int64_t> fetch_usecs{0};
+    std::atomic<int64_t> decode_usecs{0};
+    int64_t open_usecs = 0; // opening the file until the reader was set up
+
+    explicit ReaderCounters(bool timed) : timed(timed) {}
+};
+
+static int64_t now_usecs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/*
+ * Decodes a list of row groups, in order, on a thread of its own and keeps
+ * up to `depth` of them ready, so that fetching and decompressing the next
+ * row groups overlaps with the backend turning the current one into tuples.
+ * The thread only uses the Arrow reader, which the backend must leave alone
+ * meanwhile, and Arrow's memory pool: no palloc, elog or other Postgres
+ * calls. Row groups `wanted` turns down, if given, are skipped; it runs on
+ * the thread too, under the same rules. A failure is handed back in place of
+ * its row group, and nothing after it is decoded. The destructor drops what
+ * was not started and waits for the row group in progress.
+ */
+class RowGroupPrefetcher {
+public:
+    RowGroupPrefetcher(parquet::arrow::FileReader *reader,
+                       std::vector<int> leaves, std::vector<int> row_groups,
+                       std::function<bool(int)> wanted, size_t depth,
+                       const ScanMemoryPool *pool, ReaderCounters *counters)
+        : reader_(reader), leaves_(std::move(leaves)),
+          row_groups_(std::move(row_groups)), wanted_(std::move(wanted)),
+          depth_(depth), pool_(pool), counters_(counters) {
+        thread_ = std::thread([this] { Run(); });
+    }
+    ~RowGroupPrefetcher() {
+        {
+            std::lock_guard<std::mutex> guard(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+    RowGroupPrefetcher(const RowGroupPrefetcher &) = delete;
+    RowGroupPrefetcher &operator=(const RowGroupPrefetcher &) = delete;
+
+    /* The next row group of the list not skipped, or NULL after the last. */
+    std::shared_ptr<arrow::Table> Next() {
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mu_);
+            if (taken_ >= row_groups_.size())
+                return nullptr;
+            cv_.wait(lock, [this] { return !ready_.empty(); });
+            arrow::Result<std::shared_ptr<arrow::Table>> table =
+                std::move(ready_.front());
+            ready_.pop_front();
+            taken_++;
+            lock.unlock();
+            cv_.notify_all();
+            PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Table> t,
+                                    std::move(table));
+            if (t)
+                return t;
+        }
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (next_ < row_groups_.size()) {
+            /* Near the memory limit, decode only once the backend waits. */
+            cv_.wait(lock, [this] {
+                return stop_ || ready_.empty() ||
+                       (ready_.size() < depth_ && !(pool_ && pool_->crowded()));
+            });
+            if (stop_)
+                return;
+            int rg = row_groups_[next_++];
+            lock.unlock();
+            arrow::Result<std::shared_ptr<arrow::Table>> table;
+            int64_t start = counters_ && counters_->timed ? now_usecs() : 0;
+            try {
+                if (!wanted_ || wanted_(rg))
+                    table = reader_->ReadRowGroup(rg, leaves_);
+                else
+                    table = std::shared_ptr<arrow::Table>();
+            } catch (const std::exception &e) {
+                table = arrow::Status::IOError(e.what());
+            }
+            if (start)
+                counters_->decode_usecs += now_usecs() - start;
+            lock.lock();
+            bool failed = !table.ok();
+            ready_.push_back(std::move(table));
+            cv_.notify_all();
+            if (failed) {
+                /* Let the backend's Next() calls end at the error. */
+                row_groups_.resize(taken_ + ready_.size());
+                return;
+            }
+        }
+    }
+
+    parquet::arrow::FileReader *reader_;
+    const std::vector<int> leaves_;
+    std::vector<int> row_groups_;
+    const std::function<bool(int)> wanted_;
+    const size_t depth_;
+    const ScanMemoryPool *pool_; // NULL for Arrow's default pool
+    ReaderCounters *counters_;   // NULL if not counted
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<arrow::Result<std::shared_ptr<arrow::Table>>> ready_;
+    size_t next_ = 0;  // next row group to decode
+    size_t taken_ = 0; // row groups handed to the backend
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+/*
+ * Top-N scans: where the rows of a row group can rank in the scan's order.
+ * Row groups may hold the best rows (tier 0) when their statistics are
+ * missing, or when they hold NULLs and NULLs sort first; they are read first
+ * and never skipped. The others rank by `key`, the best value their
+ * statistics allow: the min ascending, the max descending (tier 1). Those
+ * holding only NULLs that sort last come after all of them (tier 2).
+ */
+struct RowGroupRank {
+    int tier;
+    FilterKey key;
+};
+
+/*
+ * Aggregate scans: what the row groups answered from their statistics add
+ * up to for one attribute.
+ */
+struct SummaryColumn {
+    int attnum;  // 0-based, -1 for none
+    bool bounds; // min and max are wanted
+    bool missing; // absent from the file, so NULL
+    int leaf;    // parquet leaf column, -1 if not primitive
+    Oid typid;
+    KeyKind kind;
+    std::shared_ptr<arrow::DataType> type;
+    int64_t nonnull;
+    bool has_bounds;
+    FilterKey min, max;
+};
+
+/*
+ * Streaming reader state. Only the row group under the cursor is decoded, and
+ * only the leaf columns in `leaves`; `batch` is a slice of `table`. With
+ * filters, `selection` lists the rows of `batch` that pass them and `row`
+ * indexes into it; otherwise `row` indexes the batch directly. When no column
+ * is needed `batch` stays empty and `batch_rows` comes from the row group
+ * metadata. When more than one row group is left to decode, `prefetch`
+ * decodes them ahead; the backend then only reads the file's metadata.
+ */
+struct ParquetReader {
+    std::shared_ptr<ScanMemoryPool> pool; // NULL for Arrow's; outlives the rest
+    std::shared_ptr<ReaderCounters> counters; // NULL if not counted
+    std::shared_ptr<arrow::io::RandomAccessFile> source; // what `reader` reads
+    std::unique_ptr<parquet::arrow::FileReader> reader;
+    std::shared_ptr<parquet::FileMetaData> metadata;
+    std::vector<ColumnConverter> columns; // one per tuple attribute
+    std::vector<std::unique_ptr<TextDictionary>> dictionaries; // of `columns`
+    std::vector<int> leaves;              // parquet leaf columns to decode
+    std::vector<PushedFilter> filters;
+    std::vector<int> row_groups;       // to read in this order; empty for all
+    int next_row_group;                // index into row_groups, or the file's
+    std::atomic<int64_t> row_groups_pruned; // also by the prefetch thread
+    int64_t row_groups_pruned_pages;   // of those, by the column index
+    std::atomic<int64_t> row_groups_pruned_bloom; // or by bloom filters
+    bool lookups_loaded;               // see load_lookups
+    bool ordered;                      // row_groups are ranked, see plan_order
+    Oid order_typid;
+    KeyKind order_kind;
+    bool order_desc;
+    std::vector<RowGroupRank> ranks;   // per row group of the file
+    bool has_bound;
+    FilterKey bound;                   // see parquet_reader_set_bound
+    int64_t limit;                     // rows the scan expects, 0 if all
+    int64_t rows_read;                 // rows of the row groups decoded so far
+    std::vector<SummaryColumn> summary; // see parquet_reader_summarize
+    bool summarizing;
+    int64_t summary_rows;
+    int64_t row_groups_summarized;
+    std::unique_ptr<RowGroupPrefetcher> prefetch; // stopped before `reader`
+    std::shared_ptr<arrow::Table> table;
+    std::unique_ptr<arrow::TableBatchReader> batches;
+    std::shared_ptr<arrow::RecordBatch> batch;
+    std::vector<std::shared_ptr<arrow::Array>> arrays; // columns of `batch`
+    std::vector<uint8_t> keep;         // per batch row, scratch for filters
+    std::vector<int32_t> selection;    // batch rows passing the filters
+    int64_t rows_filtered;
+    int64_t filter_usecs;              // when timed, in select_rows
+    int64_t convert_usecs;             // when timed, in parquet_reader_next
+    int64_t batch_rows;                // rows the cursor will visit
+    int64_t row;
+};
+
+static bool reader_timed(const ParquetReader *reader) {
+    return reader->counters && reader->counters->timed;
+}
+
+/* Rows per record batch, small enough for the filter scratch to stay cached. */
+static const int64_t kBatchRows = 64 * 1024;
+
+/*
+ * Equality lookups: loads the column index of every row group for each
+ * equality filter into its `pages`. Writers keep all column indexes together
+ * ahead of the footer, so they are fetched in one read rather than one per
+ * row group, each a round trip on S3. An index that cannot be parsed is
+ * left out, as they only serve pruning. Also sets up the file's bloom filter
+ * reader, which bloom_may_match then uses from the prefetch thread.
+ */
+static void load_lookups(ParquetReader *reader) {
+    reader->lookups_loaded = true;
+    const parquet::FileMetaData &metadata = *reader->metadata;
+    int64_t begin = std::numeric_limits<int64_t>::max(), end = 0;
+    for (const PushedFilter &f : reader->filters) {
+        if (f.op != PARQUET_FILTER_EQ || f.leaf < 0)
+            continue;
+        for (int rg = 0; rg < metadata.num_row_groups(); ++rg) {
+            std::optional<parquet::IndexLocation> loc =
+                metadata.RowGroup(rg)->ColumnChunk(f.leaf)
+                    ->GetColumnIndexLocation();
+            if (!loc)
+                continue;
+            begin = std::min(begin, loc->offset);
+            end = std::max(end, loc->offset + loc->length);
+        }
+    }
+    reader->reader->parquet_reader()->GetBloomFilterReader();
+    if (begin >= end)
+        return;
+
+    PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Buffer> indexes,
+                            reader->source->ReadAt(begin, end - begin));
+    if (indexes->size() < end - begin)
+        return;
+    for (PushedFilter &f : reader->filters) {
+        if (f.op != PARQUET_FILTER_EQ || f.leaf < 0)
+            continue;
+        const parquet::ColumnDescriptor *descr =
+            metadata.schema()->Column(f.leaf);
+        f.pages.resize(metadata.num_row_groups());
+        for (int rg = 0; rg < metadata.num_row_groups(); ++rg) {
+            std::optional<parquet::IndexLocation> loc =
+                metadata.RowGroup(rg)->ColumnChunk(f.leaf)
+                    ->GetColumnIndexLocation();
+            if (!loc)
+                continue;
+            try {
+                f.pages[rg] = parquet::ColumnIndex::Make(
+                    *descr, indexes->data() + (loc->offset - begin),
+                    loc->length, parquet::default_reader_properties());
+            } catch (const parquet::ParquetException &) {
+            }
+        }
+    }
+}
+
+/*
+ * Equality lookups: whether a page of the column chunk may hold the value,
+ * going by the min/max the column index keeps per page. Those are tighter
+ * than the chunk's when values are clustered. True if the file has no column
+ * index for the chunk.
+ */
+static bool pages_may_match(ParquetReader *reader, int rg,
+                            const PushedFilter &f) {
+    if (f.pages.empty() || !f.pages[rg])
+        return true;
+    const parquet::ColumnIndex *index = f.pages[rg].get();
+
+    const parquet::ColumnDescriptor *descr =
+        reader->metadata->schema()->Column(f.leaf);
+    const std::vector<bool> &null_pages = index->null_pages();
+    for (size_t p = 0; p < null_pages.size(); ++p) {
+        /* Comparisons never match NULL. */
+        if (null_pages[p])
+            continue;
+        std::shared_ptr<parquet::Statistics> st = parquet::Statistics::Make(
+            descr, index->encoded_min_values()[p],
+            index->encoded_max_values()[p], 1, 0, 0, true, false, false);
+        FilterKey min, max;
+        if (!stats_keys(*st, f.kind, *f.type, f.typid, &min, &max) ||
+            filter_may_match(f, min, max))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * The value an equality filter looks up, as the column stores it: the
+ * inverse of the conversions stat_int_key applies, where exactly one stored
+ * value converts to it. Returns false otherwise; text is looked up as is.
+ */
+static bool stored_value(const PushedFilter &f, parquet::Type::type physical,
+                         int64_t *raw) {
+    if (f.kind == KeyKind::BYTES) {
+        switch (f.type->id()) {
+        case arrow::Type::STRING:
+        case arrow::Type::BINARY:
+        case arrow::Type::LARGE_STRING:
+        case arrow::Type::LARGE_BINARY:
+            return physical == parquet::Type::BYTE_ARRAY;
+        default:
+            return false;
+        }
+    }
+    if (f.kind != KeyKind::INT)
+        return false;
+
+    int64_t v = f.lo.i;
+    int64_t mult, div;
+    switch (f.type->id()) {
+    case arrow::Type::INT8:
+    case arrow::Type::INT16:
+    case arrow::Type::INT32:
+    case arrow::Type::INT64:
+    case arrow::Type::UINT8:
+    case arrow::Type::UINT16:
+    case arrow::Type::UINT32:
+        if (f.typid != INT2OID && f.typid != INT4OID && f.typid != INT8OID)
+            return false;
+        break;
+    case arrow::Type::DATE32:
+        if (f.typid != DATEOID)
+            return false;
+        v += kUnixEpochDays;
+        break;
+    case arrow::Type::TIMESTAMP:
+        if (f.typid != TIMESTAMPOID && f.typid != TIMESTAMPTZOID)
+            return false;
+        timestamp_unit_factors(*f.type, &mult, &div);
+        v += kUnixEpochUsecs;
+        if (div > 1 || v % mult != 0)
+            return false;
+        v /= mult;
+        break;
+    default:
+        return false;
+    }
+
+    if (physical == parquet::Type::INT64) {
+        *raw = v;
+        return true;
+    }
+    if (physical != parquet::Type::INT32)
+        return false;
+    if (f.type->id() == arrow::Type::UINT32) {
+        if (v < 0 || v > std::numeric_limits<uint32_t>::max())
+            return false;
+        *raw = static_cast<int32_t>(static_cast<uint32_t>(v));
+        return true;
+    }
+    if (v < std::numeric_limits<int32_t>::min() ||
+        v > std::numeric_limits<int32_t>::max())
+        return false;
+    *raw = v;
+    return true;
+}
+
+/*
+ * Equality lookups: whether the bloom filter of the column chunk, if it has
+ * one that can be read, may hold the value.
+ */
+static bool bloom_may_match(ParquetReader *reader, int rg,
+                            const parquet::ColumnChunkMetaData &chunk,
+                            const PushedFilter &f) {
+    int64_t raw = 0;
+    if (!chunk.bloom_filter_offset() || !stored_value(f, chunk.type(), &raw))
+        return true;
+    std::unique_ptr<parquet::BloomFilter> bloom;
+    try {
+        std::shared_ptr<parquet::RowGroupBloomFilterReader> row_group =
+            reader->reader->parquet_reader()->GetBloomFilterReader().RowGroup(
+                rg);
+        if (row_group)
+            bloom = row_group->GetColumnBloomFilter(f.leaf);
+    } catch (const parquet::ParquetException &) {
+    }
+    if (!bloom)
+        return true;
+    uint64_t hash;
+    if (chunk.type() == parquet::Type::BYTE_ARRAY)
+        hash = bloom->Hash(std::string_view(f.lo.s));
+    else if (chunk.type() == parquet::Type::INT32)
+        hash = bloom->Hash(static_cast<int32_t>(raw));
+    else
+        hash = bloom->Hash(raw);
+    return bloom->FindHash(hash);
+}
+
+/*
+ * Equality lookups: whether the bloom filters of row group `rg` may hold the
+ * values looked up, counting it as pruned if not. Each filter costs a read,
+ * so this is only asked as the row group comes up for decoding, on the
+ * prefetch thread if there is one.
+ */
+static bool blooms_may_match(ParquetReader *reader, int rg) {
+    std::unique_ptr<parquet::RowGroupMetaData> meta;
+    for (const PushedFilter &f : reader->filters) {
+        if (f.op != PARQUET_FILTER_EQ || f.leaf < 0)
+            continue;
+        if (!meta)
+            meta = reader->metadata->RowGroup(rg);
+        if (!bloom_may_match(reader, rg, *meta->ColumnChunk(f.leaf), f)) {
+            reader->row_groups_pruned++;
+            reader->row_groups_pruned_bloom++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Checks the pushed filters against the column chunk statistics of row group
+ * `rg`. Equality filters they let through are then checked against the
+ * column index, which load_lookups reads for all row groups at once; bloom
+ * filters are left to blooms_may_match. Returns false only if no row in it
+ * can pass every filter.
+ */
+static bool row_group_may_match(ParquetReader *reader, int rg) {
+    if (reader->filters.empty())
+        return true;
+    std::unique_ptr<parquet::RowGroupMetaData> meta =
+        reader->metadata->RowGroup(rg);
+
+    for (const PushedFilter &f : reader->filters) {
+        /* Attributes missing from the file read as NULL and match nothing. */
+        if (f.column < 0)
+            return false;
+        if (f.leaf < 0)
+            continue;
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk =
+            meta->ColumnChunk(f.leaf);
+        if (!chunk->is_stats_set())
+            continue;
+        std::shared_ptr<parquet::Statistics> st = chunk->statistics();
+        if (!st)
+            continue;
+        /* Comparisons never match NULL. */
+        if (st->HasNullCount() && st->null_count() >= meta->num_rows())
+            return false;
+        if (!st->HasMinMax())
+            continue;
+        FilterKey min, max;
+        if (stats_keys(*st, f.kind, *f.type, f.typid, &min, &max) &&
+            !filter_may_match(f, min, max))
+            return false;
+    }
+
+    for (const PushedFilter &f : reader->filters) {
+        if (f.op != PARQUET_FILTER_EQ || f.leaf < 0)
+            continue;
+        if (!reader->lookups_loaded)
+            load_lookups(reader);
+        if (!pages_may_match(reader, rg, f)) {
+            reader->row_groups_pruned_pages++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Runs the filters over the current batch and fills in the selection vector.
+ * Returns the number of rows that pass.
+ */
+static int64_t select_rows(ParquetReader *reader) {
+    int64_t n = reader->batch->num_rows();
+    if (reader->filters.empty())
+        return n;
+
+    int64_t start = reader_timed(reader) ? now_usecs() : 0;
+    reader->keep.assign(n, 1);
+    uint8_t *keep = reader->keep.data();
+    for (const PushedFilter &f : reader->filters) {
+        const arrow::Array &arr = *reader->arrays[f.column];
+        if (arr.null_count() > 0) {
+            for (int64_t i = 0; i < n; ++i)
+                keep[i] &= arr.IsValid(i);
+        }
+        f.eval(arr, f, reader->columns[f.attnum], keep);
+    }
+
+    reader->selection.clear();
+    for (int64_t i = 0; i < n; ++i)
+        if (keep[i])
+            reader->selection.push_back(static_cast<int32_t>(i));
+    int64_t selected = reader->selection.size();
+    reader->rows_filtered += n - selected;
+    if (start)
+        reader->filter_usecs += now_usecs() - start;
+    return selected;
+}
+
+/* Top-N scans: whether no row of row group rg can beat the bound. */
+static bool row_group_beaten(const ParquetReader *reader, int rg) {
+    const RowGroupRank &rank = reader->ranks[rg];
+    if (!reader->has_bound || rank.tier == 0)
+        return false;
+    if (rank.tier == 2)
+        return true;
+    return reader->order_desc
+               ? key_less(rank.key, reader->bound, reader->order_kind)
+               : key_less(reader->bound, rank.key, reader->order_kind);
+}
+
+/*
+ * Aggregate scans: if the statistics of row group rg show that every row
+ * passes the filters and give what the summary wants of each attribute,
+ * adds them to it and returns true; the row group need not be decoded.
+ */
+static bool summarize_row_group(ParquetReader *reader, int rg) {
+    std::unique_ptr<parquet::RowGroupMetaData> meta =
+        reader->metadata->RowGroup(rg);
+    int64_t rows = meta->num_rows();
+    auto chunk_stats = [&](int leaf) -> std::shared_ptr<parquet::Statistics> {
+        if (leaf < 0)
+            return nullptr;
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk =
+            meta->ColumnChunk(leaf);
+        if (!chunk->is_stats_set())
+            return nullptr;
+        std::shared_ptr<parquet::Statistics> st = chunk->statistics();
+        return st && st->HasNullCount() ? st : nullptr;
+    };
+
+    for (const PushedFilter &f : reader->filters) {
+        std::shared_ptr<parquet::Statistics> st = chunk_stats(f.leaf);
+        FilterKey min, max;
+        if (!st || st->null_count() > 0 || !st->HasMinMax() ||
+            !stats_keys(*st, f.kind, *f.type, f.typid, &min, &max) ||
+            !filter_all_match(f, min, max))
+            return false;
+    }
+
+    std::vector<SummaryColumn> add(reader->summary.size());
+    for (size_t i = 0; i < reader->summary.size(); ++i) {
+        const SummaryColumn &c = reader->summary[i];
+        SummaryColumn &a = add[i];
+        a.nonnull = rows;
+        if (c.attnum < 0)
+            continue;
+        a.nonnull = 0;
+        if (c.missing)
+            continue;
+        std::shared_ptr<parquet::Statistics> st = chunk_stats(c.leaf);
+        if (!st)
+            return false;
+        a.nonnull = rows - st->null_count();
+        if (!c.bounds || a.nonnull <= 0)
+            continue;
+        Datum d;
+        if (c.kind != KeyKind::INT || !st->HasMinMax() ||
+            !stats_keys(*st, c.kind, *c.type, c.typid, &a.min, &a.max) ||
+            !int_key_datum(a.min, c.typid, &d) ||
+            !int_key_datum(a.max, c.typid, &d))
+            return false;
+        a.has_bounds = true;
+    }
+
+    for (size_t i = 0; i < reader->summary.size(); ++i) {
+        SummaryColumn &c = reader->summary[i];
+        const SummaryColumn &a = add[i];
+        c.nonnull += a.nonnull;
+        if (!a.has_bounds)
+            continue;
+        if (!c.has_bounds || a.min.i < c.min.i)
+            c.min = a.min;
+        if (!c.has_bounds || c.max.i < a.max.i)
+            c.max = a.max;
+        c.has_bounds = true;
+    }
+    reader->summary_rows += rows;
+    reader->row_groups_summarized++;
+    return true;
+}
+
+/*
+ * The next row group to read that may hold rows passing the filters, or -1
+ * at the end of the file or of the selected row groups. Aggregate scans go
+ * past the row groups they can summarize. Ranked row groups
+ * end at the first one the bound beats, as the rest rank no better.
+ */
+static int next_row_group(ParquetReader *reader) {
+    for (;;) {
+        int rg;
+        if (reader->row_groups.empty()) {
+            if (reader->next_row_group >= reader->reader->num_row_groups())
+                return -1;
+            rg = reader->next_row_group++;
+        } else {
+            if (reader->next_row_group >= (int)reader->row_groups.size())
+                return -1;
+            rg = reader->row_groups[reader->next_row_group++];
+        }
+        if (reader->ordered && row_group_beaten(reader, rg)) {
+            int left = (int)reader->row_groups.size() - reader->next_row_group;
+            reader->row_groups_pruned += left + 1;
+            reader->next_row_group = (int)reader->row_groups.size();
+            return -1;
+        }
+        if (!row_group_may_match(reader, rg))
+            reader->row_groups_pruned++;
+        else if (!reader->summarizing || !summarize_row_group(reader, rg))
+            return rg;
+    }
+}
+
+/*
+ * Whether the rows a LIMIT wants are all in the row groups read so far and
+ * row group rg. Only known without filters.
+ */
+static bool within_limit(const ParquetReader *reader, int rg) {
+    return reader->limit > 0 && reader->filters.empty() &&
+           reader->rows_read + reader->metadata->RowGroup(rg)->num_rows() >=
+               reader->limit;
+}
+
+/*
+ * Decodes the next row group into `table`, skipping those whose bloom filters
+ * rule it out. The first time more than one is left, the rest are handed to
+ * a prefetcher. Ranked row groups are decoded one at a time, as the bound may
+ * change after each, and so are those past the last one a LIMIT wants.
+ * Returns false at the end.
+ */
+static bool read_row_group(ParquetReader *reader) {
+    while (!reader->prefetch) {
+        int rg = next_row_group(reader);
+        if (rg < 0)
+            return false;
+        int following = icebergc_prefetch_row_groups > 0 && !reader->ordered &&
+                                !within_limit(reader, rg)
+                            ? next_row_group(reader)
+                            : -1;
+        if (following < 0) {
+            if (!blooms_may_match(reader, rg))
+                continue;
+            int64_t start = reader_timed(reader) ? now_usecs() : 0;
+            PARQUET_ASSIGN_OR_THROW(
+                reader->table, reader->reader->ReadRowGroup(rg, reader->leaves));
+            if (start)
+                reader->counters->decode_usecs += now_usecs() - start;
+            reader->rows_read += reader->table->num_rows();
+            return true;
+        }
+        std::vector<int> rgs = {rg, following};
+        for (int next; (next = next_row_group(reader)) >= 0;)
+            rgs.push_back(next);
+        reader->prefetch.reset(new RowGroupPrefetcher(
+            reader->reader.get(), reader->leaves, std::move(rgs),
+            [reader](int group) { return blooms_may_match(reader, group); },
+            icebergc_prefetch_row_groups, reader->pool.get(),
+            reader->counters.get()));
+    }
+    reader->table = reader->prefetch->Next();
+    if (reader->table)
+        return true;
+    reader->prefetch.reset();
+    return false;
+}
+
+/*
+ * Moves the cursor to the next record batch with rows to return, decoding the
+ * next row group when the current one is exhausted. Returns false at end of
+ * file.
+ */
+static bool advance_batch(ParquetReader *reader) {
+    for (;;) {
+        if (reader->batches) {
+            PARQUET_THROW_NOT_OK(reader->batches->ReadNext(&reader->batch));
+            reader->row = 0;
+            if (reader->batch) {
+                if (reader->batch->num_rows() == 0)
+                    continue;
+                reader->arrays = reader->batch->columns();
+                reader->batch_rows = select_rows(reader);
+                if (reader->batch_rows > 0)
+                    return true;
+                continue;
+            }
+            reader->batches.reset();
+            reader->table.reset();
+        }
+        /* Nothing is under the cursor until another row group is read. */
+        reader->row = reader->batch_rows = 0;
+        if (reader->leaves.empty()) {
+            int rg = next_row_group(reader);
+            if (rg < 0)
+                return false;
+            reader->batch_rows = reader->metadata->RowGroup(rg)->num_rows();
+            if (reader->batch_rows > 0)
+                return true;
+            continue;
+        }
+        if (!read_row_group(reader))
+            return false;
+        reader->batches.reset(new arrow::TableBatchReader(*reader->table));
+        reader->batches->set_chunksize(kBatchRows);
+    }
+}
+
+/* Top-level field for a column name; exact match first, then ignoring case. */
+static int find_field(const arrow::Schema &schema, const char *name) {
+    int idx = schema.GetFieldIndex(name);
+    if (idx >= 0)
+        return idx;
+    for (int i = 0; i < schema.num_fields(); ++i)
+        if (pg_strcasecmp(schema.field(i)->name().c_str(), name) == 0)
+            return i;
+    return -1;
+}
+
+static void collect_leaves(const parquet::arrow::SchemaField &field,
+                           std::vector<int> &leaves) {
+    if (field.is_leaf()) {
+        leaves.push_back(field.column_index);
+        return;
+    }
+    for (const auto &child : field.children)
+        collect_leaves(child, leaves);
+}
+
+/* Whether the scan reads attribute i, for output or for a filter. */
+static std::vector<bool> scan_attrs(const ParquetScanSpec *spec) {
+    TupleDesc tupdesc = spec->tupdesc;
+    std::vector<bool> used(tupdesc->natts, spec->attrs_used == NULL);
+    for (int i = 0; spec->attrs_used && i < tupdesc->natts; ++i)
+        used[i] = spec->attrs_used[i];
+    for (int i = 0; i < spec->nfilters; ++i)
+        used[spec->filters[i].attnum] = true;
+    for (int i = 0; i < tupdesc->natts; ++i)
+        used[i] = used[i] && !TupleDescAttr(tupdesc, i)->attisdropped;
+    return used;
+}
+
+/*
+ * Resolves the attributes the scan reads to top-level fields by name: the
+ * field per attribute (-1 if unused or absent) and the sorted set of them.
+ */
+static void scan_fields(const ParquetScanSpec *spec,
+                        const arrow::Schema &schema,
+                        std::vector<int> *attr_field, std::vector<int> *fields) {
+    TupleDesc tupdesc = spec->tupdesc;
+    std::vector<bool> used = scan_attrs(spec);
+
+    attr_field->assign(tupdesc->natts, -1);
+    fields->clear();
+    for (int i = 0; i < tupdesc->natts; ++i) {
+        if (!used[i])
+            continue;
+        (*attr_field)[i] =
+            find_field(schema, NameStr(TupleDescAttr(tupdesc, i)->attname));
+        if ((*attr_field)[i] >= 0)
+            fields->push_back((*attr_field)[i]);
+    }
+    std::sort(fields->begin(), fields->end());
+    fields->erase(std::unique(fields->begin(), fields->end()), fields->end());
+}
+
+/*
+ * Sets up the leaf columns to decode for the attributes the scan reads.
+ * Converters index the decoded batch, whose columns are the selected fields
+ * in schema order.
+ */
+static void plan_projection(ParquetReader *reader, const ParquetScanSpec *spec,
+                            const arrow::Schema &schema) {
+    TupleDesc tupdesc = spec->tupdesc;
+    std::vector<int> attr_field, fields;
+    scan_fields(spec, schema, &attr_field, &fields);
+
+    const parquet::arrow::SchemaManifest &manifest = reader->reader->manifest();
+    reader->leaves.clear();
+    for (int f : fields)
+        collect_leaves(manifest.schema_fields[f], reader->leaves);
+
+    reader->columns.resize(tupdesc->natts);
+    for (int i = 0; i < tupdesc->natts; ++i) {
+        int pos = -1;
+        if (attr_field[i] >= 0)
+            pos = std::lower_bound(fields.begin(), fields.end(), attr_field[i]) -
+                  fields.begin();
+        init_converter(reader->columns[i], pos,
+                       pos >= 0 ? schema.field(attr_field[i]).get() : NULL,
+                       TupleDescAttr(tupdesc, i));
+    }
+}
+
+/*
+ * Text attributes read from dictionary-encoded string columns (judging by the
+ * first row group) are decoded as dictionary arrays, so that each distinct
+ * value is converted once per row group rather than once per row. Returns
+ * the leaf columns to decode so; the reader must be reopened to read them.
+ * Must run after plan_projection.
+ */
+static std::vector<int> plan_dictionaries(ParquetReader *reader,
+                                          const ParquetScanSpec *spec,
+                                          const arrow::Schema &schema) {
+    std::vector<int> leaves;
+    if (reader->metadata->num_row_groups() == 0)
+        return leaves;
+    std::unique_ptr<parquet::RowGroupMetaData> meta =
+        reader->metadata->RowGroup(0);
+    const parquet::arrow::SchemaManifest &manifest = reader->reader->manifest();
+
+    for (size_t i = 0; i < reader->columns.size(); ++i) {
+        ColumnConverter &conv = reader->columns[i];
+        if (conv.convert != string_to_text<arrow::BinaryArray>)
+            continue;
+        int field = find_field(
+            schema, NameStr(TupleDescAttr(spec->tupdesc, (int)i)->attname));
+        const parquet::arrow::SchemaField &sf = manifest.schema_fields[field];
+        if (!sf.is_leaf() ||
+            !meta->ColumnChunk(sf.column_index)->has_dictionary_page())
+            continue;
+        reader->dictionaries.emplace_back(new TextDictionary());
+        conv.dict = reader->dictionaries.back().get();
+        conv.convert = dictionary_to_text;
+        leaves.push_back(sf.column_index);
+    }
+    return leaves;
+}
+
+/*
+ * Sets up the filters the reader can evaluate exactly (see
+ * parquet_filter_exact); the others are ignored. Filters on primitive columns
+ * are also checked against row group statistics. Must run after
+ * plan_projection.
+ */
+static void plan_filters(ParquetReader *reader, const ParquetScanSpec *spec,
+                         const arrow::Schema &schema) {
+    const parquet::arrow::SchemaManifest &manifest = reader->reader->manifest();
+
+    for (int i = 0; i < spec->nfilters; ++i) {
+        const ParquetFilter &pf = spec->filters[i];
+        Form_pg_attribute attr = TupleDescAttr(spec->tupdesc, pf.attnum);
+
+        PushedFilter f;
+        f.attnum = pf.attnum;
+        f.column = reader->columns[pf.attnum].field;
+        f.leaf = -1;
+        f.op = pf.op;
+        f.typid = attr->atttypid;
+        f.kind = key_kind(f.typid);
+        f.eval = NULL;
+        if (!filter_exact(f.kind, f.op))
+            continue;
+        if (f.column >= 0) {
+            int field = find_field(schema, NameStr(attr->attname));
+            if (manifest.schema_fields[field].is_leaf())
+                f.leaf = manifest.schema_fields[field].column_index;
+            f.type = schema.field(field)->type();
+            f.eval = reader->columns[f.attnum].dict
+                         ? filter_dictionary_strings
+                         : pick_filter(*f.type, f.typid);
+        }
+        f.lo = datum_key(pf.value1, f.typid);
+        if (pf.op == PARQUET_FILTER_BETWEEN)
+            f.hi = datum_key(pf.value2, f.typid);
+        reader->filters.push_back(std::move(f));
+    }
+}
+
+/*
+ * Top-N scans: ranks the row groups by the statistics of the order attribute
+ * and reads them best first. Must run after plan_projection.
+ */
+static void plan_order(ParquetReader *reader, const ParquetScanSpec *spec,
+                       const arrow::Schema &schema) {
+    Form_pg_attribute attr = TupleDescAttr(spec->tupdesc, spec->order_attnum);
+    reader->ordered = true;
+    reader->order_typid = attr->atttypid;
+    reader->order_kind = key_kind(attr->atttypid);
+    reader->order_desc = spec->order_desc;
+
+    int leaf = -1;
+    std::shared_ptr<arrow::DataType> type;
+    bool missing = reader->columns[spec->order_attnum].field < 0;
+    if (!missing) {
+        int field = find_field(schema, NameStr(attr->attname));
+        const parquet::arrow::SchemaField &sf =
+            reader->reader->manifest().schema_fields[field];
+        if (sf.is_leaf())
+            leaf = sf.column_index;
+        type = schema.field(field)->type();
+    }
+
+    int n = reader->metadata->num_row_groups();
+    reader->ranks.assign(n, RowGroupRank());
+    for (int rg = 0; rg < n; ++rg) {
+        RowGroupRank &rank = reader->ranks[rg];
+        /* Attributes missing from the file read as NULL. */
+        if (missing) {
+            rank.tier = spec->order_nulls_first ? 0 : 2;
+            continue;
+        }
+        if (leaf < 0)
+            continue;
+        std::unique_ptr<parquet::RowGroupMetaData> meta =
+            reader->metadata->RowGroup(rg);
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk =
+            meta->ColumnChunk(leaf);
+        std::shared_ptr<parquet::Statistics> st =
+            chunk->is_stats_set() ? chunk->statistics() : nullptr;
+        if (!st || !st->HasNullCount() ||
+            (st->null_count() > 0 && spec->order_nulls_first))
+            continue;
+        if (st->null_count() >= meta->num_rows()) {
+            rank.tier = 2;
+            continue;
+        }
+        FilterKey min, max;
+        if (!st->HasMinMax() ||
+            !stats_keys(*st, reader->order_kind, *type, reader->order_typid,
+                        &min, &max))
+            continue;
+        /* NaN does not order; it sorts above all in Postgres. */
+        if (reader->order_kind == KeyKind::FLOAT &&
+            (std::isnan(min.f) || std::isnan(max.f)))
+            continue;
+        rank.tier = 1;
+        rank.key = spec->order_desc ? max : min;
+    }
+
+    reader->row_groups.resize(n);
+    for (int rg = 0; rg < n; ++rg)
+        reader->row_groups[rg] = rg;
+    std::stable_sort(reader->row_groups.begin(), reader->row_groups.end(),
+                     [reader](int a, int b) {
+                         const RowGroupRank &x = reader->ranks[a];
+                         const RowGroupRank &y = reader->ranks[b];
+                         if (x.tier != y.tier)
+                             return x.tier < y.tier;
+                         if (x.tier != 1)
+                             return false;
+                         return reader->order_desc
+                                    ? key_less(y.key, x.key, reader->order_kind)
+                                    : key_less(x.key, y.key, reader->order_kind);
+                     });
+}
+
+std::vector<RowTuple> parse_parquet_buffer(const uint8_t *data,
+                                           size_t length,
+                                           size_t max_rows) {
+    ParquetReader reader{};
+    reader.reader = open_arrow_reader(std::make_shared<arrow::io::BufferReader>(
+        std::make_shared<arrow::Buffer>(data, length)));
+    reader.metadata = reader.reader->parquet_reader()->metadata();
+    int num_leaves = reader.metadata->num_columns();
+    for (int i = 0; i < num_leaves; ++i)
+        reader.leaves.push_back(i);
+
+    std::vector<RowTuple> rows;
+    while (!reader.leaves.empty() && rows.size() < max_rows &&
+           advance_batch(&reader)) {
+        const arrow::RecordBatch &batch = *reader.batch;
+        int num_cols = batch.num_columns();
+        int64_t n = std::min<int64_t>(batch.num_rows(), max_rows - rows.size());
+        for (int64_t r = 0; r < n; ++r) {
+            RowTuple row;
+            row.columns.reserve(num_cols);
+            for (int c = 0; c < num_cols; ++c)
+                row.columns.push_back(read_cell(*batch.column(c), r));
+            rows.push_back(std::move(row));
+        }
+    }
+
+    return rows;
+}
+
+int icebergc_metadata_cache_size = 16 * 1024;
+
+/*
+ * Parsed footers of recently opened files, least recently used first, keyed
+ * by path and version so a rewritten file is parsed again. Bounded by the
+ * serialized footer sizes against icebergc_fdw.metadata_cache_size. Only the
+ * backend thread uses it.
+ */
+struct MetadataCacheEntry {
+    std::string key;
+    std::shared_ptr<parquet::FileMetaData> metadata;
+    int64_t size;
+};
+static std::list<MetadataCacheEntry> metadata_lru;
+static std::unordered_map<std::string, std::list<MetadataCacheEntry>::iterator>
+    metadata_index;
+static int64_t metadata_cached_bytes;
+
+static std::shared_ptr<parquet::FileMetaData>
+file_metadata(const std::shared_ptr<arrow::io::RandomAccessFile> &source,
+              const std::string &key) {
+    int64_t limit = (int64_t)icebergc_metadata_cache_size * 1024;
+    /* The limit may have been lowered since the last call. */
+    while (metadata_cached_bytes > limit) {
+        metadata_cached_bytes -= metadata_lru.front().size;
+        metadata_index.erase(metadata_lru.front().key);
+        metadata_lru.pop_front();
+    }
+
+    auto it = metadata_index.find(key);
+    if (it != metadata_index.end()) {
+        metadata_lru.splice(metadata_lru.end(), metadata_lru, it->second);
+        return it->second->metadata;
+    }
+
+    std::shared_ptr<parquet::FileMetaData> metadata =
+        parquet::ReadMetaData(source);
+    int64_t size = metadata->size();
+    if (size > limit)
+        return metadata;
+    while (metadata_cached_bytes + size > limit) {
+        metadata_cached_bytes -= metadata_lru.front().size;
+        metadata_index.erase(metadata_lru.front().key);
+        metadata_lru.pop_front();
+    }
+    metadata_cached_bytes += size;
+    metadata_index[key] =
+        metadata_lru.insert(metadata_lru.end(), {key, metadata, size});
+    return metadata;
+}
+
+/*
+ * Paths as Iceberg writers record them: s3a:// and s3n:// are s3://, and
+ * file: URIs are local paths.
+ */
+static std::string normalize_path(const std::string &path) {
+    if (path.rfind("s3a://", 0) == 0 || path.rfind("s3n://", 0) == 0)
+        return "s3://" + path.substr(6);
+    if (path.rfind("file://", 0) == 0)
+        return path.substr(7);
+    if (path.rfind("file:", 0) == 0)
+        return path.substr(5);
+    return path;
+}
+
+static void split_s3_path(const std::string &path, std::string *bucket,
+                          std::string *key) {
+    auto pos = path.find('/', 5);
+    if (pos == std::string::npos)
+        throw std::runtime_error("s3 path has no object key: " + path);
+    *bucket = path.substr(5, pos - 5);
+    *key = path.substr(pos + 1);
+}
+
+/*
+ * Adds the reads of a file to a reader's counters: to `bytes`, and the time
+ * until their data is there to `fetch_usecs` if timed. Wrapped around the S3
+ * or HDFS file itself, below the local cache, it counts `remote_bytes`
+ * instead.
+ */
+class CountedFile : public arrow::io::RandomAccessFile {
+public:
+    CountedFile(std::shared_ptr<arrow::io::RandomAccessFile> source,
+                std::shared_ptr<ReaderCounters> counters, bool remote)
+        : source_(std::move(source)), counters_(std::move(counters)),
+          remote_(remote) {}
+
+    using arrow::io::RandomAccessFile::ReadAsync;
+    using arrow::io::RandomAccessFile::ReadAt;
+
+    arrow::Status Close() override { return source_->Close(); }
+    bool closed() const override { return source_->closed(); }
+    arrow::Result<int64_t> GetSize() override { return source_->GetSize(); }
+    arrow::Result<int64_t> Tell() const override { return source_->Tell(); }
+    arrow::Status Seek(int64_t position) override {
+        return source_->Seek(position);
+    }
+    bool supports_zero_copy() const override {
+        return source_->supports_zero_copy();
+    }
+    arrow::Status WillNeed(const std::vector<arrow::io::ReadRange> &ranges) override {
+        return source_->WillNeed(ranges);
+    }
+
+    arrow::Result<int64_t> Read(int64_t nbytes, void *out) override {
+        int64_t start = Start();
+        ARROW_ASSIGN_OR_RAISE(int64_t n, source_->Read(nbytes, out));
+        Count(*counters_, remote_, n, start);
+        return n;
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override {
+        int64_t start = Start();
+        ARROW_ASSIGN_OR_RAISE(auto buf, source_->Read(nbytes));
+        Count(*counters_, remote_, buf->size(), start);
+        return buf;
+    }
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  bool allow_short_read, void *out) override {
+        int64_t start = Start();
+        ARROW_ASSIGN_OR_RAISE(
+            int64_t n, source_->ReadAt(position, nbytes, allow_short_read, out));
+        Count(*counters_, remote_, n, start);
+        return n;
+    }
+    arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes,
+                                  void *out) override {
+        return ReadAt(position, nbytes, true, out);
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>>
+    ReadAt(int64_t position, int64_t nbytes, bool allow_short_read) override {
+        int64_t start = Start();
+        ARROW_ASSIGN_OR_RAISE(
+            auto buf, source_->ReadAt(position, nbytes, allow_short_read));
+        Count(*counters_, remote_, buf->size(), start);
+        return buf;
+    }
+    arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position,
+                                                         int64_t nbytes) override {
+        return ReadAt(position, nbytes, true);
+    }
+
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &ctx, int64_t position, int64_t nbytes,
+              bool allow_short_read) override {
+        int64_t start = Start();
+        std::shared_ptr<ReaderCounters> counters = counters_;
+        bool remote = remote_;
+        return source_->ReadAsync(ctx, position, nbytes, allow_short_read)
+            .Then([counters, remote, start](const std::shared_ptr<arrow::Buffer> &buf) {
+                Count(*counters, remote, buf->size(), start);
+                return buf;
+            });
+    }
+    arrow::Future<std::shared_ptr<arrow::Buffer>>
+    ReadAsync(const arrow::io::IOContext &ctx, int64_t position,
+              int64_t nbytes) override {
+        return ReadAsync(ctx, position, nbytes, true);
+    }
+
+private:
+    int64_t Start() const {
+        return counters_->timed && !remote_ ? now_usecs() : 0;
+    }
+    static void Count(ReaderCounters &counters, bool remote, int64_t n,
+                      int64_t start) {
+        if (remote) {
+            counters.remote_bytes += n;
+            return;
+        }
+        counters.bytes += n;
+        if (start)
+            counters.fetch_usecs += now_usecs() - start;
+    }
+
+    std::shared_ptr<arrow::io::RandomAccessFile> source_;
+    std::shared_ptr<ReaderCounters> counters_;
+    const bool remote_;
+};
+
+/*
+ * Opens an s3://, hdfs:// or local path for reading and sets *version to a
+ * token that changes whenever the file does. Returns NULL if a local file
+ * does not exist. With `counters`, the reads of S3 and HDFS files that miss
+ * the local cache count as remote.
+ */
+static std::shared_ptr<arrow::io::RandomAccessFile>
+open_source(const std::string &uri, const IcebergcS3Options *s3,
+            std::string *version, bool *remote,
+            const std::shared_ptr<ReaderCounters> &counters = nullptr) {
+    std::string path = normalize_path(uri);
+    std::shared_ptr<arrow::io::RandomAccessFile> source;
+    *remote = false;
+    if (path.rfind("s3://", 0) == 0) {
+        std::string bucket, key;
+        split_s3_path(path, &bucket, &key);
+        IcebergcS3Options defaults = {};
+        source = s3_open_file(s3 ? *s3 : defaults, bucket, key, version);
+        *remote = true;
+    } else if (path.rfind("hdfs://", 0) == 0) {
+        source = hdfs_open_file(path, version);
+        *remote = true;
+    } else {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return NULL;
+        *version = std::to_string((long long)st.st_mtim.tv_sec) + "." +
+                   std::to_string((long)st.st_mtim.tv_nsec) + ":" +
+                   std::to_string((long long)st.st_size);
+        /*
+         * Mapped, so column chunks are decoded straight from the page
+         * cache and only the pages a scan touches are read.
+         */
+        auto file = arrow::io::MemoryMappedFile::Open(
+            path, arrow::io::FileMode::READ);
+        if (!file.ok())
+            return NULL;
+        source = *file;
+    }
+    if (*remote && counters)
+        source = std::make_shared<CountedFile>(std::move(source), counters, true);
+    if (*remote)
+        source = cache_wrap_file(std::move(source), path, *version);
+    return source;
+}
+
+/*
+ * Runs `fn` and rethrows any C++ exception as a Postgres ERROR. The message is
+ * copied out first so no C++ frame is live when ereport() longjmps.
+ */
+template <typename Fn>
+static auto pg_guard(Fn &&fn, const char *what = "parquet read failed")
+    -> decltype(fn()) {
+    char *msg = NULL;
+    try {
+        return fn();
+    } catch (const std::exception &e) {
+        msg = pstrdup(e.what());
+    }
+    ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), errmsg("%s: %s", what, msg)));
+    pg_unreachable();
+}
+
+static IcebergOpenFn iceberg_opener(const IcebergcS3Options *s3) {
+    return [s3](const std::string &path) {
+        std::string version;
+        bool remote;
+        std::shared_ptr<arrow::io::RandomAccessFile> source =
+            open_source(path, s3, &version, &remote);
+        if (!source)
+            throw std::runtime_error(path + ": no such file");
+        return source;
+    };
+}
+
+/*
+ * Parsed table metadata by location. Iceberg never rewrites a metadata file,
+ * a commit writes a new one, so entries cannot go stale; the map is just
+ * cleared when it fills up.
+ */
+static std::unordered_map<std::string, std::shared_ptr<IcebergTable>>
+    iceberg_tables;
+static const size_t kMaxIcebergTables = 16;
+
+static std::shared_ptr<IcebergTable> load_iceberg_table(const IcebergTableRef *ref,
+                                                        const IcebergOpenFn &open,
+                                                        std::string *location) {
+    *location = ref->metadata_location
+                    ? std::string(ref->metadata_location)
+                    : IcebergTable::CurrentMetadata(ref->table_location, open);
+    auto it = iceberg_tables.find(*location);
+    if (it != iceberg_tables.end())
+        return it->second;
+    std::shared_ptr<IcebergTable> table = IcebergTable::Load(*location, open);
+    if (iceberg_tables.size() >= kMaxIcebergTables)
+        iceberg_tables.clear();
+    iceberg_tables[*location] = table;
+    return table;
+}
+
+/* The table column an attribute reads: same name, else ignoring case. */
+static const IcebergField *iceberg_field(const IcebergTable &table,
+                                         const char *name) {
+    for (const IcebergField &f : table.schema())
+        if (f.name == name)
+            return &f;
+    for (const IcebergField &f : table.schema())
+        if (pg_strcasecmp(f.name.c_str(), name) == 0)
+            return &f;
+    return nullptr;
+}
+
+/* Shift from the Postgres epoch to Iceberg's Unix one for dates and times. */
+static int64_t epoch_shift(Oid typid) {
+    switch (typid) {
+    case DATEOID:
+        return kUnixEpochDays;
+    case TIMESTAMPOID:
+    case TIMESTAMPTZOID:
+        return kUnixEpochUsecs;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * The Iceberg form of a filter on an attribute of type `typid` stored in
+ * `field`, if the types agree. Dates and timestamps move to the Unix epoch.
+ */
+static bool iceberg_predicate(const ParquetFilter &pf, Oid typid,
+                              const IcebergField &field, IcebergPredicate *pred) {
+    const std::string &t = field.type;
+    int64_t shift = epoch_shift(typid);
+    bool ok;
+
+    switch (typid) {
+    case BOOLOID:
+        ok = t == "boolean";
+        break;
+    case INT2OID:
+    case INT4OID:
+    case INT8OID:
+        ok = t == "int" || t == "long";
+        break;
+    case DATEOID:
+        ok = t == "date";
+        break;
+    case TIMESTAMPOID:
+    case TIMESTAMPTZOID:
+        ok = t == "timestamp" || t == "timestamptz";
+        break;
+    case FLOAT4OID:
+    case FLOAT8OID:
+        ok = t == "float" || t == "double";
+        break;
+    case TEXTOID:
+    case VARCHAROID:
+        ok = t == "string";
+        break;
+    default:
+        ok = false;
+    }
+    if (!ok)
+        return false;
+
+    /* Same order as ParquetFilterOp. */
+    static const IcebergOp kOps[] = {IcebergOp::EQ, IcebergOp::NE,
+                                     IcebergOp::LT, IcebergOp::LE,
+                                     IcebergOp::GT, IcebergOp::GE,
+                                     IcebergOp::BETWEEN};
+    pred->field_id = field.id;
+    pred->kind = iceberg_key_kind(t);
+    pred->op = kOps[pf.op];
+    FilterKey lo = datum_key(pf.value1, typid);
+    FilterKey hi = pf.op == PARQUET_FILTER_BETWEEN ? datum_key(pf.value2, typid)
+                                                   : FilterKey();
+    /* Infinite timestamps would overflow; they prune nothing anyway. */
+    if (__builtin_add_overflow(lo.i, shift, &pred->lo.i) ||
+        __builtin_add_overflow(hi.i, shift, &pred->hi.i))
+        return false;
+    pred->lo.f = lo.f;
+    pred->lo.s = std::move(lo.s);
+    pred->hi.f = hi.f;
+    pred->hi.s = std::move(hi.s);
+    return true;
+}
+
+/*
+ * The last few scan plans, oldest first, keyed by metadata file, snapshot,
+ * predicates and columns, so that estimating a scan while planning the query
+ * and then running it reads the manifests once. Like the metadata they come
+ * from, plans cannot go stale.
+ */
+static std::deque<std::pair<std::string, std::shared_ptr<const IcebergScanPlan>>>
+    iceberg_plans;
+static const size_t kMaxIcebergPlans = 4;
+
+static void append_key(std::string *key, const IcebergKey &k) {
+    key->append(reinterpret_cast<const char *>(&k.i), sizeof(k.i));
+    key->append(reinterpret_cast<const char *>(&k.f), sizeof(k.f));
+    key->append(std::to_string(k.s.size()) + ':');
+    key->append(k.s);
+}
+
+/*
+ * Plans a scan of the table with the spec's filters, those whose column types
+ * agree, and its columns. pred_filter receives the filter each predicate of
+ * the plan came from.
+ */
+static std::shared_ptr<const IcebergScanPlan>
+iceberg_scan_plan(const IcebergTableRef *ref, const ParquetScanSpec *spec,
+                  std::shared_ptr<IcebergTable> *table,
+                  std::vector<int> *pred_filter) {
+    IcebergOpenFn open = iceberg_opener(ref->s3);
+    std::string location;
+    std::shared_ptr<IcebergTable> t = load_iceberg_table(ref, open, &location);
+    TupleDesc tupdesc = spec->tupdesc;
+
+    std::vector<IcebergPredicate> preds;
+    pred_filter->clear();
+    for (int i = 0; i < spec->nfilters; ++i) {
+        Form_pg_attribute attr = TupleDescAttr(tupdesc, spec->filters[i].attnum);
+        const IcebergField *field = iceberg_field(*t, NameStr(attr->attname));
+        IcebergPredicate pred;
+        if (field && iceberg_predicate(spec->filters[i], attr->atttypid, *field,
+                                       &pred)) {
+            preds.push_back(std::move(pred));
+            pred_filter->push_back(i);
+        }
+    }
+    std::vector<int> columns;
+    std::vector<bool> used = scan_attrs(spec);
+    for (int i = 0; i < tupdesc->natts; ++i) {
+        const IcebergField *field =
+            used[i] ? iceberg_field(*t, NameStr(TupleDescAttr(tupdesc, i)->attname))
+                    : nullptr;
+        if (field)
+            columns.push_back(field->id);
+    }
+
+    std::string key = location + '\0' + std::to_string(ref->snapshot_id);
+    for (const IcebergPredicate &p : preds) {
+        key += '\0' + std::to_string(p.field_id) + ':' +
+               std::to_string((int)p.op) + ':';
+        append_key(&key, p.lo);
+        append_key(&key, p.hi);
+    }
+    key += '\0';
+    for (int id : columns)
+        key += std::to_string(id) + ',';
+
+    *table = t;
+    for (const auto &entry : iceberg_plans)
+        if (entry.first == key)
+            return entry.second;
+    auto plan = std::make_shared<const IcebergScanPlan>(
+        t->PlanScan(ref->snapshot_id, preds, columns, open));
+    if (iceberg_plans.size() >= kMaxIcebergPlans)
+        iceberg_plans.pop_front();
+    iceberg_plans.emplace_back(std::move(key), plan);
+    return plan;
+}
+
+/*
+ * Sets up a reader on an opened file; `key` names it in the footer cache.
+ * Its reads are added to `counters`.
+ */
+static ParquetReader *
+make_reader(std::shared_ptr<arrow::io::RandomAccessFile> source,
+            const std::string &key, bool remote, const ParquetScanSpec *spec,
+            std::shared_ptr<ReaderCounters> counters) {
+    std::unique_ptr<ParquetReader> reader(new ParquetReader());
+    if (spec->pool)
+        reader->pool = spec->pool->pool;
+    source = std::make_shared<CountedFile>(std::move(source), counters, false);
+    reader->counters = std::move(counters);
+    arrow::MemoryPool *pool = reader->pool ? reader->pool.get()
+                                           : arrow::default_memory_pool();
+    reader->source = source;
+    reader->reader =
+        open_arrow_reader(source, remote, file_metadata(source, key), pool);
+    reader->metadata = reader->reader->parquet_reader()->metadata();
+
+    std::shared_ptr<arrow::Schema> schema;
+    PARQUET_THROW_NOT_OK(reader->reader->GetSchema(&schema));
+    plan_projection(reader.get(), spec, *schema);
+    std::vector<int> dictionary_leaves =
+        plan_dictionaries(reader.get(), spec, *schema);
+    if (!dictionary_leaves.empty())
+        reader->reader = open_arrow_reader(source, remote, reader->metadata,
+                                           pool, &dictionary_leaves);
+    plan_filters(reader.get(), spec, *schema);
+    if (spec->ordered)
+        plan_order(reader.get(), spec, *schema);
+    reader->limit = (int64_t)spec->limit;
+
+    reader->next_row_group = 0;
+    reader->row = 0;
+    return reader.release();
+}
+
+extern "C" ParquetReader *parquet_reader_open(const char *path,
+                                              const ParquetScanSpec *spec) {
+    return pg_guard([&]() -> ParquetReader * {
+        std::string spath(path);
+        std::string version;
+        bool remote;
+        int64_t start = now_usecs();
+        auto counters = std::make_shared<ReaderCounters>(spec->instrument);
+        std::shared_ptr<arrow::io::RandomAccessFile> source =
+            open_source(spath, spec->s3, &version, &remote, counters);
+        if (!source)
+            return NULL;
+        ParquetReader *reader = make_reader(source, spath + '\0' + version,
+                                            remote, spec, counters);
+        counters->open_usecs = now_usecs() - start;
+        return reader;
+    });
+}
+
+int icebergc_files_in_flight = 8;
+
+/* S3 files up to this size are read whole by the request opening them. */
+static const int64_t kWholeFileSize = 1024 * 1024;
+
+/*
+ * The files of a scan, in the order it reads them. Up to
+ * icebergc_fdw.files_in_flight S3 objects, counting the one being read, are
+ * requested at a time, so the round trips of the next ones overlap with
+ * reading the current one; small ones come whole in that request and need
+ * no other. The requests complete on CRT threads. Local and HDFS files are
+ * opened by the backend when the scan reaches them.
+ */
+struct ParquetFileQueue {
+    const ParquetScanSpec *spec;
+    std::vector<std::string> paths;
+    std::vector<int64_t> sizes;  // -1 if unknown
+    std::vector<int64_t> rows;   // record counts, -1 if unknown
+    int64_t requested_rows = 0;  // of the files requested, -1 if unknown
+    /* From paths[next] on; invalid futures for files that are not on S3. */
+    std::deque<arrow::Future<S3OpenedFile>> opening;
+    size_t next = 0;      // next file to hand out
+    size_t requested = 0; // files opening has entries for
+};
+
+static void request_files(ParquetFileQueue *queue) {
+    size_t in_flight = std::max(icebergc_files_in_flight, 1);
+    while (queue->requested < queue->paths.size() &&
+           queue->requested < queue->next + in_flight) {
+        /* Without filters, the files requested hold the rows a LIMIT wants. */
+        if (queue->spec->limit > 0 && queue->spec->nfilters == 0 &&
+            queue->requested > queue->next && queue->requested_rows >= 0 &&
+            queue->requested_rows >= queue->spec->limit)
+            break;
+        std::string path = normalize_path(queue->paths[queue->requested]);
+        int64_t size = queue->sizes[queue->requested];
+        arrow::Future<S3OpenedFile> opening;
+        if (path.rfind("s3://", 0) == 0) {
+            std::string bucket, key;
+            split_s3_path(path, &bucket, &key);
+            IcebergcS3Options defaults = {};
+            opening = s3_open_file_async(
+                queue->spec->s3 ? *queue->spec->s3 : defaults, bucket, key,
+                size > 0 && size <= kWholeFileSize ? size : 0);
+        }
+        queue->opening.push_back(std::move(opening));
+        int64_t rows = queue->rows[queue->requested];
+        if (rows < 0 || queue->requested_rows < 0)
+            queue->requested_rows = -1;
+        else
+            queue->requested_rows += rows;
+        queue->requested++;
+    }
+}
+
+extern "C" ParquetFileQueue *parquet_queue_open(char **paths,
+                                                const int64 *sizes,
+                                                const int64 *rows, int n,
+                                                const ParquetScanSpec *spec) {
+    return pg_guard([&]() {
+        std::unique_ptr<ParquetFileQueue> queue(new ParquetFileQueue());
+        queue->spec = spec;
+        for (int i = 0; i < n; ++i) {
+            queue->paths.push_back(paths[i]);
+            queue->sizes.push_back(sizes ? sizes[i] : -1);
+            queue->rows.push_back(rows ? rows[i] : -1);
+        }
+        return queue.release();
+    });
+}
+
+extern "C" ParquetReader *parquet_queue_next(ParquetFileQueue *queue) {
+    return pg_guard([&]() -> ParquetReader * {
+        if (queue->next >= queue->paths.size())
+            return NULL;
+        request_files(queue);
+        arrow::Future<S3OpenedFile> opening = std::move(queue->opening.front());
+        queue->opening.pop_front();
+        const std::string &path = queue->paths[queue->next++];
+        int64_t start = now_usecs();
+        auto counters = std::make_shared<ReaderCounters>(queue->spec->instrument);
+        ParquetReader *reader;
+        if (!opening.is_valid()) {
+            std::string version;
+            bool remote;
+            std::shared_ptr<arrow::io::RandomAccessFile> source =
+                open_source(path, queue->spec->s3, &version, &remote, counters);
+            if (!source)
+                return NULL;
+            reader = make_reader(source, path + '\0' + version, remote,
+                                 queue->spec, counters);
+        } else {
+            /* Keep the future alive: result() refers into its shared state. */
+            const arrow::Result<S3OpenedFile> &opened = opening.result();
+            if (!opened.ok())
+                throw std::runtime_error(opened.status().message());
+            std::string spath = normalize_path(path);
+            std::shared_ptr<arrow::io::RandomAccessFile> source =
+                cache_wrap_file(
+                    std::make_shared<CountedFile>(opened->file, counters, true),
+                    spath, opened->etag);
+            reader = make_reader(source, path + '\0' + opened->etag, true,
+                                 queue->spec, counters);
+        }
+        /* For a file requested ahead, only what the scan waited for it. */
+        counters->open_usecs = now_usecs() - start;
+        return reader;
+    });
+}
+
+extern "C" void parquet_queue_close(ParquetFileQueue *queue) {
+    /* Requests still in flight hold their own references and finish alone. */
+    delete queue;
+}
+
+extern "C" bool parquet_estimate_scan(const char *path,
+                                      const ParquetScanSpec *spec,
+                                      ParquetScanEstimate *est,
+                                      bool *estimated) {
+    return pg_guard([&]() -> bool {
+        std::string spath(path);
+        std::string version;
+        bool remote;
+        std::shared_ptr<arrow::io::RandomAccessFile> source =
+            open_source(spath, spec->s3, &version, &remote);
+        if (!source)
+            return false;
+        std::unique_ptr<parquet::arrow::FileReader> reader = open_arrow_reader(
+            source, false, file_metadata(source, spath + '\0' + version));
+        std::shared_ptr<parquet::FileMetaData> metadata =
+            reader->parquet_reader()->metadata();
+        std::shared_ptr<arrow::Schema> schema;
+        PARQUET_THROW_NOT_OK(reader->GetSchema(&schema));
+        const parquet::arrow::SchemaManifest &manifest = reader->manifest();
+
+        std::vector<int> attr_field, fields, leaves;
+        scan_fields(spec, *schema, &attr_field, &fields);
+        for (int f : fields)
+            collect_leaves(manifest.schema_fields[f], leaves);
+
+        std::vector<AttrEstimate> attrs;
+        for (int i = 0; i < spec->nfilters; ++i) {
+            const ParquetFilter &pf = spec->filters[i];
+            Oid typid = TupleDescAttr(spec->tupdesc, pf.attnum)->atttypid;
+            estimated[i] = fold_filter(
+                attrs, pf.attnum, typid, pf.op, datum_key(pf.value1, typid),
+                pf.op == PARQUET_FILTER_BETWEEN ? datum_key(pf.value2, typid)
+                                                : FilterKey());
+        }
+        /* Attributes missing from the file read as NULL: no row passes. */
+        std::vector<int> attr_leaf;
+        bool missing = false;
+        for (const AttrEstimate &a : attrs) {
+            int field = attr_field[a.attnum];
+            missing = missing || field < 0;
+            attr_leaf.push_back(field >= 0 && manifest.schema_fields[field].is_leaf()
+                                    ? manifest.schema_fields[field].column_index
+                                    : -1);
+        }
+
+        memset(est, 0, sizeof(*est));
+        est->tuples = (double)metadata->num_rows();
+        est->files = 1;
+        est->remote = remote;
+        for (int rg = 0; rg < metadata->num_row_groups() && !missing; ++rg) {
+            std::unique_ptr<parquet::RowGroupMetaData> meta =
+                metadata->RowGroup(rg);
+            double rows = (double)meta->num_rows();
+            double share = 1;
+            for (size_t j = 0; j < attrs.size() && share > 0; ++j) {
+                const AttrEstimate &a = attrs[j];
+                AttrStats st;
+                std::shared_ptr<parquet::Statistics> stats;
+                if (attr_leaf[j] >= 0) {
+                    std::unique_ptr<parquet::ColumnChunkMetaData> chunk =
+                        meta->ColumnChunk(attr_leaf[j]);
+                    if (chunk->is_stats_set())
+                        stats = chunk->statistics();
+                }
+                if (stats && stats->HasNullCount())
+                    st.nulls = stats->null_count();
+                if (stats && stats->HasMinMax())
+                    st.has_bounds = stats_keys(
+                        *stats, a.kind, *schema->field(attr_field[a.attnum])->type(),
+                        a.typid, &st.min, &st.max);
+                share *= attr_share(a, st, rows);
+            }
+            /* The reader skips the row groups the statistics rule out. */
+            if (share <= 0)
+                continue;
+            est->scanned += rows;
+            est->row_groups += 1;
+            est->rows += rows * share;
+            for (int leaf : leaves)
+                est->bytes += (double)meta->ColumnChunk(leaf)->total_compressed_size();
+        }
+        return true;
+    });
+}
+
+extern "C" bool parquet_reader_next(ParquetReader *reader, Datum *values,
+                                    bool *nulls) {
+    if (!reader)
+        return false;
+    return pg_guard([&]() -> bool {
+        if (reader->row >= reader->batch_rows) {
+            if (!advance_batch(reader))
+                return false;
+        }
+
+        int64_t r = reader->filters.empty() ? reader->row
+                                            : reader->selection[reader->row];
+        reader->row++;
+        int64_t start = reader_timed(reader) ? now_usecs() : 0;
+        int natts = static_cast<int>(reader->columns.size());
+        for (int i = 0; i < natts; ++i) {
+            const ColumnConverter &conv = reader->columns[i];
+            if (conv.field < 0 || reader->arrays[conv.field]->IsNull(r)) {
+                nulls[i] = true;
+                continue;
+            }
+            values[i] = conv.convert(*reader->arrays[conv.field], r, conv);
+            nulls[i] = false;
+        }
+        if (start)
+            reader->convert_usecs += now_usecs() - start;
+        return true;
+    });
+}
+
+extern "C" int64 parquet_reader_skip(ParquetReader *reader, int64 n) {
+    if (!reader)
+        return 0;
+    return pg_guard([&]() -> int64 {
+        int64_t skipped = 0;
+        while (skipped < n) {
+            if (reader->row >= reader->batch_rows && !advance_batch(reader))
+                break;
+            int64_t step =
+                std::min<int64_t>(n - skipped, reader->batch_rows - reader->row);
+            reader->row += step;
+            skipped += step;
+        }
+        return skipped;
+    });
+}
+
+extern "C" void parquet_reader_row_group(ParquetReader *reader, int rg,
+                                         int64 *rows, int64 *bytes) {
+    pg_guard([&]() {
+        std::unique_ptr<parquet::RowGroupMetaData> meta =
+            reader->metadata->RowGroup(rg);
+        *rows = meta->num_rows();
+        *bytes = 0;
+        for (int leaf : reader->leaves)
+            *bytes += meta->ColumnChunk(leaf)->total_compressed_size();
+    });
+}
+
+extern "C" void parquet_reader_set_bound(ParquetReader *reader, Datum bound) {
+    if (!reader || !reader->ordered)
+        return;
+    pg_guard([&]() {
+        reader->bound = datum_key(bound, reader->order_typid);
+        reader->has_bound = true;
+    });
+}
+
+extern "C" void parquet_reader_summarize(ParquetReader *reader,
+                                         const int *attnums,
+                                         const bool *bounds, int n,
+                                         const ParquetScanSpec *spec) {
+    pg_guard([&]() {
+        std::shared_ptr<arrow::Schema> schema;
+        PARQUET_THROW_NOT_OK(reader->reader->GetSchema(&schema));
+        const parquet::arrow::SchemaManifest &manifest =
+            reader->reader->manifest();
+
+        reader->summary.assign(n, SummaryColumn());
+        for (int i = 0; i < n; ++i) {
+            SummaryColumn &c = reader->summary[i];
+            c.attnum = attnums[i];
+            c.bounds = bounds[i];
+            c.leaf = -1;
+            if (c.attnum < 0)
+                continue;
+            Form_pg_attribute attr = TupleDescAttr(spec->tupdesc, c.attnum);
+            c.typid = attr->atttypid;
+            c.kind = key_kind(c.typid);
+            int field = find_field(*schema, NameStr(attr->attname));
+            c.missing = field < 0;
+            if (c.missing)
+                continue;
+            if (manifest.schema_fields[field].is_leaf())
+                c.leaf = manifest.schema_fields[field].column_index;
+            c.type = schema->field(field)->type();
+        }
+        reader->summarizing = true;
+    });
+}
+
+extern "C" void parquet_reader_get_summary(ParquetReader *reader, int64 *rows,
+                                           ParquetColumnSummary *columns) {
+    *rows = reader->summary_rows;
+    for (size_t i = 0; i < reader->summary.size(); ++i) {
+        const SummaryColumn &c = reader->summary[i];
+        ParquetColumnSummary &out = columns[i];
+        out.nonnull = c.attnum < 0 ? reader->summary_rows : c.nonnull;
+        out.has_bounds = c.has_bounds;
+        if (c.has_bounds) {
+            int_key_datum(c.min, c.typid, &out.min);
+            int_key_datum(c.max, c.typid, &out.max);
+        }
+    }
+}
+
+extern "C" void parquet_reader_select_row_groups(ParquetReader *reader,
+                                                 const int *row_groups, int n) {
+    reader->prefetch.reset();
+    reader->row_groups.assign(row_groups, row_groups + n);
+    reader->next_row_group = 0;
+}
+
+extern "C" void parquet_reader_get_stats(ParquetReader *reader,
+                                         ParquetReaderStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!reader)
+        return;
+    stats->row_groups = reader->metadata->num_row_groups();
+    stats->row_groups_pruned = reader->row_groups_pruned;
+    stats->row_groups_pruned_pages = reader->row_groups_pruned_pages;
+    stats->row_groups_pruned_bloom = reader->row_groups_pruned_bloom;
+    stats->row_groups_summarized = reader->row_groups_summarized;
+    stats->rows_filtered = reader->rows_filtered;
+    if (!reader->counters)
+        return;
+    const ReaderCounters &counters = *reader->counters;
+    stats->bytes_read = counters.bytes;
+    stats->bytes_remote = counters.remote_bytes;
+    stats->fetch_time = counters.fetch_usecs / 1000.0;
+    stats->decode_time = counters.decode_usecs / 1000.0;
+    stats->filter_time = reader->filter_usecs / 1000.0;
+    stats->convert_time = reader->convert_usecs / 1000.0;
+    stats->open_time = counters.open_usecs / 1000.0;
+}
+
+extern "C" bool parquet_filter_exact(Oid typid, ParquetFilterOp op) {
+    return filter_exact(key_kind(typid), op);
+}
+
+extern "C" bool parquet_orderable(Oid typid, bool desc) {
+    /* Parquet leaves NaN, which sorts above all, out of the max. */
+    KeyKind kind = key_kind(typid);
+    return kind == KeyKind::INT || (kind == KeyKind::FLOAT && !desc);
+}
+
+extern "C" bool parquet_exact_bounds(Oid typid) {
+    return key_kind(typid) == KeyKind::INT;
+}
+
+extern "C" void parquet_reader_close(ParquetReader *reader) {
+    delete reader;
+}
+
+extern "C" ParquetMemoryPool *parquet_pool_create(int64 cache_size) {
+    ParquetMemoryPool *pool = new ParquetMemoryPool();
+    pool->pool = std::make_shared<ScanMemoryPool>(
+        (int64_t)icebergc_scan_memory_limit * 1024, cache_size);
+    return pool;
+}
+
+extern "C" int64 parquet_pool_peak(ParquetMemoryPool *pool) {
+    return pool->pool->max_memory();
+}
+
+extern "C" void parquet_pool_close(ParquetMemoryPool *pool) {
+    delete pool;
+}
+
+extern "C" void iceberg_plan_files(const IcebergTableRef *table,
+                                   const ParquetScanSpec *spec,
+                                   IcebergScanFiles *files) {
+    std::shared_ptr<const IcebergScanPlan> plan = pg_guard([&]() {
+        std::shared_ptr<IcebergTable> t;
+        std::vector<int> pred_filter;
+        return iceberg_scan_plan(table, spec, &t, &pred_filter);
+    }, "iceberg scan planning failed");
+
+    files->nfiles = (int)plan->files.size();
+    files->paths = (char **)palloc(sizeof(char *) * (plan->files.size() + 1));
+    files->rows = (int64 *)palloc(sizeof(int64) * (plan->files.size() + 1));
+    files->sizes = (int64 *)palloc(sizeof(int64) * (plan->files.size() + 1));
+    for (size_t i = 0; i < plan->files.size(); ++i) {
+        files->paths[i] = pstrdup(plan->files[i].path.c_str());
+        files->rows[i] = plan->files[i].record_count;
+        files->sizes[i] = plan->files[i].file_size;
+    }
+    files->manifests = plan->manifests;
+    files->manifests_pruned = plan->manifests_pruned;
+    files->files_pruned = plan->files_pruned;
+}
+
+extern "C" void iceberg_estimate_scan(const IcebergTableRef *table,
+                                      const ParquetScanSpec *spec,
+                                      ParquetScanEstimate *est,
+                                      bool *estimated) {
+    pg_guard([&]() {
+        std::shared_ptr<IcebergTable> t;
+        std::vector<int> pred_filter;
+        std::shared_ptr<const IcebergScanPlan> plan =
+            iceberg_scan_plan(table, spec, &t, &pred_filter);
+
+        /* Only filters that became predicates have per-file statistics. */
+        std::vector<AttrEstimate> attrs;
+        std::vector<int> attr_pred;
+        memset(estimated, 0, sizeof(bool) * spec->nfilters);
+        for (size_t p = 0; p < pred_filter.size(); ++p) {
+            const ParquetFilter &pf = spec->filters[pred_filter[p]];
+            Oid typid = TupleDescAttr(spec->tupdesc, pf.attnum)->atttypid;
+            size_t n = attrs.size();
+            estimated[pred_filter[p]] = fold_filter(
+                attrs, pf.attnum, typid, pf.op, datum_key(pf.value1, typid),
+                pf.op == PARQUET_FILTER_BETWEEN ? datum_key(pf.value2, typid)
+                                                : FilterKey());
+            if (attrs.size() > n)
+                attr_pred.push_back((int)p);
+        }
+
+        memset(est, 0, sizeof(*est));
+        est->files = (double)plan->files.size();
+        est->row_groups = est->files;
+        for (const IcebergDataFile &file : plan->files) {
+            double rows = (double)std::max<int64_t>(file.record_count, 0);
+            std::string path = normalize_path(file.path);
+            est->remote = est->remote || path.rfind("s3://", 0) == 0 ||
+                          path.rfind("hdfs://", 0) == 0;
+            est->scanned += rows;
+            est->bytes += (double)std::max<int64_t>(file.scan_size, 0);
+
+            double share = 1;
+            for (size_t j = 0; j < attrs.size(); ++j) {
+                const AttrEstimate &a = attrs[j];
+                const IcebergColumnStats &fs = file.stats[attr_pred[j]];
+                int64_t shift = epoch_shift(a.typid);
+                AttrStats st;
+                st.nulls = fs.null_count;
+                st.has_bounds =
+                    fs.has_bounds &&
+                    !__builtin_sub_overflow(fs.lower.i, shift, &st.min.i) &&
+                    !__builtin_sub_overflow(fs.upper.i, shift, &st.max.i);
+                st.min.f = fs.lower.f;
+                st.min.s = fs.lower.s;
+                st.max.f = fs.upper.f;
+                st.max.s = fs.upper.s;
+                share *= attr_share(a, st, rows);
+            }
+            est->rows += rows * share;
+        }
+        est->tuples = std::max((double)t->TotalRecords(table->snapshot_id),
+                               est->scanned);
+    }, "iceberg scan planning failed");
+}
@@ -1,6 +1,8 @@
 #ifndef PARQUET_UTILS_H
 #define PARQUET_UTILS_H
 
+#include "icebergc_s3.h"
+
 #ifdef __cplusplus
 #include <cstddef>
 #include <cstdint>
@@ -29,14 +31,270 @@ std::vector<RowTuple> parse_parquet_buffer(const uint8_t *data,
 extern "C" {
 #endif
 
-#include <stdbool.h>
+#include "postgres.h"
+#include "access/tupdesc.h"
 
 typedef struct ParquetReader ParquetReader;
+typedef struct ParquetMemoryPool ParquetMemoryPool;
+
+typedef enum ParquetFilterOp {
+    PARQUET_FILTER_EQ,
+    PARQUET_FILTER_NE,
+    PARQUET_FILTER_LT,
+    PARQUET_FILTER_LE,
+    PARQUET_FILTER_GT,
+    PARQUET_FILTER_GE,
+    PARQUET_FILTER_BETWEEN
+} ParquetFilterOp;
+
+/*
+ * A pushed-down comparison of one attribute against constants. The values are
+ * already of the attribute's type; text values must be detoasted.
+ */
+typedef struct ParquetFilter {
+    int attnum;         /* 0-based index into the tuple descriptor */
+    ParquetFilterOp op;
+    Datum value1;
+    Datum value2;       /* upper bound, BETWEEN only */
+} ParquetFilter;
+
+/* What a scan wants from the file; see parquet_reader_open. */
+typedef struct ParquetScanSpec {
+    TupleDesc tupdesc;      /* layout of the tuples to produce */
+    const bool *attrs_used; /* per attribute, NULL for all; others read NULL */
+    const ParquetFilter *filters; /* rows failing an exact one are skipped */
+    int nfilters;
+    const IcebergcS3Options *s3;  /* for s3:// paths, NULL for defaults */
+    ParquetMemoryPool *pool;      /* for decoded data, NULL for Arrow's */
+    bool instrument;        /* time the reads and each stage of decoding */
+    /* Top-N scans read row groups best first; see parquet_reader_set_bound. */
+    bool ordered;           /* rows are wanted in order of order_attnum */
+    int order_attnum;       /* 0-based index into the tuple descriptor */
+    bool order_desc;
+    bool order_nulls_first;
+    double limit;           /* rows the scan is expected to return, 0 if all */
+} ParquetScanSpec;
+
+/*
+ * What the planner is told of a scan; see parquet_estimate_scan. Sizes are
+ * doubles, as the planner's are.
+ */
+typedef struct ParquetScanEstimate {
+    double tuples;  /* rows in the table */
+    double scanned; /* rows in the row groups or files statistics keep */
+    double rows;    /* of those, rows expected to pass the estimated filters */
+    double bytes;   /* compressed size of the columns read from those */
+    double files;   /* data files to open */
+    double row_groups; /* row groups holding the scanned rows; for Iceberg,
+                        * the data files */
+    bool remote;    /* on S3 or HDFS rather than a local disk */
+} ParquetScanEstimate;
+
+typedef struct ParquetReaderStats {
+    int64 row_groups;        /* row groups in the file */
+    int64 row_groups_pruned; /* skipped using column statistics */
+    int64 row_groups_pruned_pages; /* of those, by the page index */
+    int64 row_groups_pruned_bloom; /* or by bloom filters */
+    int64 row_groups_summarized; /* answered from them; see
+                                  * parquet_reader_summarize */
+    int64 rows_filtered;     /* decoded rows dropped by the filters */
+    int64 bytes_read;        /* read from the file, footer included */
+    int64 bytes_remote;      /* fetched from S3 or HDFS: with the local cache,
+                              * the blocks it missed */
+    double open_time;        /* ms opening the file and reading its footer;
+                              * for files requested ahead, the wait for them */
+    /* With ParquetScanSpec.instrument, in milliseconds: */
+    double fetch_time;       /* reads until their data was there, summed */
+    double decode_time;      /* decoding row groups, waits for reads included */
+    double filter_time;      /* evaluating the filters */
+    double convert_time;     /* making Datums of the rows returned */
+} ParquetReaderStats;
+
+/*
+ * Whether the reader evaluates a filter with this operator on an attribute of
+ * this type exactly as Postgres would, so the executor need not recheck it.
+ * The reader ignores other filters.
+ */
+bool parquet_filter_exact(Oid typid, ParquetFilterOp op);
+
+/*
+ * Whether row group statistics of an attribute of this type order row groups
+ * as Postgres orders the values, ascending or descending, so a top-N scan
+ * can read them best first.
+ */
+bool parquet_orderable(Oid typid, bool desc);
+
+/*
+ * Whether row group statistics give the exact min and max of an attribute of
+ * this type, so aggregate scans can answer min/max from them.
+ */
+bool parquet_exact_bounds(Oid typid);
+
+/* icebergc_fdw.metadata_cache_size, in kB; 0 disables the footer cache. */
+extern int icebergc_metadata_cache_size;
+
+/*
+ * icebergc_fdw.prefetch_row_groups: row groups a reader decodes ahead of the
+ * cursor on a thread of its own; 0 decodes them on the backend thread.
+ */
+extern int icebergc_prefetch_row_groups;
+
+/*
+ * icebergc_fdw.scan_memory_limit, in kB: decoded data the readers of a scan
+ * may hold at once; 0 for no limit.
+ */
+extern int icebergc_scan_memory_limit;
+
+/*
+ * Memory for the decoded data of a scan's readers, counted against
+ * icebergc_fdw.scan_memory_limit as of its creation. Past half the limit the
+ * readers stop decoding row groups ahead; an allocation past it fails the
+ * read. Freed buffers, up to cache_size bytes, are kept for the next row
+ * groups. Readers keep the pool alive until they are closed.
+ */
+ParquetMemoryPool *parquet_pool_create(int64 cache_size);
+/* The most bytes the pool has had allocated at once. */
+int64 parquet_pool_peak(ParquetMemoryPool *pool);
+void parquet_pool_close(ParquetMemoryPool *pool);
+
+/*
+ * Estimates a scan of one file from its footer: the rows of each row group
+ * and the share passing the filters, from the column chunks' min/max and
+ * null counts. Sets estimated[i] for each filter accounted for in est->rows;
+ * the others are left to the planner. Footers are cached per backend, so
+ * planning and then scanning a file parses it once. Returns false if a local
+ * file does not exist.
+ */
+bool parquet_estimate_scan(const char *path, const ParquetScanSpec *spec,
+                           ParquetScanEstimate *est, bool *estimated);
+
+/* Where an Iceberg table's metadata is found; see iceberg_plan_files. */
+typedef struct IcebergTableRef {
+    const char *metadata_location; /* a metadata.json file, or NULL */
+    const char *table_location;    /* else the table's directory, laid out
+                                    * by the Hadoop catalog */
+    int64 snapshot_id;             /* 0 for the current snapshot */
+    const IcebergcS3Options *s3;   /* for s3:// paths, NULL for defaults */
+} IcebergTableRef;
 
-ParquetReader *parquet_reader_open(const char *path);
-bool parquet_reader_next(ParquetReader *reader, char **values, int ncols);
+typedef struct IcebergScanFiles {
+    int nfiles;
+    char **paths;           /* data files to scan, palloc'd */
+    int64 *rows;            /* record count per file, -1 if unknown */
+    int64 *sizes;           /* size in bytes per file, -1 if unknown */
+    int64 manifests;        /* data manifests of the snapshot */
+    int64 manifests_pruned; /* skipped using partition summaries */
+    int64 files_pruned;     /* skipped using partitions or column bounds */
+} IcebergScanFiles;
+
+/*
+ * Plans a scan of an Iceberg table: lists the data files of the snapshot that
+ * may hold rows passing the spec's filters. Filters are matched to table
+ * columns by name and only used where the column types agree. Parsed
+ * metadata files and recent plans are cached per backend.
+ */
+void iceberg_plan_files(const IcebergTableRef *table,
+                        const ParquetScanSpec *spec, IcebergScanFiles *files);
+
+/*
+ * Like parquet_estimate_scan, for the data files iceberg_plan_files would
+ * list: their record counts, column sizes and per-file column statistics.
+ */
+void iceberg_estimate_scan(const IcebergTableRef *table,
+                           const ParquetScanSpec *spec,
+                           ParquetScanEstimate *est, bool *estimated);
+
+/*
+ * Opens a file for a scan. Readers may run a thread decoding row groups ahead
+ * of the cursor, so one left behind by an error must still be closed; the
+ * thread never calls into Postgres.
+ */
+ParquetReader *parquet_reader_open(const char *path, const ParquetScanSpec *spec);
+bool parquet_reader_next(ParquetReader *reader, Datum *values, bool *nulls);
+void parquet_reader_get_stats(ParquetReader *reader, ParquetReaderStats *stats);
+
+/*
+ * Skips up to n rows without converting them. Returns how many were skipped,
+ * fewer only at the end of the file.
+ */
+int64 parquet_reader_skip(ParquetReader *reader, int64 n);
+
+/*
+ * Row group rg's row count and the compressed size of the column chunks the
+ * reader would fetch from it; see parquet_reader_get_stats for the count.
+ */
+void parquet_reader_row_group(ParquetReader *reader, int rg, int64 *rows,
+                              int64 *bytes);
+
+/*
+ * Top-N scans: the value of the spec's order attribute the N-th best row
+ * found so far has. Row groups whose statistics show that none of their rows
+ * can beat it are skipped; as they are read best first, the scan ends at the
+ * first one.
+ */
+void parquet_reader_set_bound(ParquetReader *reader, Datum bound);
+
+/* What the row groups an aggregate scan summarized hold of an attribute. */
+typedef struct ParquetColumnSummary {
+    int64 nonnull;   /* values that are not NULL */
+    bool has_bounds; /* whether min and max are set; false if nonnull is 0 */
+    Datum min;
+    Datum max;
+} ParquetColumnSummary;
+
+/*
+ * Aggregate scans: row groups whose statistics show that all their rows pass
+ * the filters, and give the null count of each of the n attributes (0-based;
+ * -1 for none) and, where bounds[i] is set, their exact min and max, are not
+ * decoded. Only the other row groups' rows are returned; what the skipped
+ * ones hold is added up for parquet_reader_get_summary. Exact bounds are
+ * known for integer, boolean, date and timestamp attributes. Call before the
+ * first row.
+ */
+void parquet_reader_summarize(ParquetReader *reader, const int *attnums,
+                              const bool *bounds, int n,
+                              const ParquetScanSpec *spec);
+
+/*
+ * The rows of the summarized row groups, and per attribute given to
+ * parquet_reader_summarize what they hold of it. Integer attributes wider
+ * than a Datum are palloc'd.
+ */
+void parquet_reader_get_summary(ParquetReader *reader, int64 *rows,
+                                ParquetColumnSummary *columns);
+
+/* Reads only these row groups, in this order. Call before the first row. */
+void parquet_reader_select_row_groups(ParquetReader *reader,
+                                      const int *row_groups, int n);
 void parquet_reader_close(ParquetReader *reader);
 
+/*
+ * icebergc_fdw.files_in_flight: S3 files a scan keeps requested, counting
+ * the one being read.
+ */
+extern int icebergc_files_in_flight;
+
+/*
+ * The files of a scan, read in order. S3 objects are requested ahead of the
+ * reader, and small ones, by sizes when given, are read whole by that one
+ * request. Without filters, files past the spec's limit by their record
+ * counts (rows, when given) are not requested until the scan gets to them.
+ * spec must outlive the queue.
+ */
+typedef struct ParquetFileQueue ParquetFileQueue;
+
+ParquetFileQueue *parquet_queue_open(char **paths, const int64 *sizes,
+                                     const int64 *rows, int n,
+                                     const ParquetScanSpec *spec);
+
+/*
+ * Opens a reader on the next file, like parquet_reader_open. Returns NULL
+ * after the last file, or if the next one is a local file that does not
+ * exist.
+ */
+ParquetReader *parquet_queue_next(ParquetFileQueue *queue);
+void parquet_queue_close(ParquetFileQueue *queue);
+
 #ifdef __cplusplus
 }
 #endif
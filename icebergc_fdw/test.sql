@@ -22,3 +22,86 @@ SELECT id, name FROM iceberg_tbl WHERE active = true ORDER BY id;
 
 -- Query testing various data types
 SELECT id, price, active, created_at FROM iceberg_tbl ORDER BY created_at DESC LIMIT 3;
+
+-- ORDER BY ... LIMIT is sorted by the scan, which reads row groups best first
+EXPLAIN (COSTS OFF)
+SELECT id, price, active, created_at FROM iceberg_tbl ORDER BY created_at DESC LIMIT 3;
+
+-- WITH TIES may return more rows than asked for, so it is not pushed down
+SELECT count(*) FROM (SELECT * FROM iceberg_tbl ORDER BY active FETCH FIRST 1 ROWS WITH TIES) t;
+
+-- count/min/max without GROUP BY are computed by the scan, mostly from statistics
+EXPLAIN (COSTS OFF)
+SELECT count(*), min(created_at), max(created_at) FROM iceberg_tbl;
+SELECT count(*), min(created_at), max(created_at) FROM iceberg_tbl;
+SELECT count(*), max(id) FROM iceberg_tbl WHERE id > 500;
+
+-- Range filter on a time column; row groups outside the range are skipped
+SELECT count(*) FROM iceberg_tbl
+WHERE created_at BETWEEN '2024-01-01' AND '2024-01-02';
+
+-- Comparisons the reader evaluates itself are not rechecked by the executor
+EXPLAIN (COSTS OFF)
+SELECT id, name FROM iceberg_tbl WHERE id BETWEEN 10 AND 20 AND name = 'foo';
+
+-- S3 client tuning options are validated when set
+ALTER SERVER iceberg_srv OPTIONS (ADD s3_max_connections '16', ADD s3_part_size '8MB');
+ALTER SERVER iceberg_srv OPTIONS (ADD s3_throughput_target_gbps '0');
+ALTER SERVER iceberg_srv OPTIONS (DROP s3_max_connections, DROP s3_part_size);
+
+-- Block cache counters; all zero while icebergc_fdw.cache_dir is unset
+SELECT * FROM icebergc_fdw_cache_stats();
+
+-- An Iceberg table (Hadoop catalog layout under warehouse) is read through
+-- its snapshot's manifests; partitions and files that cannot match are skipped
+CREATE FOREIGN TABLE iceberg_events (
+    id bigint,
+    ts timestamp,
+    region text
+) SERVER iceberg_srv OPTIONS (warehouse '/tmp/warehouse', table_name 'db.events');
+SELECT count(*) FROM iceberg_events WHERE ts >= '2024-01-05' AND ts < '2024-01-07';
+SELECT count(*) FROM iceberg_events WHERE region = 'eu';
+SET icebergc_fdw.files_in_flight = 1;
+SELECT count(*) FROM iceberg_events;
+RESET icebergc_fdw.files_in_flight;
+ALTER FOREIGN TABLE iceberg_events OPTIONS (ADD snapshot_id 'latest');
+
+-- Hive Metastore connection options are validated when set
+ALTER SERVER iceberg_srv OPTIONS (ADD hms_transport 'framed', ADD hms_timeout '5s');
+ALTER SERVER iceberg_srv OPTIONS (SET hms_transport 'http');
+ALTER SERVER iceberg_srv OPTIONS (DROP hms_transport, DROP hms_timeout);
+SELECT icebergc_fdw_hms_invalidate(NULL, 'iceberg_tbl');
+SELECT icebergc_fdw_hms_invalidate();
+
+-- Row groups are shared out between the processes of a parallel scan
+SET max_parallel_workers_per_gather = 2;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+EXPLAIN (COSTS OFF) SELECT sum(id) FROM iceberg_tbl;
+SELECT sum(id) FROM iceberg_tbl;
+RESET max_parallel_workers_per_gather;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+
+-- Row groups are decoded ahead of the scan unless prefetching is off
+SET icebergc_fdw.prefetch_row_groups = 0;
+SELECT count(*) FROM iceberg_tbl;
+RESET icebergc_fdw.prefetch_row_groups;
+
+-- EXPLAIN shows the reader's filters and columns; ANALYZE adds what it read
+EXPLAIN (COSTS OFF) SELECT id FROM iceberg_tbl WHERE id < 100;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT id FROM iceberg_tbl WHERE id < 100;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM iceberg_events WHERE region = 'eu';
+
+-- Counters of all backends; needs shared_preload_libraries = 'icebergc_fdw'
+SELECT icebergc_fdw_stats_reset();
+SELECT count(*) FROM iceberg_tbl;
+SELECT name, value FROM icebergc_fdw_stats
+WHERE name IN ('scans', 'files_opened', 'local_bytes_read');
+
+-- Equality filters also prune row groups with the page index and bloom filters
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF)
+SELECT * FROM iceberg_tbl WHERE id = 12345;